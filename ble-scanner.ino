@@ -35,8 +35,13 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
-#include <WebServer.h>
+#include <esp_heap_caps.h>
+#include <esp_http_server.h>
+#include <esp_rom_crc.h>
+#include <lwip/sockets.h>
 #include <time.h>
+#include <atomic>
+#include <new>
 
 #include "secrets.h"
 
@@ -72,16 +77,237 @@ SPIClass sdSPI(VSPI);
 #define DEVICE_ROW_HEIGHT 46
 #define MAX_VISIBLE_DEVICES 6
 #define ROW_START_Y (HEADER_HEIGHT + 5)
+#define LIST_HEIGHT (MAX_VISIBLE_DEVICES * DEVICE_ROW_HEIGHT)
+
+// The device list is composed in horizontal strips in RAM sprites and pushed
+// by DMA. Each buffer costs SCREEN_WIDTH * DISPLAY_STRIP_HEIGHT * 2 bytes
+// (22 KB at 23 lines); lower either to fit beside BLE + WiFi. With 0 buffers
+// rows are drawn straight to the panel and scrolling jumps a row at a time.
+#define DISPLAY_STRIP_BUFFERS 2     // 0 = direct drawing, 1 = no overlap, 2 = compose during DMA
+#define DISPLAY_STRIP_HEIGHT 23     // Lines per strip (half a row)
+#define SCROLL_STEP_PX 8            // Smooth scroll distance per frame
+#define DISPLAY_FRAME_MS 16         // Frame period while scrolling
+#define RSSI_METER_INTERVAL 250     // Live row refresh period (4 Hz)
+#define DISPLAY_VIEW VIEW_STATUS    // Default list order (DeviceView)
+#define BOOT_SPLASH_MS 1500         // Longest the splash waits for the background boot steps
 
 // ============================================================================
 // BLE Scanning Constants
 // ============================================================================
 
+#define SCAN_CONTINUOUS true      // Default mode: the controller never stops (false = SCAN_DURATION every SCAN_INTERVAL)
+#define SCAN_PROFILE PROFILE_WIFI_COEXIST  // Default interval/window (ScanProfileId)
 #define SCAN_DURATION 5           // Seconds per scan cycle
-#define SCAN_INTERVAL 10000       // Milliseconds between scans
+#define SCAN_INTERVAL 10000       // Milliseconds between scans (continuous mode: between housekeeping passes)
+#define SCAN_RETRY_MS 1000        // Wait before restarting a continuous scan that failed to start
+#define SCAN_ACTIVE ACTIVE_ADAPTIVE  // Default scan request policy (ActiveScanMode)
+#define ACTIVE_BURST_MS 3000      // Length of an adaptive active burst in continuous mode (cycle mode: one whole scan)
+#define ACTIVE_BURST_GAP 30000    // Least passive time between bursts (ms)
+#define ACTIVE_BURST_TRIES 3      // Bursts an unresolved device is heard in before it stops triggering them
 #define DEVICE_TIMEOUT 60000      // Milliseconds before device removed
 #define NEW_DEVICE_THRESHOLD 300000  // Milliseconds to show as "new" (5 min)
-#define MAX_TRACKED_DEVICES 50    // Maximum devices to track in memory
+#define MAX_TRACKED_DEVICES 200   // Maximum devices to track in memory
+#define EVICTION_POLICY EVICT_PRIORITY  // Which device makes room when the table is full (EvictionPolicy)
+#define EVICT_WEIGHT_MS_PER_DB 500      // Weighted eviction: each dB of signal counts as this much recency
+#define ROTATION_HANDOFF_MS 10000 // A new private address may continue a device heard this recently (0 = never)
+#define ROTATION_RSSI_DELTA 12    // ...at no more than this many dB from its last RSSI
+#define STATUS_DEVICE_BATCH 8     // Devices copied per deviceMutex hold while streaming /status
+#define CHANGE_RSSI_DELTA 5       // dB an RSSI must move to count as a change for /status?since
+#define REMOVED_LOG_SIZE 64       // Removals remembered for /status?since
+#define DEVICE_HASH_SIZE 512      // Address hash index slots (power of 2, >= 2x MAX_TRACKED_DEVICES)
+#define DEVICE_SLOT_EMPTY -1      // Unused hash index slot
+#define DEVICE_NAME_LEN 20        // Name characters stored per device
+#define RSSI_BUCKET_INTERVAL 60000   // Default ms of RSSI samples folded into one log record
+
+// ============================================================================
+// Advertisement Ingest Constants
+// ============================================================================
+
+#define INGEST_QUEUE_SIZE 64      // Advert records buffered between BLE callback and tracker (power of 2)
+#define INGEST_BATCH_SIZE 16      // Max records drained per deviceMutex hold
+#define ADVERT_NAME_LEN 20        // Advertised name bytes kept per record
+#define ADVERT_PAYLOAD_MAX 62     // Advertising data + scan response bytes kept per record
+
+// AdvertRecord.flags bits
+#define ADV_HAS_NAME     0x01     // name[] holds the advertised name
+#define ADV_HAS_MFG_ID   0x02     // mfgId holds the manufacturer company ID
+#define ADV_HAS_MFG_TYPE 0x04     // mfgType holds the byte following the company ID
+#define ADV_HAS_UUID16   0x08     // serviceUuid16 holds the first 16-bit service UUID
+
+// ============================================================================
+// SD Log Writer Constants
+// ============================================================================
+
+#define LOG_DIR "/ble-logs"
+#define LOG_SECTOR_SIZE 512       // FAT sector size; threshold flushes end on a sector boundary
+#define LOG_BUFFER_SIZE 4096      // RAM buffer for pending CSV lines
+#define LOG_FLUSH_THRESHOLD 2048  // Write out once this many bytes are pending
+#define LOG_FLUSH_INTERVAL 10000  // Max ms a line waits in RAM before reaching the card
+#define LOG_LINE_MAX 128          // Longest formatted CSV line
+#define LOG_CSV_CHUNK 1436        // Streamed response bytes per sendContent() (one TCP segment)
+
+// Binary log (.bin records + .nam name table)
+#define LOG_NAME_SLOT DEVICE_NAME_LEN  // Bytes per name table slot, NUL padded
+#define LOG_NAME_NONE 0xFFFF      // LogRecord.nameRef for an unnamed device
+#define LOG_NAME_INDEX_SIZE 512   // Today's names indexed for dedupe (power of 2)
+#define LOG_NAME_BUFFER_SIZE (LOG_NAME_SLOT * 8)  // New names pending for the .nam file
+#define LOG_NAME_CACHE_SIZE 32    // Name slots cached while exporting CSV
+
+// Gzip: downloads compressed on the fly, previous days' logs once as .csv.gz
+#define GZIP_WINDOW 2048          // LZ77 history in bytes (power of 2); the writer is ~10 KB
+#define GZIP_HASH_BITS 10         // Hash table of 3-byte prefixes
+#define GZIP_MAX_CHAIN 16         // Earlier matches tried per position
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+#define GZIP_OUT_BUFFER 128       // Compressed bytes gathered per write to the sink
+#define LOG_COMPRESS_SLICE_MS 10  // Storage task time per compression step...
+#define LOG_COMPRESS_IDLE_MS 30   // ...and the pause after it, for lower-priority tasks
+
+// LogRecord.flags: status in bits 0-1, timestamp kind in bit 2, record kind in bits 4-7
+#define LOG_STATUS_MASK 0x03
+#define LOG_STATUS_UNKNOWN 0
+#define LOG_STATUS_NEW 1
+#define LOG_STATUS_KNOWN 2
+#define LOG_FLAG_UPTIME 0x04      // time holds millis() because NTP had not synced
+#define LOG_KIND_SHIFT 4
+#define LOG_KIND_SIGHTING 0       // New device detection (LogRecord)
+#define LOG_KIND_RSSI 1           // Per-device RSSI bucket (LogRssiRecord)
+#define VALID_TIME_EPOCH 1609459200  // 2021-01-01; earlier clock means NTP has not synced
+
+// ============================================================================
+// Task Layout Constants
+// ============================================================================
+
+// Bluedroid runs on core 0, so the tracker sits beside it; everything that can
+// block on SPI, sockets or tone delays runs on core 1.
+#define TRACKER_CORE 0
+#define APP_CORE 1
+#define TRACKER_TASK_PRIORITY 5     // Ingest, scan cycling, alert decisions
+#define STORAGE_TASK_PRIORITY 3     // SD log writer
+#define DISPLAY_TASK_PRIORITY 2     // TFT, touch and audio
+#define WEB_TASK_PRIORITY 1         // Local HTTP server, request workers and live feed
+#define UPLINK_TASK_PRIORITY 1      // Server uplink, webhooks and WiFi monitoring
+#define AUDIO_TASK_PRIORITY 1       // Tone sequencer
+#define TRACKER_TASK_STACK 6144     // Bytes
+#define STORAGE_TASK_STACK 6144
+#define DISPLAY_TASK_STACK 7168
+#define WEB_TASK_STACK 10240       // Per worker: /status document or CSV export buffers
+#define HTTPD_TASK_STACK 4096       // esp_http_server task: parses requests, runs the short ones
+#define LIVE_TASK_STACK 4096        // Live feed pump
+#define UPLINK_TASK_STACK 10240     // HTTPClient
+#define AUDIO_TASK_STACK 3072
+#define TRACKER_IDLE_MS 20          // Tracker wakes at least this often to drive scans
+#define DISPLAY_POLL_MS 50          // Touch polling period
+#define LOG_QUEUE_SIZE 64           // Pending storage requests (prune can close many buckets)
+#define ALERT_QUEUE_SIZE 32         // Webhook alerts raised but not yet batched (a burst of unknowns)
+#define UPLINK_QUEUE_SIZE 32        // Pending server uplink sightings
+#define AUDIO_QUEUE_SIZE 8          // Pending alert sounds
+#define AUDIO_COALESCE_MS 2000      // Repeats of a pattern within this window are dropped
+#define LIVE_QUEUE_SIZE 32          // Pending live feed events, tracker -> web
+#define WEB_QUEUE_SIZE 4            // Requests waiting for a web worker
+
+// ============================================================================
+// Web Server Constants
+// ============================================================================
+
+#define WEB_WORKERS 2             // Requests served concurrently by worker tasks
+#define WEB_MAX_SOCKETS 8         // Open HTTP connections, kept alive between requests
+#define WEB_QUERY_MAX 128         // Longest query string read
+#define WEB_MAX_ROUTES 12         // URI handlers (one per route and method)
+
+// ============================================================================
+// Live Event Feed Constants
+// ============================================================================
+
+#define LIVE_MAX_CLIENTS 4        // Concurrent /events subscribers
+#define LIVE_CLIENT_QUEUE 16      // Events buffered per subscriber; the oldest is dropped when full
+#define LIVE_EVENT_MAX 192        // Longest formatted SSE event
+#define LIVE_KEEPALIVE_MS 15000   // Idle subscribers get an SSE comment this often
+#define LIVE_POLL_MS 20           // Live feed retries blocked sockets this often
+
+// ============================================================================
+// Metrics Constants
+// ============================================================================
+
+#define METRICS_HISTORY 60        // Samples kept in RAM, one per housekeeping pass (SCAN_INTERVAL)
+#define METRICS_STATUS_SAMPLES 12 // Newest samples /status includes unless ?history=N asks otherwise
+
+// ============================================================================
+// Benchmark Constants
+// ============================================================================
+
+// ./deploy.sh benchmark builds with BENCHMARK_MODE 1: instead of scanning, a
+// synthetic advert corpus is replayed through ingest, classification, the
+// device table, the SD log and the display, and timings go to serial
+#ifndef BENCHMARK_MODE
+#define BENCHMARK_MODE 0
+#endif
+#define BENCH_ADVERTS 4000        // Adverts replayed per scenario (BENCH_SCENARIOS)
+#define BENCH_SAMPLES 1024        // Cycle counts kept per stage for the percentiles
+#define BENCH_CHURN_PCT 10        // Adverts carrying a changed payload (classification cache miss)
+#define BENCH_PAUSE_MS 30000      // Between runs of the whole suite
+#define BENCH_LOG_NAME LOG_DIR "/benchmark"  // Log the replay writes (.bin/.csv), emptied per scenario
+
+// ============================================================================
+// Server Uplink Constants
+// ============================================================================
+
+#define UPLINK_BATCH_MAX 32       // Sightings collected in RAM before a post (or spill)
+#define UPLINK_POST_MAX 100       // Spooled sightings per POST (binary encoding: ~2 KB)
+#define UPLINK_INTERVAL 60000     // A partial batch is posted once its oldest sighting is this old (ms)
+#define UPLINK_PAYLOAD_MAX 4096   // Body buffer; UPLINK_POST_MAX binary records fit, JSON goes in parts
+#define UPLINK_MIN_WINDOW 2000    // Least scan gap (ms) worth starting a post in
+#define UPLINK_GAP_MARGIN 500     // Post timeouts end this long before the next scan (ms)
+#define UPLINK_CONTINUOUS_WINDOW 5000  // Time a post may take in continuous scan mode, which has no gap (ms)
+#define UPLINK_BACKOFF_MIN 5000   // Retry delay after a failed post, doubled per failure...
+#define UPLINK_BACKOFF_MAX 300000 // ...up to this (ms)
+#define UPLINK_POLL_MS 250        // Uplink task checks the schedule this often
+#define NETWORK_DIAGNOSTICS false // Log gateway, internet and HTTPS reachability once after boot (stalls the uplink up to ~40 s)
+#define UPLINK_SPOOL_PATH "/uplink.spool"    // Sightings waiting on the card, oldest first
+#define UPLINK_SPOOL_POS_PATH "/uplink.pos"  // Count of spool records already posted
+#define UPLINK_SPOOL_MAX 32768    // Spooled records (~1.1 MB); beyond this sightings are dropped
+#define UPLINK_BINARY_TYPE "application/x-ble-batch"  // server/batch.go BinaryBatchContentType
+#define UPLINK_BINARY_VERSION 1
+#define UPLINK_BINARY_REPROBE 600000  // After a 400 to a binary post, JSON is used this long before binary is tried again (ms)
+#define UPLINK_FLAG_TIME 0x04     // Binary record: a time delta follows (bits 0-1 are the status)
+#define UPLINK_FLAG_NAME 0x08     // Binary record: a name follows
+#define UPLINK_BINARY_RECORD_MAX (10 + 5 + 1 + DEVICE_NAME_LEN)  // Fixed part, varint, name
+static_assert(8 + 32 + UPLINK_POST_MAX * UPLINK_BINARY_RECORD_MAX <= UPLINK_PAYLOAD_MAX,
+              "UPLINK_POST_MAX binary records (and a 32-character scanner ID) must fit UPLINK_PAYLOAD_MAX");
+
+// ============================================================================
+// Webhook Alert Constants
+// ============================================================================
+
+#define ALERT_COALESCE_MS 2000    // Alerts raised within this long of the first go out in one POST
+#define ALERT_BATCH_MAX 16        // Alerts per POST; a full batch is sent without waiting
+#define ALERT_PAYLOAD_MAX 4096    // Body buffer; ALERT_BATCH_MAX alerts fit
+#define ALERT_DEVICE_INTERVAL 600000  // Least time between alerts for one address (ms)
+#define ALERT_RECENT_SIZE 64      // Addresses remembered for ALERT_DEVICE_INTERVAL
+#define ALERT_RATE_PER_MIN 30     // Global limit: alerts admitted per minute...
+#define ALERT_RATE_BURST 16       // ...with up to this many at once
+#define ALERT_TIMEOUT_MS 3000     // Connect and response timeout of a webhook POST
+#define ALERT_BACKOFF_MIN 2000    // Retry delay after a failed POST, doubled per failure...
+#define ALERT_BACKOFF_MAX 60000   // ...up to this (ms)
+#define ALERT_MAX_AGE_MS 300000   // Alerts still undelivered after this long are dropped
+
+// ============================================================================
+// Whitelist Constants
+// ============================================================================
+
+#define WHITELIST_PATH "/whitelist.json"
+#define WHITELIST_TMP_PATH "/whitelist.tmp"  // Written in full, then renamed over WHITELIST_PATH
+#define WHITELIST_INDEX_PATH "/whitelist.idx"     // Binary copy of the index, read at boot instead of the JSON
+#define WHITELIST_JOURNAL_PATH "/whitelist.log"   // Touch edits since the last compaction, one per line
+#define WHITELIST_IMPORT_PATH "/whitelist.import" // POST /whitelist body, spooled before parsing
+#define WHITELIST_MAX 2048        // Addresses in the RAM index (6 bytes each)
+#define WHITELIST_OUI_MAX 64      // OUI prefix rules ("mac": "AA:BB:CC" entries)
+#define WHITELIST_ENTRY_DOC 384   // JSON document for one entry while streaming the file
+#define WHITELIST_ENTRY_TEXT 256  // Longest entry object read; longer ones are skipped as unparseable
+#define WHITELIST_JOURNAL_MAX 32  // Journal edits that trigger a compaction into WHITELIST_PATH
+#define WHITELIST_IMPORT_MAX 262144  // Largest accepted import body (bytes)
+#define WHITELIST_IMPORT_DEADLINE_MS 30000  // Longest an import body may take to arrive (whitelistMutex is held)
+#define WHITELIST_INDEX_MAGIC 0x58494C57  // "WLIX"
 
 // ============================================================================
 // Color Definitions (RGB565)
@@ -103,24 +329,525 @@ SPIClass sdSPI(VSPI);
 // Data Structures
 // ============================================================================
 
+// Device types reported by classifyAdvert(). Stored as a uint8_t index
+// into DEVICE_TYPE_NAMES so device records carry no String payloads.
+enum DeviceType : uint8_t {
+  TYPE_UNKNOWN = 0,
+  TYPE_IBEACON,
+  TYPE_AIRDROP,
+  TYPE_AIRPODS,
+  TYPE_AIRPLAY,
+  TYPE_AIRTAG,
+  TYPE_APPLE,
+  TYPE_SAMSUNG,
+  TYPE_GOOGLE,
+  TYPE_MICROSOFT,
+  TYPE_TILE,
+  TYPE_WEARABLE,
+  TYPE_BLE_DEVICE,
+  TYPE_HID,
+  TYPE_BEACON,
+  TYPE_PHONE,
+  TYPE_AUDIO,
+  TYPE_TRACKER,
+  TYPE_COUNT
+};
+
+constexpr const char* DEVICE_TYPE_NAMES[] = {
+  "Unknown", "iBeacon", "AirDrop", "AirPods", "AirPlay", "AirTag", "Apple",
+  "Samsung", "Google", "Microsoft", "Tile", "Wearable", "BLE Device", "HID",
+  "Beacon", "Phone", "Audio", "Tracker"
+};
+static_assert(sizeof(DEVICE_TYPE_NAMES) / sizeof(DEVICE_TYPE_NAMES[0]) == TYPE_COUNT,
+              "DEVICE_TYPE_NAMES out of sync with DeviceType");
+
+// Manufacturers reported by classifyAdvert(), indexing MANUFACTURER_NAMES
+enum Manufacturer : uint8_t {
+  MFR_UNKNOWN = 0,
+  MFR_APPLE,
+  MFR_SAMSUNG,
+  MFR_GOOGLE,
+  MFR_MICROSOFT,
+  MFR_TILE,
+  MFR_GARMIN,
+  MFR_HUAWEI,
+  MFR_XIAOMI,
+  MFR_NORDIC,
+  MFR_SONY,
+  MFR_COUNT
+};
+
+constexpr const char* MANUFACTURER_NAMES[] = {
+  "Unknown", "Apple", "Samsung", "Google", "Microsoft", "Tile", "Garmin",
+  "Huawei", "Xiaomi", "Nordic", "Sony"
+};
+static_assert(sizeof(MANUFACTURER_NAMES) / sizeof(MANUFACTURER_NAMES[0]) == MFR_COUNT,
+              "MANUFACTURER_NAMES out of sync with Manufacturer");
+
+// On-card binary log record (little endian). Fixed width so a day's .bin file
+// can be seeked and converted without parsing.
+struct __attribute__((packed)) LogRecord {
+  uint32_t time;                  // Epoch seconds, or millis() with LOG_FLAG_UPTIME
+  uint8_t addr[6];                // BLE address (display byte order)
+  int8_t rssi;                    // Signal strength in dBm
+  uint8_t flags;                  // LOG_STATUS_*, LOG_FLAG_UPTIME, LOG_KIND_* << LOG_KIND_SHIFT
+  uint8_t deviceType;             // DeviceType index
+  uint8_t manufacturer;           // Manufacturer index
+  uint16_t nameRef;               // Slot in the day's .nam table, or LOG_NAME_NONE
+};
+static_assert(sizeof(LogRecord) == 16, "LogRecord must stay 16 bytes");
+
+// RSSI summary for one device over one bucket; shares the .bin file and the
+// time/addr/flags layout with LogRecord
+struct __attribute__((packed)) LogRssiRecord {
+  uint32_t time;                  // Bucket start: epoch seconds, or millis() with LOG_FLAG_UPTIME
+  uint8_t addr[6];                // BLE address (display byte order)
+  int8_t rssiMean;                // Mean RSSI over the bucket
+  uint8_t flags;                  // LOG_FLAG_UPTIME, LOG_KIND_RSSI << LOG_KIND_SHIFT
+  int8_t rssiMin;
+  int8_t rssiMax;
+  uint16_t samples;               // Adverts folded into this record
+};
+static_assert(sizeof(LogRssiRecord) == sizeof(LogRecord), "Log records must share a size");
+
+// Sighting queued for the server uplink, and the record layout of its SD spool
+struct __attribute__((packed)) UplinkRecord {
+  uint32_t time;                  // Epoch seconds, 0 if NTP had not synced
+  uint8_t addr[6];                // BLE address (display byte order)
+  int8_t rssi;                    // Signal strength in dBm
+  uint8_t status;                 // LOG_STATUS_*
+  uint8_t deviceType;             // DeviceType index
+  uint8_t manufacturer;           // Manufacturer index
+  char name[DEVICE_NAME_LEN + 1]; // Advertised name, empty if unknown
+};
+
+// Unknown-device alert, queued by the tracker for the webhook
+struct AlertEvent {
+  uint32_t time;                  // Epoch seconds when raised, 0 if NTP had not synced
+  unsigned long raisedMs;         // millis() when raised, for delivery latency
+  uint8_t addr[6];                // BLE address (display byte order)
+  int8_t rssi;                    // Signal strength in dBm
+  uint8_t deviceType;             // DeviceType index
+  uint8_t manufacturer;           // Manufacturer index
+  char name[DEVICE_NAME_LEN + 1]; // deviceDisplayName() when raised
+};
+
+constexpr char LOG_CSV_HEADER[] = "timestamp,mac,name,rssi,device_type,status,manufacturer\n";
+constexpr char LOG_RSSI_CSV_HEADER[] = "bucket_start,mac,samples,rssi_min,rssi_max,rssi_mean\n";
+constexpr const char* LOG_STATUS_NAMES[] = {"unknown", "new", "known", "unknown"};
+
+// Cursor over a .bin log being converted to CSV, for /download and the
+// compressor. Names repeat heavily within a day, so name table slots go
+// through a small direct-mapped cache.
+struct LogCsvExport {
+  File bin;
+  File nam;                       // Name table, if present
+  bool rssiSeries;                // RSSI bucket records rather than sightings
+  bool headerDone;
+  LogRecord batch[LOG_SECTOR_SIZE / sizeof(LogRecord)];
+  size_t batchCount;              // Records read into batch
+  size_t batchPos;                // Next record of batch to convert
+  uint32_t records;               // Lines produced
+  struct {
+    uint16_t ref;                 // Slot held, or LOG_NAME_NONE
+    char name[LOG_NAME_SLOT + 1];
+  } nameCache[LOG_NAME_CACHE_SIZE];
+};
+
+// How /download sends a file body
+enum ContentCoding : uint8_t {
+  CODING_IDENTITY,
+  CODING_GZIP,                    // Compressed while sending
+  CODING_GZIP_FILE,               // The file is already gzip (.csv.gz)
+};
+
+// Orderings of the device table. VIEW_TABLE is slot order (activeSlots);
+// the others are maintained incrementally by the Sorted Views functions.
+enum DeviceView : uint8_t {
+  VIEW_TABLE,
+  VIEW_RSSI,                      // Strongest first
+  VIEW_LAST_SEEN,                 // Most recently heard first
+  VIEW_STATUS,                    // Unknown, then new, then known; strongest first within each
+  VIEW_COUNT
+};
+
+constexpr const char* DEVICE_VIEW_NAMES[] = {"table", "rssi", "last_seen", "status"};
+static_assert(sizeof(DEVICE_VIEW_NAMES) / sizeof(DEVICE_VIEW_NAMES[0]) == VIEW_COUNT,
+              "DEVICE_VIEW_NAMES must match DeviceView");
+
+// Device that goes when a new one arrives at a full table, selectable
+// through /scan
+enum EvictionPolicy : uint8_t {
+  EVICT_RSSI,                     // Weakest signal
+  EVICT_LRU,                      // Longest since last heard
+  EVICT_PRIORITY,                 // Known, then stale unknown, then new unknown; longest unheard within each
+  EVICT_WEIGHTED,                 // Longest unheard, with weak signals counted as older (EVICT_WEIGHT_MS_PER_DB)
+  EVICT_POLICY_COUNT
+};
+constexpr const char* EVICTION_POLICY_NAMES[] = {"rssi", "lru", "priority", "weighted"};
+static_assert(sizeof(EVICTION_POLICY_NAMES) / sizeof(EVICTION_POLICY_NAMES[0]) == EVICT_POLICY_COUNT,
+              "EVICTION_POLICY_NAMES must match EvictionPolicy");
+
+// Scan interval/window profiles, selectable at runtime through /scan
+enum ScanProfileId : uint8_t {
+  PROFILE_MAX_DETECTION,          // Listening ~all the time; WiFi only gets the leftover 1%
+  PROFILE_WIFI_COEXIST,           // Half of every interval left to WiFi
+  PROFILE_LOW_POWER,              // 10% radio duty cycle
+  PROFILE_COUNT
+};
+
+struct ScanProfile {
+  const char* name;
+  uint16_t intervalMs;
+  uint16_t windowMs;
+};
+
+constexpr ScanProfile SCAN_PROFILES[] = {
+  {"max-detection", 100, 99},
+  {"wifi-coexistence", 100, 50},
+  {"low-power", 1000, 100},
+};
+static_assert(sizeof(SCAN_PROFILES) / sizeof(SCAN_PROFILES[0]) == PROFILE_COUNT,
+              "SCAN_PROFILES must match ScanProfileId");
+
+// When the scanner sends scan requests. Passive scanning leaves the airtime
+// of scan requests and responses to receiving adverts; adaptive bursts fetch
+// scan responses (usually carrying the name) for still-unresolved devices.
+enum ActiveScanMode : uint8_t {
+  ACTIVE_OFF,                     // Always passive
+  ACTIVE_ON,                      // Always active (the original behaviour)
+  ACTIVE_ADAPTIVE,                // Passive, with bursts while devices are unresolved
+  ACTIVE_MODE_COUNT
+};
+constexpr const char* ACTIVE_SCAN_MODE_NAMES[] = {"off", "on", "adaptive"};
+static_assert(sizeof(ACTIVE_SCAN_MODE_NAMES) / sizeof(ACTIVE_SCAN_MODE_NAMES[0]) == ACTIVE_MODE_COUNT,
+              "ACTIVE_SCAN_MODE_NAMES must match ActiveScanMode");
+
+// Startup steps. setup() runs the first two, then scanning starts while the
+// storage task mounts the SD card and the uplink task brings up the network.
+enum BootStep : uint8_t {
+  BOOT_WHITELIST,
+  BOOT_BLE,
+  BOOT_SD,
+  BOOT_WIFI,
+  BOOT_NTP,                       // Runs until the clock is first set
+  BOOT_WEB,
+  BOOT_STEP_COUNT
+};
+constexpr const char* BOOT_STEP_NAMES[] = {"whitelist", "ble", "sd", "wifi", "ntp", "web"};
+constexpr const char* BOOT_STEP_LABELS[] = {"Whitelist", "BLE", "SD card", "WiFi", "Clock (NTP)", "Web server"};
+static_assert(sizeof(BOOT_STEP_NAMES) / sizeof(BOOT_STEP_NAMES[0]) == BOOT_STEP_COUNT,
+              "BOOT_STEP_NAMES must match BootStep");
+static_assert(sizeof(BOOT_STEP_LABELS) / sizeof(BOOT_STEP_LABELS[0]) == BOOT_STEP_COUNT,
+              "BOOT_STEP_LABELS must match BootStep");
+
+enum BootState : uint8_t {
+  BOOT_PENDING,
+  BOOT_RUNNING,
+  BOOT_DONE,
+  BOOT_FAILED,
+  BOOT_SKIPPED,                   // Not configured, or needs a step that failed
+  BOOT_STATE_COUNT
+};
+constexpr const char* BOOT_STATE_NAMES[] = {"pending", "running", "done", "failed", "skipped"};
+static_assert(sizeof(BOOT_STATE_NAMES) / sizeof(BOOT_STATE_NAMES[0]) == BOOT_STATE_COUNT,
+              "BOOT_STATE_NAMES must match BootState");
+
+// bootEvents bits
+#define BOOT_SD_DONE (1 << 0)       // SD mounted (or found missing) and the uplink spool read
+#define BOOT_NETWORK_DONE (1 << 1)  // WiFi and web server up, or given up on
+
+// Devices that went from unresolved (no name, or TYPE_UNKNOWN) to resolved
+struct ResolveStats {
+  uint32_t count;
+  uint64_t totalMs;               // Summed time from first sighting to resolution
+  uint32_t maxMs;
+};
+
+// Adverts heard while a profile/mode combination was selected
+struct ScanProfileStats {
+  uint32_t adverts;
+  uint64_t activeMs;
+};
+
+// One metrics interval, from one housekeeping pass to the next. Maxima and
+// averages cover the interval; the heap is sampled at its end.
+struct MetricsSample {
+  uint32_t timeMs;                // millis() at the end of the interval
+  uint32_t intervalMs;
+  uint32_t adverts;               // Received, including those the ingest queue dropped
+  uint32_t uniqueDevices;         // Tracked devices heard during the interval
+  uint32_t ingestDropped;
+  uint32_t evicted;               // Devices evicted from the full table
+  uint32_t rotated;               // Private address changes followed onto a tracked device
+  uint32_t classified;            // Slow-path parses and classifications (cache misses)
+  uint32_t classifyAvgUs;
+  uint32_t classifyMaxUs;
+  uint32_t sdFlushMaxUs;
+  uint32_t frameMaxUs;            // Display frame
+  uint32_t httpRequests;
+  uint32_t httpMaxUs;             // Handler time, until the response is handed to the socket
+  uint32_t freeHeap;
+  uint32_t largestBlock;
+  uint32_t loopMaxUs;             // Longest tracker pass (queue drain and scan cycle)
+};
+
+// Accumulators for the interval in progress. Each is raised by the task that
+// does the work and swapped out by the tracker when it closes the interval,
+// so a value reported in between lands in one interval or the next.
+struct MetricsWindow {
+  std::atomic<uint32_t> classified;
+  std::atomic<uint32_t> classifyUs;
+  std::atomic<uint32_t> classifyMaxUs;
+  std::atomic<uint32_t> sdFlushMaxUs;
+  std::atomic<uint32_t> frameMaxUs;
+  std::atomic<uint32_t> httpRequests;
+  std::atomic<uint32_t> httpMaxUs;
+  std::atomic<uint32_t> loopMaxUs;
+};
+
+// MetricsSample fields in /status history column order. Those with a gauge
+// name are also exported by /metrics, from the newest sample.
+struct MetricsField {
+  const char* key;
+  const char* gauge;
+  const char* help;
+  uint32_t MetricsSample::*value;
+};
+constexpr MetricsField METRICS_FIELDS[] = {
+  {"t", nullptr, nullptr, &MetricsSample::timeMs},
+  {"interval_ms", nullptr, nullptr, &MetricsSample::intervalMs},
+  {"adverts", "ble_interval_adverts", "Adverts received in the last interval", &MetricsSample::adverts},
+  {"unique", "ble_interval_unique_devices", "Tracked devices heard in the last interval", &MetricsSample::uniqueDevices},
+  {"dropped", "ble_interval_ingest_dropped", "Adverts the ingest queue dropped in the last interval", &MetricsSample::ingestDropped},
+  {"evicted", "ble_interval_evicted", "Devices evicted from the full table in the last interval", &MetricsSample::evicted},
+  {"rotated", "ble_interval_address_rotations", "Private address changes followed in the last interval", &MetricsSample::rotated},
+  {"classified", "ble_interval_classified", "Adverts parsed and classified in the last interval", &MetricsSample::classified},
+  {"classify_avg_us", "ble_interval_classify_avg_us", "Mean parse and classification time in the last interval", &MetricsSample::classifyAvgUs},
+  {"classify_max_us", "ble_interval_classify_max_us", "Longest parse and classification in the last interval", &MetricsSample::classifyMaxUs},
+  {"sd_flush_max_us", "ble_interval_sd_flush_max_us", "Longest SD log flush in the last interval", &MetricsSample::sdFlushMaxUs},
+  {"frame_max_us", "ble_interval_display_frame_max_us", "Longest display frame in the last interval", &MetricsSample::frameMaxUs},
+  {"http", "ble_interval_http_requests", "HTTP requests handled in the last interval", &MetricsSample::httpRequests},
+  {"http_max_us", "ble_interval_http_handler_max_us", "Longest HTTP handler in the last interval", &MetricsSample::httpMaxUs},
+  {"heap_free", nullptr, nullptr, &MetricsSample::freeHeap},          // Exported live instead
+  {"heap_block", nullptr, nullptr, &MetricsSample::largestBlock},
+  {"loop_max_us", "ble_interval_tracker_loop_max_us", "Longest tracker pass in the last interval", &MetricsSample::loopMaxUs},
+};
+constexpr int METRICS_FIELD_COUNT = sizeof(METRICS_FIELDS) / sizeof(METRICS_FIELDS[0]);
+static_assert(METRICS_FIELD_COUNT * sizeof(uint32_t) == sizeof(MetricsSample),
+              "METRICS_FIELDS must list every MetricsSample field");
+
+// A load to replay: population size and advert rate
+struct BenchScenario {
+  const char* name;
+  uint16_t devices;
+  uint16_t rate;                  // Adverts per second, 0 = as fast as the pipeline goes
+};
+
+// Pipeline stages timed per advert (log and render per item and frame)
+enum BenchStage : uint8_t {
+  BENCH_INGEST,                   // ingestRecord(): the BLE callback's copy and hash
+  BENCH_PROCESS_HIT,              // processDevice(), payload unchanged: table refresh only
+  BENCH_PROCESS_MISS,             // processDevice(), new payload: parse, classify, updateDeviceList()
+  BENCH_CLASSIFY,                 // parseAdvertPayload() + classifyAdvert() alone
+  BENCH_LOG,                      // writeLogItem() per queued item, and flushes to the card
+  BENCH_RENDER,                   // drawDisplay()
+  BENCH_STAGE_COUNT
+};
+
+constexpr const char* BENCH_STAGE_NAMES[] = {
+  "ingest", "process-hit", "process-miss", "classify", "log", "render"
+};
+static_assert(sizeof(BENCH_STAGE_NAMES) / sizeof(BENCH_STAGE_NAMES[0]) == BENCH_STAGE_COUNT,
+              "BENCH_STAGE_NAMES must match BenchStage");
+
+// Cycle counts seen for one stage. Up to BENCH_SAMPLES are kept by reservoir
+// sampling, so percentiles cover the whole scenario, not its start.
+struct BenchStats {
+  uint32_t* samples;
+  uint32_t kept;
+  uint32_t seen;
+  uint64_t totalCycles;
+  uint32_t maxCycles;
+};
+
+// Result of classifyAdvert(): type and manufacturer resolved together
+struct DeviceClass {
+  DeviceType type;
+  Manufacturer mfr;
+};
+
+// Fixed-size POD device record: no heap allocations per tracked device
 struct BLEDeviceInfo {
-  String mac;                     // MAC address
-  String name;                    // Advertised name (or "Unknown")
-  int rssi;                       // Signal strength in dBm
-  String deviceType;              // Detected type: phone, beacon, etc.
-  String manufacturer;            // Manufacturer from data
-  bool isKnown;                   // On whitelist
-  bool isNew;                     // Seen < 5 minutes
   unsigned long firstSeen;        // Timestamp of first detection
   unsigned long lastSeen;         // Timestamp of most recent detection
-  bool alertSent;                 // Already alerted for this device
+  uint32_t payloadHash;           // Hash of the advert last classified for this device
+  uint32_t fingerprint;           // Advert fingerprint if the address is private, else 0
+  unsigned long bucketStart;      // First sample of the open RSSI bucket
+  int32_t rssiSum;                // Open RSSI bucket: sum, count, extremes
+  uint16_t rssiSamples;
+  int8_t rssiMin;
+  int8_t rssiMax;
+  uint8_t addr[6];                // BLE address (display byte order)
+  uint8_t prevAddr[6];            // Private address it was followed from (valid if rotations > 0)
+  uint16_t rotations;             // Address changes followed onto this device
+  int8_t rssi;                    // Signal strength in dBm
+  uint8_t deviceType;             // DeviceType index (DEVICE_TYPE_NAMES)
+  uint8_t manufacturer;           // Manufacturer index (MANUFACTURER_NAMES)
+  uint8_t isKnown : 1;            // On whitelist
+  uint8_t isNew : 1;              // Seen < 5 minutes
+  uint8_t alertSent : 1;          // Already alerted for this device
+  uint8_t publicAddr : 1;         // Public address type, so OUI rules apply
+  uint8_t activeBursts;           // Active bursts heard in while unresolved (saturates at ACTIVE_BURST_TRIES)
+  char name[DEVICE_NAME_LEN + 1]; // Advertised name, empty if unknown
+  int8_t reportedRssi;            // RSSI as of changeSeq
+  uint8_t reportedStatus;         // deviceLogStatus() as of changeSeq
+  uint32_t addedSeq;              // deviceChangeSeq when the device was added
+  uint32_t changeSeq;             // deviceChangeSeq at its last reported change
+};
+
+// Live feed event, queued by the tracker and fanned out by the web task
+enum LiveEventType : uint8_t {
+  LIVE_DEVICE,                    // Device added to the table
+  LIVE_ALERT,                     // Unknown device alert raised
+  LIVE_EXPIRED,                   // Device left the table
+  LIVE_SCAN                       // Scan cycle finished
+};
+constexpr const char* LIVE_EVENT_NAMES[] = {"device", "alert", "expired", "scan"};
+
+struct LiveEvent {
+  uint8_t type;                   // LiveEventType
+  uint8_t addr[6];                // Device events
+  int8_t rssi;
+  uint8_t status;                 // LOG_STATUS_*
+  uint8_t deviceType;
+  uint16_t deviceCount;           // LIVE_SCAN: devices tracked / unknown / new
+  uint16_t unknownCount;
+  uint16_t newCount;
+  uint32_t seq;                   // deviceChangeSeq after the event
+  char name[DEVICE_NAME_LEN + 1];
+};
+
+// One /events subscriber. The request is held open as an async request so
+// the HTTP server leaves its socket alone. Events wait in a ring until the
+// socket accepts them; the event being sent is held formatted in out[].
+struct LiveClient {
+  httpd_req_t* req;
+  int fd;
+  bool active;
+  LiveEvent queue[LIVE_CLIENT_QUEUE];
+  uint8_t queueHead;              // Oldest queued event
+  uint8_t queueCount;
+  char out[LIVE_EVENT_MAX];
+  uint16_t outLength;
+  uint16_t outSent;
+  unsigned long lastSend;
+  uint32_t dropped;               // Events discarded from a full ring
+};
+
+// A device that left the table, kept for /status?since
+struct DeviceRemoval {
+  uint8_t addr[6];
+  uint32_t seq;                   // deviceChangeSeq of the removal
+};
+
+// Storage task request: a sighting to log or a closed RSSI bucket
+struct LogItem {
+  uint8_t kind;                   // LOG_KIND_SIGHTING or LOG_KIND_RSSI
+  union {
+    BLEDeviceInfo device;         // Snapshot taken when the device was added
+    LogRssiRecord rssi;
+  };
 };
 
+// Sounds queued for the audio task, which owns the LEDC output
+enum AudioAlert : uint8_t {
+  AUDIO_UNKNOWN_DEVICE,
+  AUDIO_NEW_DEVICE,
+  AUDIO_WHITELIST_ADDED,
+  AUDIO_STARTUP,
+  AUDIO_ALERT_COUNT
+};
+
+// One step of a tone pattern; frequency 0 is a rest
+struct ToneStep {
+  uint16_t frequency;             // Hz
+  uint16_t duration;              // ms
+};
+
+// What one device row currently shows, as drawn by drawDeviceRow()
+struct RowView {
+  bool occupied;
+  uint16_t statusColor;
+  uint8_t bars;                   // rssiToBars()
+  char name[17];                  // Truncated to 14 chars + ".."
+  char subInfo[26];               // "type | manufacturer"
+  char rssiText[10];
+  char macSuffix[9];              // Last 8 chars of the MAC
+};
+
+// Retained model of the whole panel, diffed by drawDisplay()
+struct DisplayView {
+  bool valid;                     // false forces a full repaint
+  int scrollY;                    // List scroll position in pixels
+  int deviceCount;                // Shown in the header
+  bool scrollUp;
+  bool scrollDown;
+  bool divider[MAX_VISIBLE_DEVICES - 1];  // Line below row i
+  RowView rows[MAX_VISIBLE_DEVICES + 1];  // From row scrollY / DEVICE_ROW_HEIGHT; +1 while mid-scroll
+};
+
+// Compact copy of one advertisement, filled in the BLE callback and
+// consumed by the tracker task. Fixed size so the callback never touches the heap.
+struct AdvertRecord {
+  uint8_t addr[6];                // BLE address (display byte order)
+  uint8_t addrType;               // esp_ble_addr_type_t
+  int8_t rssi;                    // Signal strength in dBm
+  uint8_t payloadLen;             // Bytes used in payload[]
+  uint32_t payloadHash;           // FNV-1a of payload[], computed by the producer
+  uint8_t payload[ADVERT_PAYLOAD_MAX]; // Raw advertising data
+
+  // Parsed from payload[] by the consumer, only on a classification cache miss
+  uint8_t flags;                  // ADV_HAS_* bits
+  uint16_t mfgId;                 // Manufacturer company ID
+  uint16_t serviceUuid16;         // First 16-bit service UUID
+  uint8_t mfgType;                // First manufacturer payload byte after company ID
+  uint32_t fingerprint;           // Fields that survive an address rotation (fingerprintField())
+  char name[ADVERT_NAME_LEN + 1]; // Advertised name, truncated, NUL terminated
+};
+
+// Whitelist addition made on the device, written to the journal
 struct WhitelistEntry {
-  String mac;
-  String name;
-  String type;
+  uint8_t addr[6];
+  char name[DEVICE_NAME_LEN + 1];
+  const char* type;               // DEVICE_TYPE_NAMES entry
+};
+
+// What nextWhitelistEntry() found in the "devices" array, or
+// nextJournalEntry() in the journal
+enum WhitelistRead : uint8_t {
+  WHITELIST_READ_ENTRY,           // The next entry, parsed
+  WHITELIST_READ_BAD,             // An entry that didn't parse or fit, stepped over
+  WHITELIST_READ_END,             // The closing ']' (journal: the end of the file)
+  WHITELIST_READ_BROKEN           // The file ends, or holds something other than an object
+                                  // (journal: the last line has no newline)
+};
+
+// WHITELIST_INDEX_PATH header, followed by count addresses and ouiCount OUIs
+struct WhitelistIndexHeader {
+  uint32_t magic;                 // WHITELIST_INDEX_MAGIC
+  uint32_t jsonSize;              // Size of the WHITELIST_PATH it was built from
+  uint16_t count;
+  uint16_t ouiCount;
+};
+
+// Progress of a compaction: which index entries are already in the output
+struct WhitelistWriter {
+  uint8_t written[(WHITELIST_MAX + 7) / 8];  // Index positions
+  uint64_t ouisWritten;
+  int count;
 };
+static_assert(WHITELIST_OUI_MAX <= 64, "ouisWritten is a 64-bit mask");
 
 // ============================================================================
 // Global Variables
@@ -128,19 +855,131 @@ struct WhitelistEntry {
 
 // Display
 TFT_eSPI tft = TFT_eSPI();
+DisplayView shownView = {};            // What the panel shows now
+TFT_eSprite* stripSprites[2] = {};     // List strip buffers (display task only)
+int stripBufferCount = 0;              // Buffers actually allocated
+bool stripUseDma = false;
+int scrollY = 0;                       // Animated list position, eases toward scrollOffset
+static_assert(DISPLAY_STRIP_BUFFERS >= 0 && DISPLAY_STRIP_BUFFERS <= 2, "DISPLAY_STRIP_BUFFERS must be 0-2");
+static_assert(DISPLAY_STRIP_HEIGHT > 0, "DISPLAY_STRIP_HEIGHT must be positive");
+uint32_t displayFrames = 0;            // drawDisplay() calls
+uint32_t displayFullFrames = 0;        // Of which full repaints
+uint32_t displayFrameLastUs = 0;
+uint32_t displayFrameMaxUs = 0;
+uint64_t displayFrameTotalUs = 0;
+uint32_t displayFullFrameUs = 0;       // Most recent full repaint, for comparison
+uint16_t displayWidgetsLast = 0;       // Widgets repainted by the last frame
 
 // BLE
 BLEScan* pBLEScan;
-bool scanInProgress = false;
+bool scanInProgress = false;         // Continuous mode: the endless scan is running
+bool scanContinuous = SCAN_CONTINUOUS;
+ScanProfileId scanProfile = SCAN_PROFILE;
+std::atomic<int8_t> requestedScanMode(-1);     // Set by /scan, applied by the tracker (1 = continuous)
+std::atomic<int8_t> requestedScanProfile(-1);
+ScanProfileStats scanProfileStats[PROFILE_COUNT][2];  // [profile][continuous]
+uint32_t scanStatsAdverts = 0;       // Ingest total when scanProfileStats was last accrued
+unsigned long scanStatsSince = 0;
+float scanAdvertRate = 0;            // Adverts/s over the last housekeeping pass
+ActiveScanMode activeScanMode = SCAN_ACTIVE;
+std::atomic<int8_t> requestedActiveMode(-1);   // Set by /scan, applied by the tracker
+bool scanActive = false;             // Scan requests are being sent (configured on the controller)
+unsigned long activeBurstStart = 0;
+unsigned long activeBurstEnd = 0;
+uint32_t activeBurstCount = 0;
+int activeCandidates = 0;            // Unresolved devices with bursts left; > 0 asks for a burst
+int unresolvedCount = 0;             // Devices without a name or type, as of the last count
+ScanProfileStats scanPhaseStats[2];  // [scanActive]: adverts/s passive vs active
+ResolveStats resolveStats[2];        // [scanActive when resolved]
+uint32_t lastScanFreeHeap = 0;       // Heap at previous scan start, for delta reporting
+uint32_t lastScanLargestBlock = 0;
+
+// Advertisement ingest queue (single producer: BLE callback, single consumer: tracker task)
+AdvertRecord ingestQueue[INGEST_QUEUE_SIZE];
+std::atomic<uint32_t> ingestHead(0);   // Next slot to write (producer only)
+std::atomic<uint32_t> ingestTail(0);   // Next slot to read (consumer only)
+uint32_t ingestEnqueued = 0;           // Records accepted (written by producer)
+uint32_t ingestDropped = 0;            // Records dropped because the queue was full
+uint32_t ingestHighWater = 0;          // Deepest queue depth observed
+
+// Classification cache: repeat adverts with an unchanged payload skip parsing
+uint32_t classifyCacheHits = 0;        // Totals since boot
+uint32_t classifyCacheMisses = 0;
+uint32_t scanCacheHits = 0;            // Current (or last completed) scan cycle
+uint32_t scanCacheMisses = 0;
 
 // Device tracking
+// devices[] is a pool of index-stable slots: a device keeps its slot until it
+// is removed, so lookups and removals never copy BLEDeviceInfo (or its Strings).
+// deviceHash[] maps packed addresses to slots (linear probing, backward-shift
+// deletion so no tombstones). activeSlots[] lists occupied slots densely for
+// iteration; deviceAt(i) returns the i-th tracked device.
 BLEDeviceInfo devices[MAX_TRACKED_DEVICES];
+int16_t deviceHash[DEVICE_HASH_SIZE];
+int16_t activeSlots[MAX_TRACKED_DEVICES];   // Occupied slots, positions 0..deviceCount-1
+int16_t slotPosition[MAX_TRACKED_DEVICES];  // Position of each slot in activeSlots[]
+int16_t freeSlots[MAX_TRACKED_DEVICES];     // Stack of unused slots
+int freeSlotCount = 0;
 int deviceCount = 0;
 int scrollOffset = 0;
 
-// Whitelist
-WhitelistEntry whitelist[50];
+// Sorted views: viewSlots[v - 1] holds the occupied slots in DeviceView v
+// order and viewPosition[v - 1][slot] is each slot's index in it
+int16_t viewSlots[VIEW_COUNT - 1][MAX_TRACKED_DEVICES];
+int16_t viewPosition[VIEW_COUNT - 1][MAX_TRACKED_DEVICES];
+int viewSize = 0;                      // Slots inserted in the views
+bool lastSeenViewSorted = true;        // Cleared by sightings, restored on read
+DeviceView displayView = DISPLAY_VIEW; // Order of the TFT list
+
+// Eviction order: a binary min-heap of the occupied slots under
+// evictsBefore(), so the next device to go is evictHeap[0]
+int16_t evictHeap[MAX_TRACKED_DEVICES];
+int16_t evictPosition[MAX_TRACKED_DEVICES];  // Each slot's index in evictHeap
+int evictHeapSize = 0;
+EvictionPolicy evictionPolicy = EVICTION_POLICY;
+std::atomic<int8_t> requestedEvictionPolicy(-1);  // Set by /scan, applied by the tracker
+uint32_t devicesEvicted = 0;           // Since boot
+uint32_t evictedUnknown = 0;           // Of which not on the whitelist...
+uint32_t evictedNewUnknown = 0;        // ...and still new (alerted within NEW_DEVICE_THRESHOLD)
+unsigned long lastEvictionMs = 0;
+
+// Private address correlation (matchRotatedDevice())
+uint32_t addressRotations = 0;         // New addresses followed onto a tracked device
+uint32_t rotationSplits = 0;           // Followed addresses handed back: two devices after all
+uint32_t rotationsAmbiguous = 0;       // New addresses more than one tracked device could have rotated from
+
+// Change cursor for /status?since: bumped on every add, reported change and
+// removal. removedLog is a ring of the latest removals; a cursor older than
+// removedHorizon may have missed one that was overwritten. Clients see
+// changeCursor(), which puts changeBootId above the seq so a cursor kept
+// across a reboot can't be mistaken for one of this boot's.
+uint32_t deviceChangeSeq = 0;
+uint32_t changeBootId = 0;             // Random per boot, never 0; set by initDeviceTable()
+DeviceRemoval removedLog[REMOVED_LOG_SIZE];
+uint32_t removedCount = 0;             // Total removals logged
+uint32_t removedHorizon = 0;           // seq of the newest overwritten removal
+
+// Live event feed (/events): subscribers are owned by the web task
+LiveClient liveClients[LIVE_MAX_CLIENTS];
+std::atomic<int> liveClientCount(0);   // Read by the tracker to skip queueing with no subscribers
+uint32_t liveEventsQueued = 0;
+uint32_t liveQueueDropped = 0;         // Oldest events discarded from a full liveQueue
+uint32_t liveClientDropped = 0;        // Summed over past and present subscribers
+
+// Whitelist index: sorted addresses (display byte order, so memcmp order
+// is address order) for binary search, plus OUI prefix rules. Names and
+// types stay in WHITELIST_PATH and the journal. Touch edits (display task)
+// and imports (web workers) hold whitelistMutex around the edit and its save.
+uint8_t whitelistAddrs[WHITELIST_MAX][6];
 int whitelistCount = 0;
+uint8_t whitelistOuis[WHITELIST_OUI_MAX][3];
+int whitelistOuiCount = 0;
+int whitelistJournalCount = 0;         // Edits in WHITELIST_JOURNAL_PATH
+uint32_t whitelistLoadMs = 0;          // Boot load, including the journal replay
+bool whitelistLoadCached = false;      // Boot load came from WHITELIST_INDEX_PATH
+int whitelistBadEntries = 0;           // Entries of WHITELIST_PATH that didn't parse at boot
+bool whitelistIncomplete = false;      // WHITELIST_PATH broke off before its end: never saved over
+uint32_t whitelistImports = 0;
 
 // Timing
 unsigned long lastScanTime = 0;
@@ -149,17 +988,294 @@ unsigned long scanStartTime = 0;
 
 // SD Card
 bool sdCardPresent = false;
-String currentLogDate = "";
+bool useBinaryLog = true;  // true = compact .bin/.nam logs, false = CSV
+unsigned long rssiBucketInterval = RSSI_BUCKET_INTERVAL;  // 0 disables RSSI history
+uint32_t rssiRecordsLogged = 0;
+
+// SD log writer
+File logFile;                          // Day's log, kept open between writes
+char logFilePath[40] = "";             // Path of logFile, empty when closed
+uint32_t logFileSize = 0;              // Bytes in logFile including flushed writes
+char logBuffer[LOG_BUFFER_SIZE];       // Lines not yet written to the card
+size_t logBufferUsed = 0;
+unsigned long lastLogFlush = 0;
+uint32_t logBytesWritten = 0;          // Stats since boot
+uint32_t logFlushCount = 0;
+uint32_t logFlushLastUs = 0;
+uint32_t logFlushMaxUs = 0;
+uint32_t logWriteErrors = 0;
+uint32_t logLinesDropped = 0;
+File logNameFile;                      // .nam table beside a binary logFile
+uint32_t logNameHashes[LOG_NAME_INDEX_SIZE];  // Name hash per index slot, 0 = empty
+uint16_t logNameRefs[LOG_NAME_INDEX_SIZE];    // Name table slot for each hash
+uint16_t logNameCount = 0;             // Slots in the name table, including pending
+char logNameBuffer[LOG_NAME_BUFFER_SIZE];
+size_t logNameBufferUsed = 0;
+
+// Gzip
+uint32_t gzipResponses = 0;            // Downloads compressed on the fly
+uint32_t gzipBytesIn = 0;              // Their body sizes before and after compression
+uint32_t gzipBytesOut = 0;
+uint32_t gzipFilesServed = 0;          // Downloads answered from a .csv.gz
+uint32_t gzipAllocFailures = 0;        // Sent uncompressed: no heap for a GzipWriter
+uint32_t logsCompressed = 0;           // Previous days' logs written as .csv.gz
+bool logCompressScan = true;           // Storage task: look for logs still to compress
 
 // WiFi
 bool wifiConnected = false;
 
+// Boot timeline. Each step is written by the task running it; times are
+// millis() since reset.
+volatile uint8_t bootSteps[BOOT_STEP_COUNT] = {};  // BootState
+uint32_t bootStepMs[BOOT_STEP_COUNT] = {};         // When the step finished
+std::atomic<uint32_t> bootVersion(0);  // Bumped on every step change, redraws the progress
+volatile uint32_t firstAdvertMs = 0;   // First advert ingested: time to first advert
+
+// Server uplink (uplink task only, apart from uplinkQueueDropped)
+bool uplinkEnabled = false;            // BLE_SERVER_URL and BLE_API_KEY are set
+HTTPClient uplinkHttp;                 // Kept between posts so the connection is reused
+UplinkRecord uplinkBatch[UPLINK_BATCH_MAX];       // Sightings not yet posted or spooled
+int uplinkBatchCount = 0;
+unsigned long uplinkBatchStart = 0;    // When the oldest sighting in the batch arrived
+UplinkRecord uplinkSendBuffer[UPLINK_POST_MAX];   // Spool records being posted
+uint8_t uplinkPayload[UPLINK_PAYLOAD_MAX];
+bool uplinkBinary = true;              // Compact encoding; off while the server turns it down
+bool uplinkBinaryReprobe = false;      // Off after a 400, so tried again; a 415 keeps it off
+unsigned long uplinkBinaryOffAt = 0;   // When it was turned off
+uint32_t uplinkSpoolRecords = 0;       // Records in UPLINK_SPOOL_PATH
+uint32_t uplinkSpoolSent = 0;          // Of which the server has accepted
+unsigned long uplinkLastAttempt = 0;
+uint32_t uplinkBackoffMs = 0;          // Wait after the last failure, 0 once a post succeeds
+int uplinkLastStatus = 0;              // HTTP status (or HTTPClient error) of the last post
+uint32_t postSuccessCount = 0;         // Batches the server accepted
+uint32_t postFailCount = 0;
+uint32_t uplinkRecordsSent = 0;
+uint32_t uplinkRecordsSpooled = 0;     // Sightings parked on the card
+uint32_t uplinkRecordsDropped = 0;     // No room in the batch or spool
+uint16_t uplinkLastBatch = 0;          // Sightings in the last accepted post
+uint16_t uplinkMaxBatch = 0;
+uint32_t uplinkLastLatencyMs = 0;      // Request to response of the last accepted post
+uint32_t uplinkMaxLatencyMs = 0;
+uint32_t uplinkConnectionsReused = 0;  // Posts sent on an already open connection
+uint32_t uplinkBytesSent = 0;          // Bodies of accepted posts
+
+// Webhook alerts (uplink task only, apart from alertQueueDropped)
+HTTPClient alertHttp;                  // Kept between POSTs so the connection is reused
+AlertEvent alertBatch[ALERT_BATCH_MAX];  // Admitted alerts, oldest first
+int alertBatchCount = 0;
+unsigned long alertBatchStart = 0;     // When the oldest alert in the batch was admitted
+char alertPayload[ALERT_PAYLOAD_MAX];
+uint8_t alertRecentAddrs[ALERT_RECENT_SIZE][6];  // Ring of addresses alerted for...
+unsigned long alertRecentMs[ALERT_RECENT_SIZE];  // ...and when
+int alertRecentCount = 0;              // Ring entries used; the next goes at alertRecentCount % ALERT_RECENT_SIZE
+uint32_t alertTokens = ALERT_RATE_BURST;  // Global limit bucket
+unsigned long alertTokensRefilled = 0;
+unsigned long alertLastAttempt = 0;
+uint32_t alertBackoffMs = 0;           // Wait after the last failure, 0 once a POST goes through
+int alertLastStatus = 0;               // HTTP status (or HTTPClient error) of the last POST
+uint32_t alertsSent = 0;               // Alerts in accepted POSTs
+uint32_t alertPostsOk = 0;
+uint32_t alertPostsFailed = 0;         // Retried later
+uint32_t alertsRejected = 0;           // Refused by the webhook with a 4xx, not retried
+uint32_t alertsLimitedDevice = 0;      // Address alerted for within ALERT_DEVICE_INTERVAL
+uint32_t alertsLimitedGlobal = 0;      // Over ALERT_RATE_PER_MIN
+uint32_t alertsExpired = 0;            // Undelivered after ALERT_MAX_AGE_MS
+uint16_t alertMaxBatch = 0;
+uint32_t alertLastLatencyMs = 0;       // Raised to delivered, newest alert of the last POST
+uint32_t alertMaxLatencyMs = 0;
+uint32_t alertLatencyTotalMs = 0;      // Over all alertsSent
+uint32_t alertConnectionsReused = 0;
+
 // Web Server
-WebServer server(80);
+httpd_handle_t webServer = nullptr;
+uint32_t webRequestsQueued = 0;
+uint32_t webRequestsRejected = 0;      // Turned away with 503: all workers busy, queue full
+std::atomic<uint32_t> webRequestsHandled(0);  // By the httpd task or a worker
+
+// Metrics
+MetricsSample metricsRing[METRICS_HISTORY];  // Rolling history, guarded by deviceMutex
+uint32_t metricsSamples = 0;           // Recorded since boot; the newest is at (metricsSamples - 1) % METRICS_HISTORY
+MetricsWindow metricsWindow;           // Interval in progress
+uint32_t metricsDroppedMark = 0;       // ingestDropped when the interval began
+uint32_t metricsEvictedMark = 0;       // devicesEvicted when the interval began
+uint32_t metricsRotatedMark = 0;       // addressRotations when the interval began
+
+// Benchmark mode
+BenchStats benchStats[BENCH_STAGE_COUNT];  // Reset for each scenario
+uint32_t benchSeed = 1;                // benchRandom() state
 
 // Audio
 bool audioEnabled = true;
 bool useSpeaker = true;  // true = P4 speaker, false = GPIO 22 piezo
+uint32_t audioPlayed = 0;              // Patterns started
+uint32_t audioCoalesced = 0;           // Requests merged into a pending or recent pattern
+uint32_t audioPreempted = 0;           // Patterns cut short by a higher-priority one
+
+// Tasks. Ownership:
+// - trackerTask owns devices[], the hash index and scan state. deviceMutex
+//   guards devices[] and the whitelist index; the tracker holds it while processing a
+//   batch, other tasks only while copying out (or toggling isKnown).
+//   whitelistMutex serialises whitelist edits and their SPIFFS files; it is
+//   taken before deviceMutex, never while holding it.
+// - storageTask owns the log writer (logFile, buffers, name table) and is fed
+//   through logQueue. sdMutex serialises all SD access so the web task can
+//   read logs between writer flushes.
+// - displayTask owns the TFT and touch.
+// - audioTask owns the LEDC tone output and sequences patterns (audioQueue).
+// - esp_http_server's own task parses requests and answers the short ones;
+//   webWorkers run the long ones (webQueue), so a download doesn't hold up
+//   other clients. webTask pumps the live feed. uplinkTask owns outbound
+//   HTTP: webhooks (alertQueue, its batch) and the server uplink (uplinkQueue,
+//   its batch and SD spool).
+TaskHandle_t trackerTask = nullptr;
+TaskHandle_t storageTask = nullptr;
+TaskHandle_t displayTask = nullptr;
+TaskHandle_t webTask = nullptr;
+TaskHandle_t webWorkers[WEB_WORKERS] = {};
+TaskHandle_t uplinkTask = nullptr;
+TaskHandle_t audioTask = nullptr;
+SemaphoreHandle_t deviceMutex = nullptr;   // Recursive
+SemaphoreHandle_t sdMutex = nullptr;       // Recursive
+SemaphoreHandle_t liveMutex = nullptr;     // Recursive, guards liveClients[]
+SemaphoreHandle_t whitelistMutex = nullptr;  // Recursive
+SemaphoreHandle_t taskSampleMutex = nullptr; // Recursive, guards /status's CPU sample between workers
+QueueHandle_t logQueue = nullptr;          // LogItem, tracker -> storage
+QueueHandle_t alertQueue = nullptr;        // AlertEvent, tracker -> uplink
+QueueHandle_t uplinkQueue = nullptr;       // UplinkRecord, tracker -> uplink
+QueueHandle_t audioQueue = nullptr;        // AudioAlert, any -> audio
+QueueHandle_t liveQueue = nullptr;         // LiveEvent, tracker -> web
+QueueHandle_t webQueue = nullptr;          // httpd_req_t*, HTTP server -> web workers
+EventGroupHandle_t bootEvents = nullptr;   // BOOT_SD_DONE, BOOT_NETWORK_DONE
+volatile bool rescanRequested = false;     // Set by touch, consumed by the tracker
+uint32_t logQueueDropped = 0;
+uint32_t alertQueueDropped = 0;
+uint32_t uplinkQueueDropped = 0;
+
+// Holds a recursive mutex for the enclosing scope
+class ScopedLock {
+ public:
+  explicit ScopedLock(SemaphoreHandle_t mutex) : mutex_(mutex) {
+    xSemaphoreTakeRecursive(mutex_, portMAX_DELAY);
+  }
+  ~ScopedLock() { xSemaphoreGiveRecursive(mutex_); }
+  ScopedLock(const ScopedLock&) = delete;
+  ScopedLock& operator=(const ScopedLock&) = delete;
+
+ private:
+  SemaphoreHandle_t mutex_;
+};
+
+// Route handler; the request may be an async copy running on a web worker
+typedef void (*WebHandler)(httpd_req_t* req);
+
+// Chunked HTTP response that JSON and text are printed into directly. Output
+// is packed into one TCP segment's worth of buffer per chunk, so a response
+// of any length costs LOG_CSV_CHUNK bytes of RAM. Once a send fails (the
+// client went away) the rest of the response is discarded; long producers
+// check ok() to stop early.
+class ChunkedResponse : public Print {
+ public:
+  ChunkedResponse(httpd_req_t* req, const char* status, const char* contentType) : req_(req) {
+    httpd_resp_set_status(req_, status);
+    httpd_resp_set_type(req_, contentType);
+  }
+  ~ChunkedResponse() {
+    flush();
+    if (ok_) httpd_resp_send_chunk(req_, nullptr, 0);  // End of chunked response
+  }
+  ChunkedResponse(const ChunkedResponse&) = delete;
+  ChunkedResponse& operator=(const ChunkedResponse&) = delete;
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* data, size_t size) override {
+    for (size_t done = 0; done < size;) {
+      size_t n = min(size - done, sizeof(buffer_) - used_);
+      memcpy(buffer_ + used_, data + done, n);
+      used_ += n;
+      done += n;
+      if (used_ == sizeof(buffer_)) flush();
+    }
+    return size;
+  }
+  void flush() override {
+    if (used_ == 0) return;
+    send(buffer_, used_);
+  }
+
+  // Sends data as its own chunk, after anything already buffered
+  void send(const char* data, size_t size) {
+    if (data != buffer_) flush();
+    if (ok_ && httpd_resp_send_chunk(req_, data, size) != ESP_OK) ok_ = false;
+    if (data == buffer_) used_ = 0;
+  }
+  bool ok() const { return ok_; }
+
+ private:
+  httpd_req_t* req_;
+  char buffer_[LOG_CSV_CHUNK];
+  size_t used_ = 0;
+  bool ok_ = true;
+};
+
+// Writes a gzip stream to another Print: deflate with the fixed Huffman codes
+// and LZ77 matches found through hash chains over the last GZIP_WINDOW bytes.
+// A fraction of zlib's memory, and still several-fold on log CSV, whose lines
+// repeat MACs, types and manufacturers. Allocate with newGzipWriter().
+class GzipWriter final : public Print {
+ public:
+  explicit GzipWriter(Print& out);
+  GzipWriter(const GzipWriter&) = delete;
+  GzipWriter& operator=(const GzipWriter&) = delete;
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* data, size_t size) override;
+  void finish();                  // Ends the stream; later writes are ignored
+  bool ok() const { return ok_; } // False once the sink has refused bytes
+  uint32_t bytesIn() const { return size_; }
+  uint32_t bytesOut() const { return written_; }
+
+ private:
+  static uint32_t hash(const uint8_t* p);
+  void compress(bool final);
+  void slide();
+  void insertHash(size_t pos);
+  size_t longestMatch(size_t& distance);
+  void putLiteral(uint8_t c);
+  void putMatch(size_t length, size_t distance);
+  void putHuffman(uint32_t code, int length);
+  void putBits(uint32_t bits, int count);
+  void flushOutput();
+
+  Print& out_;
+  uint8_t window_[2 * GZIP_WINDOW];       // History, then input not yet encoded
+  uint16_t head_[1 << GZIP_HASH_BITS];    // Latest position + 1 per hash, 0 = none
+  uint16_t prev_[GZIP_WINDOW];            // Previous position + 1 with the same hash
+  size_t fill_ = 0;                       // Bytes in window_
+  size_t pos_ = 0;                        // Next byte to encode
+  uint32_t bitBuffer_ = 0;
+  int bitCount_ = 0;
+  uint8_t output_[GZIP_OUT_BUFFER];
+  size_t outputUsed_ = 0;
+  uint32_t crc_ = 0;
+  uint32_t size_ = 0;
+  uint32_t written_ = 0;
+  bool finished_ = false;
+  bool ok_ = true;
+};
+
+// Storage task: a previous day's log being compressed into its .csv.gz
+struct LogCompressJob {
+  bool active;
+  bool fromBinary;                // Source is .bin, converted to CSV first
+  char source[40];
+  char target[40];                // YYYY-MM-DD.csv.gz
+  char temp[44];                  // target + ".tmp" until complete
+  LogCsvExport csv;               // Read position in a .bin source
+  File raw;                       // Read position in a .csv source
+  File out;
+  GzipWriter* gzip;
+};
+LogCompressJob compressJob = {};
 
 // ============================================================================
 // Forward Declarations
@@ -170,39 +1286,222 @@ void initBLE();
 void initSDCard();
 void initAudio();
 void initWiFi();
+bool wifiConfigured();
+void initNetwork();
+void testNetworkConnectivity();
 void testHttpsConnection();
+void initTaskSync();
+void startTasks();
+void startWebTasks();
+void setBootStep(BootStep step, BootState state);
+void drawBootProgress();
+const char* bootStepInProgress();
+void trackerTaskMain(void* param);
+void storageTaskMain(void* param);
+void displayTaskMain(void* param);
+void webTaskMain(void* param);
+void webWorkerMain(void* param);
+void uplinkTaskMain(void* param);
+void audioTaskMain(void* param);
+void runScanCycle();
+void completeScanCycle();
+void configureScan();
+void applyScanSettings();
+void accrueScanStats();
+int parseScanProfile(const char* name);
+bool deviceUnresolved(const BLEDeviceInfo& dev);
+void noteDeviceResolved(const BLEDeviceInfo& dev, unsigned long now);
+bool wantActiveScan(unsigned long now);
+void serviceActiveScan(unsigned long now);
+void setScanActive(bool active, unsigned long now);
+void countUnresolvedDevices(bool burstEnded);
+void recordMetricsSample(unsigned long now, unsigned long elapsed, uint32_t adverts);
+void noteMetricMax(std::atomic<uint32_t>& max, uint32_t value);
 void loadWhitelist();
-void saveWhitelist();
+int readWhitelistFile(const char* path, uint8_t (*addrs)[6], int& count, uint8_t (*ouis)[3], int& ouiCount, int& badEntries);
+int sortWhitelistAddrs(uint8_t (*addrs)[6], int count);
+WhitelistRead nextWhitelistEntry(File& file, JsonDocument& entry);
+bool loadWhitelistIndex();
+void writeWhitelistIndex();
+void recoverWhitelistFiles();
+bool whitelistFileComplete(const char* path);
+void commitWhitelistFile();
+int replayWhitelistJournal();
+WhitelistRead nextJournalEntry(File& file, JsonDocument& entry, uint8_t* addr, bool& add);
+void journalWhitelistEdit(const WhitelistEntry* added, const uint8_t* removed);
+bool compactWhitelist(const char* importPath);
+void copyWhitelistFile(const char* path, File& out, WhitelistWriter& writer, JsonDocument& entry);
+void writeWhitelistEntry(File& out, WhitelistWriter& writer, JsonDocument& entry, const uint8_t* addr, int octets);
+bool insertWhitelistAddr(const uint8_t* addr);
+bool removeWhitelistAddr(const uint8_t* addr);
+int refreshKnownDevices();
+int parseMac(const char* text, uint8_t* addr);
+int whitelistLowerBound(const uint8_t* addr);
+int findWhitelistAddr(const uint8_t* addr);
+int findWhitelistOui(const uint8_t* addr);
 void startBLEScan();
-void processDevice(BLEAdvertisedDevice& device);
-void updateDeviceList(String mac, String name, int rssi, String deviceType, String manufacturer);
-bool isDeviceKnown(String mac);
-String detectDeviceType(BLEAdvertisedDevice& device);
-String detectManufacturer(BLEAdvertisedDevice& device);
+bool ingestAdvert(BLEAdvertisedDevice& device);
+bool ingestRecord(const uint8_t* addr, uint8_t addrType, int rssi, const uint8_t* payload, size_t length);
+void parseAdvertPayload(const uint8_t* payload, size_t length, AdvertRecord& rec);
+int drainIngestQueue();
+uint32_t hashPayload(const uint8_t* payload, size_t length);
+uint32_t hashMix(uint32_t hash, const uint8_t* bytes, size_t length);
+uint32_t fingerprintField(uint32_t hash, uint8_t adType, const uint8_t* data, uint8_t dataLen);
+void processDevice(AdvertRecord& rec);
+void initDeviceTable();
+uint64_t packAddress(const uint8_t* addr);
+uint32_t hashAddress(uint64_t addrKey);
+int findDeviceSlot(uint64_t addrKey);
+int allocDeviceSlot(uint64_t addrKey);
+void indexDeviceSlot(int slot);
+bool unindexDeviceSlot(int slot);
+void freeDeviceSlot(int slot);
+BLEDeviceInfo& deviceAt(int index);
+uint8_t deviceStatusRank(const BLEDeviceInfo& dev);
+bool viewPrecedes(int view, const BLEDeviceInfo& a, const BLEDeviceInfo& b);
+void insertDeviceViews(int slot);
+void removeDeviceViews(int slot);
+void updateDeviceViews(BLEDeviceInfo& dev);
+void sortLastSeenView();
+bool evictsBefore(const BLEDeviceInfo& a, const BLEDeviceInfo& b);
+void placeEvictHeap(int pos, int slot);
+void siftEvictHeap(int pos);
+void insertEvictHeap(int slot);
+void removeEvictHeap(int slot);
+void rebuildEvictHeap();
+void evictDevice(int sparedSlot);
+int parseEvictionPolicy(const char* name);
+bool isPrivateAddress(const uint8_t* addr, uint8_t addrType);
+int matchRotatedDevice(const uint8_t* addr, uint32_t fingerprint, int rssi, unsigned long now);
+void moveDeviceAddress(int slot, const uint8_t* addr, bool handBack);
+BLEDeviceInfo& deviceInView(DeviceView view, int index);
+DeviceView parseDeviceView(const String& name, DeviceView fallback);
+void noteDeviceChange(BLEDeviceInfo& dev, bool fieldsChanged);
+void recordDeviceRemoval(const BLEDeviceInfo& dev);
+void updateDeviceList(const uint8_t* addr, uint8_t addrType, const char* name, int rssi, DeviceType deviceType, Manufacturer manufacturer, uint32_t payloadHash, uint32_t fingerprint);
+void addDevice(const uint8_t* addr, uint8_t addrType, const char* name, int rssi, DeviceType deviceType, Manufacturer manufacturer, uint32_t payloadHash, uint32_t fingerprint);
+bool isDeviceKnown(const uint8_t* addr, bool publicAddr);
+DeviceClass classifyAdvert(const AdvertRecord& rec);
+const char* deviceTypeName(uint8_t type);
+const char* manufacturerName(uint8_t mfr);
+const char* deviceDisplayName(const BLEDeviceInfo& dev);
+void formatMac(const uint8_t* addr, char* out);
 void pruneStaleDevices();
+void invalidateDisplay();
+void buildRowView(const BLEDeviceInfo& dev, RowView& view);
 void drawDisplay();
 void drawHeader();
-void drawDeviceRow(int index, int yPos);
-void drawRSSIBars(int x, int y, int rssi);
+void drawDeviceCount(int count);
+int drawDeviceRow(TFT_eSPI& gfx, const RowView& row, const RowView* shown, int yPos);
+void drawRSSIBars(TFT_eSPI& gfx, int x, int y, int bars);
+void initDisplaySprites();
+int drawListDirect(const DisplayView& next, bool full);
+int drawListComposited(const DisplayView& next, bool full);
+void composeListStrip(TFT_eSprite& sprite, const DisplayView& view, int top, int lines);
+void drawNoSdIndicator(TFT_eSPI& gfx, int bottomY);
 void updateElapsedTime();
 void handleTouch();
 void addToWhitelist(int deviceIndex);
 void removeFromWhitelist(int deviceIndex);
-void logDeviceToSD(BLEDeviceInfo& device);
-String getLogFilename();
-void playTone(int frequency, int duration);
+bool currentLocalTime(struct tm& timeinfo);
+void formatLogFilename(char* out, size_t size);
+void nameTablePath(const char* binPath, char* out, size_t size);
+bool ensureLogFileOpen();
+bool openLogFile(const char* path);
+void openNameTable(const char* binPath);
+uint32_t hashLogName(const char* name);
+void indexLogName(const char* name, uint16_t ref);
+uint16_t logNameRef(const char* name);
+void closeLogFile();
+void appendLogBytes(const void* data, size_t length);
+void flushLogBuffer(bool all);
+void serviceLogWriter();
+uint8_t deviceLogStatus(const BLEDeviceInfo& device);
+void formatLogTimestamp(char* out, size_t size, uint32_t time, bool uptime);
+int formatLogCsvLine(char* out, size_t size, const char* timestamp, const uint8_t* addr,
+                     const char* name, int rssi, uint8_t deviceType, uint8_t status,
+                     uint8_t manufacturer);
+void logDeviceToSD(const BLEDeviceInfo& device);
+void queueDeviceLog(const BLEDeviceInfo& device);
+void writeLogItem(const LogItem& item);
+void recordRssiSample(BLEDeviceInfo& device, int rssi, unsigned long now);
+void closeRssiBucket(BLEDeviceInfo& device);
+void flushExpiredRssiBuckets();
+bool openLogCsvExport(LogCsvExport& csv, const char* binPath, bool rssiSeries);
+size_t readLogCsv(LogCsvExport& csv, char* out, size_t size);
+void closeLogCsvExport(LogCsvExport& csv);
+void streamBinaryLogAsCsv(httpd_req_t* req, const String& binPath, const String& csvName, bool rssiSeries, bool gzip);
+void streamSdFile(httpd_req_t* req, const String& path, const String& filename, const char* contentType, ContentCoding coding);
+int parseByteRange(const char* header, size_t size, size_t& start, size_t& end);
+bool acceptsGzip(httpd_req_t* req);
+GzipWriter* newGzipWriter(Print& out);
+void endGzipResponse(GzipWriter* gzip);
+bool isPastLogName(const char* name, const char* today);
+bool findLogToCompress(const char* today, char* source, size_t size);
+bool startLogCompression(const char* source);
+void serviceLogCompression();
+void finishLogCompression();
+void setTone(uint16_t frequency);
+void queueAudioAlert(AudioAlert alert);
 void alertUnknownDevice();
 void alertNewDevice();
 void alertWhitelistAdded();
-void sendWebhookAlert(BLEDeviceInfo& device);
-void postLogsToServer();
+void queueWebhookAlert(const BLEDeviceInfo& device);
+bool admitWebhookAlert(const AlertEvent& alert, unsigned long now);
+void serviceWebhookAlerts();
+void fillWebhookAlert(JsonDocument& doc, const AlertEvent& alert);
+int encodeWebhookBody(const AlertEvent* alerts, int count, char* out, size_t size, size_t& length);
+int postWebhookBatch();
+bool uplinkConfigured();
+void initUplink();
+void queueUplinkSighting(const BLEDeviceInfo& device);
+void drainUplinkQueue();
+uint32_t scanGapRemaining();
+void serviceUplink();
+int encodeUplinkJson(const UplinkRecord* records, int count, char* out, size_t size, size_t& length);
+int encodeUplinkBinary(const UplinkRecord* records, int count, uint8_t* out, size_t size, size_t& length);
+int postUplinkBatch(const UplinkRecord* records, int count, uint32_t timeoutMs);
+bool spillUplinkBatch();
+int readUplinkSpool(UplinkRecord* out, int max);
+void advanceUplinkSpool(int count);
 int rssiToBars(int rssi);
 String formatElapsedTime(unsigned long ms);
 void initWebServer();
-void handleRoot();
-void handleListLogs();
-void handleDownloadLog();
-void handleStatus();
+esp_err_t runWebRequest(httpd_req_t* req);
+void serveWebRequest(httpd_req_t* req);
+esp_err_t queueWebRequest(httpd_req_t* req);
+bool findQueryArg(httpd_req_t* req, const char* name, char* value, size_t size);
+bool hasQueryArg(httpd_req_t* req, const char* name);
+String queryArg(httpd_req_t* req, const char* name);
+void urlDecode(char* text);
+void sendResponse(httpd_req_t* req, const char* status, const char* contentType, const char* body);
+void handleRoot(httpd_req_t* req);
+void handleListLogs(httpd_req_t* req);
+void handleDownloadLog(httpd_req_t* req);
+void handleStatus(httpd_req_t* req);
+void handleScanSettings(httpd_req_t* req);
+void handleWhitelistImport(httpd_req_t* req);
+void handleMetrics(httpd_req_t* req);
+void printMetric(Print& out, const char* name, const char* type, const char* help, double value);
+void printMetricsHistory(Print& out, int samples);
+int pageArg(httpd_req_t* req, const char* name, int fallback);
+void printJsonMembers(Print& out, JsonObjectConst members);
+int streamStatusDevices(Print& out, DeviceView view, int offset, int limit, uint32_t since, bool& more);
+void handleStatusDelta(httpd_req_t* req, uint32_t since);
+uint64_t changeCursor(uint32_t seq);
+void queueLiveEvent(LiveEvent& event);
+void queueDeviceEvent(LiveEventType type, const BLEDeviceInfo& dev);
+void queueScanEvent();
+void handleLiveEvents(httpd_req_t* req);
+void serviceLiveClients();
+int formatLiveEvent(const LiveEvent& event, char* out, size_t size);
+void runBenchmarks();
+void runBenchScenario(const BenchScenario& scenario);
+uint32_t benchRandom();
+void benchRecord(BenchStage stage, uint32_t cycles);
+void buildBenchAdvert(int index, uint8_t variant, uint8_t* addr, uint8_t* payload, uint8_t& length);
+int compareBenchCycles(const void* a, const void* b);
+void printBenchStats();
 
 // ============================================================================
 // BLE Scan Callback Class
@@ -210,7 +1509,8 @@ void handleStatus();
 
 class BLEScanCallbacks : public BLEAdvertisedDeviceCallbacks {
   void onResult(BLEAdvertisedDevice advertisedDevice) {
-    processDevice(advertisedDevice);
+    // Runs in the Bluedroid task - only copy the advert, processing happens in trackerTask
+    ingestAdvert(advertisedDevice);
   }
 };
 
@@ -226,9 +1526,14 @@ void setup() {
   Serial.println("\n=== BLE Security Scanner ===");
   Serial.println("Initializing...");
 
+  // Mutexes and queues exist before anything that might use them
+  initTaskSync();
+
   // Initialize display first for visual feedback
   initDisplay();
 
+  initDeviceTable();
+
   // Show splash screen
   tft.fillScreen(COLOR_BG);
   tft.setTextColor(COLOR_TEXT);
@@ -238,49 +1543,41 @@ void setup() {
   tft.setTextSize(1);
   tft.drawString("Initializing...", SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 + 10);
 
-  // Initialize components
-  tft.drawString("Loading whitelist...", SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 + 30);
+  // Only what scanning needs runs here: the whitelist, so the first adverts
+  // are classified right, and BLE. The rest comes up in the tasks while the
+  // scan runs, and the display task keeps the progress lines current.
+  setBootStep(BOOT_WHITELIST, BOOT_RUNNING);
+  drawBootProgress();
   if (SPIFFS.begin(true)) {
     loadWhitelist();
-    Serial.printf("Whitelist loaded: %d devices\n", whitelistCount);
+    Serial.printf("Whitelist loaded: %d devices, %d OUI rules\n", whitelistCount, whitelistOuiCount);
+    setBootStep(BOOT_WHITELIST, BOOT_DONE);
   } else {
     Serial.println("SPIFFS mount failed");
+    setBootStep(BOOT_WHITELIST, BOOT_FAILED);
   }
 
-  tft.drawString("Initializing SD card...", SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 + 50);
-  initSDCard();
-
-  tft.drawString("Initializing audio...", SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 + 70);
-  initAudio();
-
-  tft.drawString("Initializing WiFi...", SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 + 90);
-  initWiFi();
-
-  if (wifiConnected) {
-    tft.drawString("Starting web server...", SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 + 110);
-    initWebServer();
-  }
+  // Benchmark build: replay the synthetic corpus in place of scanning
+  if (BENCHMARK_MODE) runBenchmarks();
 
-  tft.drawString("Initializing BLE...", SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2 + 130);
+  setBootStep(BOOT_BLE, BOOT_RUNNING);
+  drawBootProgress();
   initBLE();
+  setBootStep(BOOT_BLE, BOOT_DONE);
+  drawBootProgress();
 
-  // Play startup sound
-  if (audioEnabled) {
-    playTone(1000, 100);
-    delay(50);
-    playTone(1500, 100);
-  }
-
-  delay(500);
-
-  // Draw main display
-  tft.fillScreen(COLOR_BG);
-  drawDisplay();
+  initAudio();
+  // Play startup sound (starts once the audio task runs)
+  queueAudioAlert(AUDIO_STARTUP);
 
   // Start first scan
   lastScanTime = millis() - SCAN_INTERVAL;  // Force immediate scan
+  scanStartTime = millis() - SCAN_RETRY_MS;
 
-  Serial.println("Initialization complete!");
+  // Hand over to the pinned tasks; loop() has nothing left to do
+  startTasks();
+
+  Serial.printf("Initialization complete: scanning %lu ms after boot\n", millis());
 }
 
 // ============================================================================
@@ -288,7 +1585,104 @@ void setup() {
 // ============================================================================
 
 void loop() {
+  // All work runs in the tasks started by setup()
+  vTaskDelete(NULL);
+}
+
+// ============================================================================
+// Tasks
+// ============================================================================
+
+void initTaskSync() {
+  deviceMutex = xSemaphoreCreateRecursiveMutex();
+  sdMutex = xSemaphoreCreateRecursiveMutex();
+  liveMutex = xSemaphoreCreateRecursiveMutex();
+  whitelistMutex = xSemaphoreCreateRecursiveMutex();
+  taskSampleMutex = xSemaphoreCreateRecursiveMutex();
+  logQueue = xQueueCreate(LOG_QUEUE_SIZE, sizeof(LogItem));
+  alertQueue = xQueueCreate(ALERT_QUEUE_SIZE, sizeof(AlertEvent));
+  uplinkQueue = xQueueCreate(UPLINK_QUEUE_SIZE, sizeof(UplinkRecord));
+  audioQueue = xQueueCreate(AUDIO_QUEUE_SIZE, sizeof(AudioAlert));
+  liveQueue = xQueueCreate(LIVE_QUEUE_SIZE, sizeof(LiveEvent));
+  webQueue = xQueueCreate(WEB_QUEUE_SIZE, sizeof(httpd_req_t*));
+  bootEvents = xEventGroupCreate();
+}
+
+void startTasks() {
+  xTaskCreatePinnedToCore(storageTaskMain, "storage", STORAGE_TASK_STACK, nullptr,
+                          STORAGE_TASK_PRIORITY, &storageTask, APP_CORE);
+  xTaskCreatePinnedToCore(displayTaskMain, "display", DISPLAY_TASK_STACK, nullptr,
+                          DISPLAY_TASK_PRIORITY, &displayTask, APP_CORE);
+  xTaskCreatePinnedToCore(uplinkTaskMain, "uplink", UPLINK_TASK_STACK, nullptr,
+                          UPLINK_TASK_PRIORITY, &uplinkTask, APP_CORE);
+  xTaskCreatePinnedToCore(audioTaskMain, "audio", AUDIO_TASK_STACK, nullptr,
+                          AUDIO_TASK_PRIORITY, &audioTask, APP_CORE);
+  // Last, so the tasks it notifies already exist
+  xTaskCreatePinnedToCore(trackerTaskMain, "tracker", TRACKER_TASK_STACK, nullptr,
+                          TRACKER_TASK_PRIORITY, &trackerTask, TRACKER_CORE);
+}
+
+// Uplink task, once the web server is up (initNetwork())
+void startWebTasks() {
+  xTaskCreatePinnedToCore(webTaskMain, "web", LIVE_TASK_STACK, nullptr,
+                          WEB_TASK_PRIORITY, &webTask, APP_CORE);
+  for (int i = 0; i < WEB_WORKERS; i++) {
+    char name[12];
+    snprintf(name, sizeof(name), "web%d", i);
+    xTaskCreatePinnedToCore(webWorkerMain, name, WEB_TASK_STACK, nullptr,
+                            WEB_TASK_PRIORITY, &webWorkers[i], APP_CORE);
+  }
+}
+
+// Records a step change and has the display task redraw the progress
+void setBootStep(BootStep step, BootState state) {
+  if (state >= BOOT_DONE) bootStepMs[step] = millis();
+  bootSteps[step] = state;
+  bootVersion++;
+  if (displayTask) xTaskNotifyGive(displayTask);
+  Serial.printf("Boot: %s %s at %lu ms\n", BOOT_STEP_NAMES[step], BOOT_STATE_NAMES[state], millis());
+}
+
+void trackerTaskMain(void* param) {
+  for (;;) {
+    // Woken by ingestAdvert(), or periodically to drive the scan cycle
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TRACKER_IDLE_MS));
+    uint32_t passStart = micros();
+
+    // Release the table between batches so readers are never held off long
+    int processed;
+    do {
+      ScopedLock lock(deviceMutex);
+      processed = drainIngestQueue();
+    } while (processed == INGEST_BATCH_SIZE);
+
+    runScanCycle();
+    noteMetricMax(metricsWindow.loopMaxUs, micros() - passStart);
+  }
+}
+
+void runScanCycle() {
+  applyScanSettings();
+
   unsigned long currentTime = millis();
+  serviceActiveScan(currentTime);
+
+  if (rescanRequested) {
+    rescanRequested = false;
+    lastScanTime = currentTime - SCAN_INTERVAL;
+  }
+
+  // Continuous mode: the controller keeps listening and only the
+  // housekeeping runs every SCAN_INTERVAL
+  if (scanContinuous) {
+    if (!scanInProgress && currentTime - scanStartTime >= SCAN_RETRY_MS) {
+      startBLEScan();
+    }
+    if (currentTime - lastScanTime >= SCAN_INTERVAL) {
+      completeScanCycle();
+    }
+    return;
+  }
 
   // Start new scan if interval elapsed and not currently scanning
   if (!scanInProgress && (currentTime - lastScanTime >= SCAN_INTERVAL)) {
@@ -298,54 +1692,370 @@ void loop() {
   // Check if scan is complete (scan duration has elapsed)
   if (scanInProgress && (millis() - scanStartTime >= (SCAN_DURATION * 1000 + 500))) {
     scanInProgress = false;
-    lastScanTime = millis();
+    completeScanCycle();
+    if (scanActive && activeScanMode == ACTIVE_ADAPTIVE) setScanActive(false, millis());  // The burst was this scan
+    // The uplink task posts to the server in the gap that starts now
+  }
+}
+
+// Switches mode and profile as requested through /scan. The running scan is
+// stopped so the new settings take effect; runScanCycle() restarts it.
+void applyScanSettings() {
+  int8_t active = requestedActiveMode.exchange(-1);
+  if (active >= 0) activeScanMode = (ActiveScanMode)active;  // serviceActiveScan() follows it
+
+  int8_t eviction = requestedEvictionPolicy.exchange(-1);
+  if (eviction >= 0 && eviction != evictionPolicy) {
+    ScopedLock lock(deviceMutex);
+    evictionPolicy = (EvictionPolicy)eviction;
+    rebuildEvictHeap();
+    Serial.printf("Eviction policy: %s\n", EVICTION_POLICY_NAMES[evictionPolicy]);
+  }
+
+  int8_t mode = requestedScanMode.exchange(-1);
+  int8_t profile = requestedScanProfile.exchange(-1);
+  if (mode < 0 && profile < 0) return;
+  if ((mode < 0 || (mode == 1) == scanContinuous) && (profile < 0 || profile == scanProfile)) return;
+
+  accrueScanStats();
+  if (scanInProgress) {
+    pBLEScan->stop();
+    scanInProgress = false;
+  }
+  if (mode >= 0) scanContinuous = mode == 1;
+  if (profile >= 0) scanProfile = (ScanProfileId)profile;
+  configureScan();
+
+  // Start right away in either mode
+  scanStartTime = millis() - SCAN_RETRY_MS;
+  lastScanTime = millis() - SCAN_INTERVAL;
+  Serial.printf("Scan settings: %s, profile %s (%u/%u ms)\n", scanContinuous ? "continuous" : "cycle",
+                SCAN_PROFILES[scanProfile].name, SCAN_PROFILES[scanProfile].intervalMs,
+                SCAN_PROFILES[scanProfile].windowMs);
+}
+
+// Charges the adverts and time since the last call to the current profile/mode
+void accrueScanStats() {
+  unsigned long now = millis();
+  uint32_t adverts = ingestEnqueued + ingestDropped;
+  ScanProfileStats& stats = scanProfileStats[scanProfile][scanContinuous];
+  stats.adverts += adverts - scanStatsAdverts;
+  stats.activeMs += now - scanStatsSince;
+  ScanProfileStats& phase = scanPhaseStats[scanActive];
+  phase.adverts += adverts - scanStatsAdverts;
+  phase.activeMs += now - scanStatsSince;
+  scanStatsAdverts = adverts;
+  scanStatsSince = now;
+}
+
+// A device still worth a scan response: no name, or no type
+bool deviceUnresolved(const BLEDeviceInfo& dev) {
+  return dev.name[0] == '\0' || dev.deviceType == TYPE_UNKNOWN;
+}
+
+// Tracker (deviceMutex held): dev just learned its last missing field
+void noteDeviceResolved(const BLEDeviceInfo& dev, unsigned long now) {
+  ResolveStats& stats = resolveStats[scanActive];
+  uint32_t ms = now - dev.firstSeen;
+  stats.count++;
+  stats.totalMs += ms;
+  if (ms > stats.maxMs) stats.maxMs = ms;
+  if (dev.activeBursts < ACTIVE_BURST_TRIES && activeCandidates > 0) activeCandidates--;
+}
+
+// Whether scan requests should be sent now under activeScanMode. An adaptive
+// burst starts when unresolved devices with tries left exist and the last one
+// ended ACTIVE_BURST_GAP ago. In continuous mode it lasts ACTIVE_BURST_MS; a
+// cycle burst is one whole scan, asked for as it starts and ended by
+// runScanCycle() when it completes, since a timed one would start and end in
+// the gap between scans.
+bool wantActiveScan(unsigned long now) {
+  switch (activeScanMode) {
+    case ACTIVE_OFF:
+      return false;
+    case ACTIVE_ON:
+      return true;
+    default:
+      if (scanActive && scanContinuous) return now - activeBurstStart < ACTIVE_BURST_MS;
+      return activeCandidates > 0 && now - activeBurstEnd >= ACTIVE_BURST_GAP;
+  }
+}
+
+// Tracker: switches the continuous scan between passive and active, stopping
+// it for that (runScanCycle() restarts it). A cycle scan picks its setting in
+// startBLEScan().
+void serviceActiveScan(unsigned long now) {
+  if (!scanContinuous) return;
+  bool active = wantActiveScan(now);
+  if (active == scanActive) return;
+  if (scanInProgress) {
+    pBLEScan->stop();
+    scanInProgress = false;
+    scanStartTime = now - SCAN_RETRY_MS;
+  }
+  setScanActive(active, now);
+}
+
+void setScanActive(bool active, unsigned long now) {
+  accrueScanStats();
+  scanActive = active;
+  pBLEScan->setActiveScan(active);
+  // Only adaptive bursts are counted and use up tries
+  bool adaptive = activeScanMode == ACTIVE_ADAPTIVE;
+  if (active) {
+    activeBurstStart = now;
+    if (adaptive) activeBurstCount++;
+  } else {
+    activeBurstEnd = now;
+    if (adaptive) countUnresolvedDevices(true);
+  }
+}
+
+// Recounts unresolvedCount and activeCandidates. After a burst, unresolved
+// devices heard during it use up one of their ACTIVE_BURST_TRIES.
+void countUnresolvedDevices(bool burstEnded) {
+  ScopedLock lock(deviceMutex);
+  unresolvedCount = 0;
+  activeCandidates = 0;
+  for (int i = 0; i < deviceCount; i++) {
+    BLEDeviceInfo& dev = deviceAt(i);
+    if (!deviceUnresolved(dev)) continue;
+    unresolvedCount++;
+    if (burstEnded && (long)(dev.lastSeen - activeBurstStart) >= 0 &&
+        dev.activeBursts < ACTIVE_BURST_TRIES) {
+      dev.activeBursts++;
+    }
+    if (dev.activeBursts < ACTIVE_BURST_TRIES) activeCandidates++;
+  }
+}
+
+// End of a scan cycle, or a housekeeping pass of the continuous scan
+void completeScanCycle() {
+  unsigned long now = millis();
+  unsigned long elapsed = now - scanStatsSince;
+  uint32_t adverts = ingestEnqueued + ingestDropped - scanStatsAdverts;
+  scanAdvertRate = elapsed > 0 ? adverts * 1000.0f / elapsed : 0;
+  accrueScanStats();
+  lastScanTime = now;
+
+  {
+    ScopedLock lock(deviceMutex);
+
+    // Close the metrics interval before pruning drops the devices it heard
+    recordMetricsSample(now, elapsed, adverts);
 
     // Prune devices not seen recently
     pruneStaleDevices();
 
-    // Server POST disabled - BLE + HTTPS have incompatible memory requirements
-    // Use local web server at http://<IP>/status to view devices
-    // Or pull SD card logs from http://<IP>/logs
-
-    // Update display
-    drawDisplay();
+    // Log RSSI buckets of devices that have gone quiet
+    flushExpiredRssiBuckets();
 
-    Serial.printf("Scan complete. Tracking %d devices\n", deviceCount);
+    queueScanEvent();
+  }
+  countUnresolvedDevices(false);
+
+  // Redraw on the display task
+  xTaskNotifyGive(displayTask);
+
+  Serial.printf("Scan complete. Tracking %d devices, %d unresolved\n", deviceCount, unresolvedCount);
+  Serial.printf("  Adverts: %.1f/s (%s, %s, %s)\n", scanAdvertRate,
+                scanContinuous ? "continuous" : "cycle", SCAN_PROFILES[scanProfile].name,
+                scanActive ? "active" : "passive");
+  Serial.printf("  Ingest: %lu queued, %lu dropped, high-water %lu/%d\n",
+                ingestEnqueued, ingestDropped, ingestHighWater, INGEST_QUEUE_SIZE);
+  Serial.printf("  Classify cache: %lu hits, %lu misses this scan\n",
+                scanCacheHits, scanCacheMisses);
+  if (devicesEvicted > 0) {
+    Serial.printf("  Evicted (%s): %lu unknown (%lu new), %lu known of %d slots\n",
+                  EVICTION_POLICY_NAMES[evictionPolicy], evictedUnknown, evictedNewUnknown,
+                  devicesEvicted - evictedUnknown, MAX_TRACKED_DEVICES);
+  }
+  if (addressRotations > 0 || rotationsAmbiguous > 0) {
+    Serial.printf("  Address rotations: %lu followed, %lu handed back, %lu ambiguous\n",
+                  addressRotations, rotationSplits, rotationsAmbiguous);
+  }
+  if (sdCardPresent) {
+    Serial.printf("  SD log: %lu bytes in %lu flushes (last %lu us, max %lu us), %u pending\n",
+                  logBytesWritten, logFlushCount, logFlushLastUs, logFlushMaxUs, (unsigned)logBufferUsed);
+  }
+  if (alertsLimitedDevice > 0 || alertsLimitedGlobal > 0) {
+    Serial.printf("  Webhook: %lu alerts sent, %lu held back per device, %lu by the rate limit\n",
+                  alertsSent, alertsLimitedDevice, alertsLimitedGlobal);
+  }
+  if (logQueueDropped > 0 || alertQueueDropped > 0 || uplinkQueueDropped > 0) {
+    Serial.printf("  Task queues: %lu log items, %lu alerts, %lu uplink sightings dropped\n",
+                  logQueueDropped, alertQueueDropped, uplinkQueueDropped);
   }
 
-  // Update elapsed time display every second
-  if (currentTime - lastDisplayUpdate >= 1000) {
-    updateElapsedTime();
-    lastDisplayUpdate = currentTime;
+  // The continuous scan never restarts, so its per-scan counters reset here
+  if (scanContinuous) {
+    scanCacheHits = 0;
+    scanCacheMisses = 0;
   }
+}
 
-  // Handle touch input
-  handleTouch();
+void storageTaskMain(void* param) {
+  // Mount here rather than in setup() so scanning doesn't wait for the card;
+  // log items queue up meanwhile
+  setBootStep(BOOT_SD, BOOT_RUNNING);
+  {
+    ScopedLock lock(sdMutex);
+    initSDCard();
+    initUplink();
+  }
+  setBootStep(BOOT_SD, sdCardPresent ? BOOT_DONE : BOOT_FAILED);
+  xEventGroupSetBits(bootEvents, BOOT_SD_DONE);
+
+  LogItem item;
+  for (;;) {
+    // Wake for new items, or often enough to honour LOG_FLUSH_INTERVAL (or to
+    // keep a log compression moving)
+    TickType_t wait = pdMS_TO_TICKS(compressJob.active ? LOG_COMPRESS_IDLE_MS : LOG_FLUSH_INTERVAL / 4);
+    if (xQueueReceive(logQueue, &item, wait) == pdTRUE) {
+      ScopedLock lock(sdMutex);
+      writeLogItem(item);
+      // Take whatever else is already queued under the same lock
+      while (xQueueReceive(logQueue, &item, 0) == pdTRUE) {
+        writeLogItem(item);
+      }
+    }
 
-  // Handle web server requests - call frequently for responsiveness
-  if (wifiConnected) {
-    server.handleClient();
+    {
+      ScopedLock lock(sdMutex);
+      serviceLogWriter();
+    }
+    serviceLogCompression();
   }
+}
+
+void displayTaskMain(void* param) {
+  unsigned long lastMeterRefresh = 0;
+  unsigned long splashStart = millis();
+  bool splash = true;                  // setup() left the boot progress on screen
+  bool spritesReady = false;
+  uint32_t shownBootVersion = 0;
+  for (;;) {
+    // Frame rate while a scroll animation runs, touch polling rate otherwise
+    bool scrolling = scrollY != scrollOffset * DEVICE_ROW_HEIGHT;
+    TickType_t wait = pdMS_TO_TICKS(scrolling ? DISPLAY_FRAME_MS : DISPLAY_POLL_MS);
+    bool redraw = ulTaskNotifyTake(pdTRUE, wait) > 0;
+
+    // Boot progress: on the splash until the background steps finish (or
+    // BOOT_SPLASH_MS passes), then in the header
+    uint32_t version = bootVersion;
+    EventBits_t boot = xEventGroupGetBits(bootEvents);
+    if (version != shownBootVersion) {
+      shownBootVersion = version;
+      if (splash) {
+        drawBootProgress();
+      } else {
+        invalidateDisplay();
+      }
+    }
+    if (splash) {
+      bool finished = (boot & (BOOT_SD_DONE | BOOT_NETWORK_DONE)) == (BOOT_SD_DONE | BOOT_NETWORK_DONE);
+      if (!finished && millis() - splashStart < BOOT_SPLASH_MS) continue;
+      splash = false;
+      invalidateDisplay();
+      redraw = true;
+    }
 
-  // Periodic WiFi debug (every 30 seconds)
-  static unsigned long lastWifiDebug = 0;
-  if (millis() - lastWifiDebug >= 30000) {
-    lastWifiDebug = millis();
-    Serial.println("=== WiFi Status Check ===");
-    Serial.printf("  wifiConnected: %s\n", wifiConnected ? "true" : "false");
-    Serial.printf("  WiFi.status(): %d\n", WiFi.status());
-    if (WiFi.status() == WL_CONNECTED) {
-      IPAddress ip = WiFi.localIP();
-      Serial.printf("  IP: %d.%d.%d.%d\n", ip[0], ip[1], ip[2], ip[3]);
-      Serial.printf("  RSSI: %d dBm\n", WiFi.RSSI());
+    // Strip buffers wait for the network bring-up, so WiFi has already
+    // taken the heap it needs
+    if (!spritesReady && (boot & BOOT_NETWORK_DONE)) {
+      initDisplaySprites();
+      spritesReady = true;
+      invalidateDisplay();
     }
+
+    // Redraws only repaint what changed, so live RSSI meters are cheap
+    unsigned long currentTime = millis();
+    if (redraw || !shownView.valid || scrolling || currentTime - lastMeterRefresh >= RSSI_METER_INTERVAL) {
+      drawDisplay();
+      lastMeterRefresh = currentTime;
+    }
+
+    // Update elapsed time display every second
+    if (currentTime - lastDisplayUpdate >= 1000) {
+      updateElapsedTime();
+      lastDisplayUpdate = currentTime;
+    }
+
+    // Handle touch input
+    handleTouch();
+  }
+}
+
+// Live feed pump: wakes for each new event, or every LIVE_POLL_MS to retry
+// subscribers whose sockets were full
+void webTaskMain(void* param) {
+  LiveEvent event;
+  for (;;) {
+    xQueuePeek(liveQueue, &event, pdMS_TO_TICKS(LIVE_POLL_MS));
+    serviceLiveClients();
+  }
+}
+
+// Runs requests queueWebRequest() handed over; a slow client only holds up
+// its own worker
+void webWorkerMain(void* param) {
+  httpd_req_t* req;
+  for (;;) {
+    if (xQueueReceive(webQueue, &req, portMAX_DELAY) != pdTRUE) continue;
+    serveWebRequest(req);
+    httpd_req_async_handler_complete(req);
   }
+}
+
+void uplinkTaskMain(void* param) {
+  // WiFi association, the web server and NTP come up here, in parallel with
+  // the SD mount and while the tracker is already scanning
+  initNetwork();
+  xEventGroupWaitBits(bootEvents, BOOT_SD_DONE, pdFALSE, pdTRUE, portMAX_DELAY);
+
+  alertHttp.setReuse(true);
+  AlertEvent raised;
+  unsigned long lastWifiDebug = 0;
+  bool diagnosticsDue = NETWORK_DIAGNOSTICS && wifiConnected;
+  for (;;) {
+    // Sleeps until an alert is raised or the next poll is due; the alert
+    // stays queued for serviceWebhookAlerts(). A full batch takes none.
+    if (alertBatchCount < ALERT_BATCH_MAX) {
+      xQueuePeek(alertQueue, &raised, pdMS_TO_TICKS(UPLINK_POLL_MS));
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(UPLINK_POLL_MS));
+    }
+    serviceWebhookAlerts();
 
-  // Yield to other tasks
-  yield();
+    if (bootSteps[BOOT_NTP] == BOOT_RUNNING && time(nullptr) >= VALID_TIME_EPOCH) {
+      setBootStep(BOOT_NTP, BOOT_DONE);
+    }
+
+    drainUplinkQueue();
+    serviceUplink();
+
+    // Opt-in, and only once the boot burst of sightings has been taken off
+    // the queue: each check can block for seconds
+    if (diagnosticsDue) {
+      diagnosticsDue = false;
+      testNetworkConnectivity();
+      Serial.println("Testing HTTPS connectivity...");
+      testHttpsConnection();
+    }
 
-  // Minimal delay
-  delay(1);
+    // Periodic WiFi debug (every 30 seconds)
+    if (millis() - lastWifiDebug >= 30000) {
+      lastWifiDebug = millis();
+      Serial.println("=== WiFi Status Check ===");
+      Serial.printf("  wifiConnected: %s\n", wifiConnected ? "true" : "false");
+      Serial.printf("  WiFi.status(): %d\n", WiFi.status());
+      if (WiFi.status() == WL_CONNECTED) {
+        IPAddress ip = WiFi.localIP();
+        Serial.printf("  IP: %d.%d.%d.%d\n", ip[0], ip[1], ip[2], ip[3]);
+        Serial.printf("  RSSI: %d dBm\n", WiFi.RSSI());
+      }
+    }
+  }
 }
 
 // ============================================================================
@@ -373,12 +2083,26 @@ void initBLE() {
   pBLEScan = BLEDevice::getScan();
   pScanCallbacks = new BLEScanCallbacks();
 
-  pBLEScan->setAdvertisedDeviceCallbacks(pScanCallbacks);
-  pBLEScan->setActiveScan(true);
-  pBLEScan->setInterval(100);
-  pBLEScan->setWindow(99);
+  scanActive = activeScanMode == ACTIVE_ON;
+  configureScan();
+  scanStatsSince = millis();
+  activeBurstEnd = millis() - ACTIVE_BURST_GAP;  // The first unresolved devices get a burst right away
+
+  Serial.printf("BLE initialized: %s scan, profile %s, active %s\n",
+                scanContinuous ? "continuous" : "cycle", SCAN_PROFILES[scanProfile].name,
+                ACTIVE_SCAN_MODE_NAMES[activeScanMode]);
+}
 
-  Serial.println("BLE initialized");
+// Applies scanContinuous, scanProfile and scanActive; the scan must be stopped. The
+// continuous scan wants duplicates, which Bluedroid hands to the callback
+// without recording them, so results never accumulate. A cycle scan records
+// each address once per scan, so it reports one advert per device.
+void configureScan() {
+  const ScanProfile& profile = SCAN_PROFILES[scanProfile];
+  pBLEScan->setAdvertisedDeviceCallbacks(pScanCallbacks, scanContinuous);
+  pBLEScan->setActiveScan(scanActive);
+  pBLEScan->setInterval(profile.intervalMs);
+  pBLEScan->setWindow(profile.windowMs);
 }
 
 void initSDCard() {
@@ -389,8 +2113,8 @@ void initSDCard() {
     sdCardPresent = true;
 
     // Create logs directory if it doesn't exist
-    if (!SD.exists("/ble-logs")) {
-      SD.mkdir("/ble-logs");
+    if (!SD.exists(LOG_DIR)) {
+      SD.mkdir(LOG_DIR);
     }
 
     Serial.println("SD card initialized");
@@ -410,11 +2134,40 @@ void initAudio() {
   Serial.printf("Audio initialized on GPIO %d\n", audioPin);
 }
 
-void initWiFi() {
-  // Check if WiFi credentials are configured
-  if (strlen(WIFI_SSID) == 0 || strcmp(WIFI_SSID, "Your_WiFi_SSID") == 0) {
-    Serial.println("WiFi not configured - alerts disabled");
-    wifiConnected = false;
+bool wifiConfigured() {
+  return strlen(WIFI_SSID) > 0 && strcmp(WIFI_SSID, "Your_WiFi_SSID") != 0;
+}
+
+// Uplink task, at start. Strip buffers are only allocated once this is done
+// (display task), so WiFi gets the heap it needs first.
+void initNetwork() {
+  setBootStep(BOOT_WIFI, BOOT_RUNNING);
+  initWiFi();
+  if (!wifiConnected) {
+    setBootStep(BOOT_WIFI, wifiConfigured() ? BOOT_FAILED : BOOT_SKIPPED);
+    setBootStep(BOOT_NTP, BOOT_SKIPPED);
+    setBootStep(BOOT_WEB, BOOT_SKIPPED);
+    xEventGroupSetBits(bootEvents, BOOT_NETWORK_DONE);
+    return;
+  }
+  setBootStep(BOOT_WIFI, BOOT_DONE);
+
+  // SNTP syncs in the background; the uplink loop marks the step done
+  setBootStep(BOOT_NTP, BOOT_RUNNING);
+  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+
+  setBootStep(BOOT_WEB, BOOT_RUNNING);
+  initWebServer();
+  startWebTasks();
+  setBootStep(BOOT_WEB, webServer ? BOOT_DONE : BOOT_FAILED);
+  xEventGroupSetBits(bootEvents, BOOT_NETWORK_DONE);
+}
+
+void initWiFi() {
+  // Check if WiFi credentials are configured
+  if (!wifiConfigured()) {
+    Serial.println("WiFi not configured - alerts disabled");
+    wifiConnected = false;
     return;
   }
 
@@ -430,12 +2183,13 @@ void initWiFi() {
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
   Serial.println("WiFi.begin() called");
 
-  // Wait for connection with timeout
+  // Wait for connection with timeout (15 s), polled finely so the network
+  // is reported ready as soon as it is
   int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-    delay(500);
-    Serial.printf(".");
-    if (attempts % 10 == 9) {
+  while (WiFi.status() != WL_CONNECTED && attempts < 150) {
+    delay(100);
+    if (attempts % 5 == 4) Serial.printf(".");
+    if (attempts % 50 == 49) {
       Serial.printf(" [status=%d]\n", WiFi.status());
     }
     attempts++;
@@ -459,41 +2213,6 @@ void initWiFi() {
     Serial.printf("  RSSI:        %d dBm\n", WiFi.RSSI());
     Serial.printf("  MAC:         %s\n", WiFi.macAddress().c_str());
     Serial.printf("  DNS:         %s\n", WiFi.dnsIP().toString().c_str());
-
-    // Test network connectivity with simple TCP connection
-    Serial.println("=== Network Connectivity Test ===");
-
-    // Test gateway reachability via TCP connect to port 80 (or just ARP)
-    Serial.printf("  Testing gateway %s...\n", gateway.toString().c_str());
-    WiFiClient testClient;
-    testClient.setTimeout(3000);
-    unsigned long pingStart = millis();
-    if (testClient.connect(gateway, 80)) {
-      unsigned long pingTime = millis() - pingStart;
-      Serial.printf("  Gateway reachable! Response time: %lu ms\n", pingTime);
-      testClient.stop();
-    } else {
-      // Gateway might not have port 80 open, try DNS resolution as connectivity test
-      Serial.println("  Gateway port 80 closed (normal for most routers)");
-    }
-
-    // Test external connectivity by resolving and connecting to a known host
-    Serial.println("  Testing external connectivity (google.com)...");
-    pingStart = millis();
-    if (testClient.connect("google.com", 80)) {
-      unsigned long pingTime = millis() - pingStart;
-      Serial.printf("  External connectivity OK! Response time: %lu ms\n", pingTime);
-      testClient.stop();
-    } else {
-      Serial.println("  External connectivity FAILED!");
-    }
-
-    // Configure time via NTP
-    configTime(0, 0, "pool.ntp.org", "time.nist.gov");
-
-    // Test HTTPS connectivity with known working endpoint
-    Serial.println("Testing HTTPS connectivity...");
-    testHttpsConnection();
   } else {
     wifiConnected = false;
     Serial.println("WiFi connection FAILED");
@@ -501,6 +2220,38 @@ void initWiFi() {
   }
 }
 
+// Logs whether the gateway and the internet answer
+void testNetworkConnectivity() {
+  IPAddress gateway = WiFi.gatewayIP();
+  // Test network connectivity with simple TCP connection
+  Serial.println("=== Network Connectivity Test ===");
+
+  // Test gateway reachability via TCP connect to port 80 (or just ARP)
+  Serial.printf("  Testing gateway %s...\n", gateway.toString().c_str());
+  WiFiClient testClient;
+  testClient.setTimeout(3000);
+  unsigned long pingStart = millis();
+  if (testClient.connect(gateway, 80)) {
+    unsigned long pingTime = millis() - pingStart;
+    Serial.printf("  Gateway reachable! Response time: %lu ms\n", pingTime);
+    testClient.stop();
+  } else {
+    // Gateway might not have port 80 open, try DNS resolution as connectivity test
+    Serial.println("  Gateway port 80 closed (normal for most routers)");
+  }
+
+  // Test external connectivity by resolving and connecting to a known host
+  Serial.println("  Testing external connectivity (google.com)...");
+  pingStart = millis();
+  if (testClient.connect("google.com", 80)) {
+    unsigned long pingTime = millis() - pingStart;
+    Serial.printf("  External connectivity OK! Response time: %lu ms\n", pingTime);
+    testClient.stop();
+  } else {
+    Serial.println("  External connectivity FAILED!");
+  }
+}
+
 // Test HTTPS connectivity - compare working API vs our server
 void testHttpsConnection() {
   // Test 1: Known working API (river levels)
@@ -565,130 +2316,598 @@ void testHttpsConnection() {
 // Whitelist Management
 // ============================================================================
 
+int compareWhitelistAddr(const void* a, const void* b) {
+  return memcmp(a, b, 6);
+}
+
+// Builds the index at boot. The binary copy in WHITELIST_INDEX_PATH is a
+// single read when it matches WHITELIST_PATH; otherwise the JSON is streamed
+// and the copy rebuilt. Journal edits are replayed on top.
 void loadWhitelist() {
+  unsigned long start = millis();
   whitelistCount = 0;
-
-  if (!SPIFFS.exists("/whitelist.json")) {
-    Serial.println("No whitelist file found");
-    return;
+  whitelistOuiCount = 0;
+  recoverWhitelistFiles();
+
+  int skipped = 0;
+  whitelistBadEntries = 0;
+  whitelistIncomplete = false;
+  whitelistLoadCached = loadWhitelistIndex();
+  if (!whitelistLoadCached) {
+    if (SPIFFS.exists(WHITELIST_PATH)) {
+      // A file that breaks off still gives the entries before the break, but
+      // it's kept as it is (and re-read each boot) rather than saved over
+      skipped = readWhitelistFile(WHITELIST_PATH, whitelistAddrs, whitelistCount,
+                                  whitelistOuis, whitelistOuiCount, whitelistBadEntries);
+      whitelistIncomplete = skipped < 0;
+      whitelistCount = sortWhitelistAddrs(whitelistAddrs, whitelistCount);
+      if (whitelistIncomplete) {
+        Serial.printf("Whitelist: %s breaks off after %d entries, not saving over it\n",
+                      WHITELIST_PATH, whitelistCount + whitelistOuiCount);
+        skipped = whitelistBadEntries;
+      } else {
+        writeWhitelistIndex();
+      }
+    } else {
+      Serial.println("No whitelist file found");
+    }
   }
+  int edits = replayWhitelistJournal();
 
-  File file = SPIFFS.open("/whitelist.json", "r");
-  if (!file) {
-    Serial.println("Failed to open whitelist file");
-    return;
+  whitelistLoadMs = millis() - start;
+  Serial.printf("Loaded %d whitelist entries, %d OUI rules in %lu ms (%s, %d journal edits, %d skipped)\n",
+                whitelistCount, whitelistOuiCount, (unsigned long)whitelistLoadMs,
+                whitelistLoadCached ? "index" : "parsed", edits, skipped);
+}
+
+// Streams a whitelist file one entry at a time, so its size only bounds the
+// index, appending to addrs (unsorted) and ouis. Entries past WHITELIST_MAX
+// (or WHITELIST_OUI_MAX), malformed MACs and entries that don't parse are
+// skipped; returns how many, the unparseable ones also counted in
+// badEntries. Returns -1 if the file has no "devices" array or breaks off
+// before its end, keeping what was read up to there.
+int readWhitelistFile(const char* path, uint8_t (*addrs)[6], int& count, uint8_t (*ouis)[3], int& ouiCount, int& badEntries) {
+  File file = SPIFFS.open(path, "r");
+  if (!file) return -1;
+  if (!file.find("\"devices\"") || !file.find("[")) {
+    file.close();
+    return -1;
   }
 
-  StaticJsonDocument<4096> doc;
-  DeserializationError error = deserializeJson(doc, file);
+  int skipped = 0;
+  StaticJsonDocument<WHITELIST_ENTRY_DOC> entry;
+  WhitelistRead read;
+  while ((read = nextWhitelistEntry(file, entry)) <= WHITELIST_READ_BAD) {
+    if (read == WHITELIST_READ_BAD) {
+      badEntries++;
+      skipped++;
+      continue;
+    }
+    uint8_t addr[6];
+    int octets = parseMac(entry["mac"] | "", addr);
+    if (octets == 6 && count < WHITELIST_MAX) {
+      memcpy(addrs[count++], addr, 6);
+    } else if (octets == 3) {
+      int i = 0;
+      while (i < ouiCount && memcmp(ouis[i], addr, 3) != 0) i++;
+      if (i < ouiCount) continue;
+      if (ouiCount < WHITELIST_OUI_MAX) {
+        memcpy(ouis[ouiCount++], addr, 3);
+      } else {
+        skipped++;
+      }
+    } else {
+      skipped++;
+    }
+  }
   file.close();
+  return read == WHITELIST_READ_END ? skipped : -1;
+}
+
+// Sorts, then drops duplicates; returns the new count
+int sortWhitelistAddrs(uint8_t (*addrs)[6], int count) {
+  qsort(addrs, count, 6, compareWhitelistAddr);
+  int unique = 0;
+  for (int i = 0; i < count; i++) {
+    if (unique > 0 && memcmp(addrs[unique - 1], addrs[i], 6) == 0) continue;
+    if (unique != i) memcpy(addrs[unique], addrs[i], 6);
+    unique++;
+  }
+  return unique;
+}
+
+// Reads the next object of the "devices" array into entry. file must be
+// positioned inside the array. The object's text is read up to its matching
+// brace first, so one that doesn't parse (or is over WHITELIST_ENTRY_TEXT) is
+// stepped over whole and the next entry still reads.
+WhitelistRead nextWhitelistEntry(File& file, JsonDocument& entry) {
+  int c;
+  while ((c = file.peek()) == ' ' || c == ',' || c == '\n' || c == '\r' || c == '\t') {
+    file.read();  // Whitespace and separating commas
+  }
+  if (c == ']') return WHITELIST_READ_END;
+  if (c != '{') return WHITELIST_READ_BROKEN;
+
+  char text[WHITELIST_ENTRY_TEXT];
+  size_t length = 0;
+  int depth = 0;
+  bool inString = false;
+  bool escaped = false;
+  do {
+    if ((c = file.read()) < 0) return WHITELIST_READ_BROKEN;
+    if (length < sizeof(text)) text[length] = c;
+    length++;
+    if (escaped) {
+      escaped = false;
+    } else if (inString) {
+      escaped = c == '\\';
+      inString = c != '"';
+    } else if (c == '"') {
+      inString = true;
+    } else if (c == '{' || c == '[') {
+      depth++;
+    } else if (c == '}' || c == ']') {
+      depth--;
+    }
+  } while (depth > 0);
 
+  if (length > sizeof(text)) {
+    Serial.printf("Whitelist entry of %u bytes skipped (limit %d)\n", (unsigned)length, WHITELIST_ENTRY_TEXT);
+    return WHITELIST_READ_BAD;
+  }
+  DeserializationError error = deserializeJson(entry, (const char*)text, length);
   if (error) {
-    Serial.printf("Whitelist parse error: %s\n", error.c_str());
-    return;
+    Serial.printf("Whitelist entry skipped: %s\n", error.c_str());
+    return WHITELIST_READ_BAD;
   }
+  return WHITELIST_READ_ENTRY;
+}
+
+// Reads the binary index if it was built from the current WHITELIST_PATH.
+// A torn write fails the size check and the JSON is parsed instead.
+bool loadWhitelistIndex() {
+  File json = SPIFFS.open(WHITELIST_PATH, "r");
+  if (!json) return false;
+  uint32_t jsonSize = json.size();
+  json.close();
+
+  File file = SPIFFS.open(WHITELIST_INDEX_PATH, "r");
+  if (!file) return false;
+  WhitelistIndexHeader header;
+  bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+            header.magic == WHITELIST_INDEX_MAGIC && header.jsonSize == jsonSize &&
+            header.count <= WHITELIST_MAX && header.ouiCount <= WHITELIST_OUI_MAX &&
+            file.size() == sizeof(header) + header.count * 6 + header.ouiCount * 3;
+  ok = ok && file.read(whitelistAddrs[0], header.count * 6) == header.count * 6u &&
+       file.read(whitelistOuis[0], header.ouiCount * 3) == header.ouiCount * 3u;
+  file.close();
+
+  whitelistCount = ok ? header.count : 0;
+  whitelistOuiCount = ok ? header.ouiCount : 0;
+  return ok;
+}
 
-  JsonArray devicesArray = doc["devices"];
-  for (JsonObject device : devicesArray) {
-    if (whitelistCount >= 50) break;
+// Saves the index as it stands for WHITELIST_PATH, so call it only when the
+// two agree (straight after a parse or a compaction)
+void writeWhitelistIndex() {
+  File json = SPIFFS.open(WHITELIST_PATH, "r");
+  if (!json) return;
+  WhitelistIndexHeader header = {WHITELIST_INDEX_MAGIC, (uint32_t)json.size(),
+                                 (uint16_t)whitelistCount, (uint16_t)whitelistOuiCount};
+  json.close();
+
+  File file = SPIFFS.open(WHITELIST_INDEX_PATH, "w");
+  if (!file) return;
+  file.write((const uint8_t*)&header, sizeof(header));
+  file.write(whitelistAddrs[0], whitelistCount * 6);
+  file.write(whitelistOuis[0], whitelistOuiCount * 3);
+  bool ok = file.getWriteError() == 0;
+  file.close();
+  if (!ok) SPIFFS.remove(WHITELIST_INDEX_PATH);
+}
 
-    whitelist[whitelistCount].mac = device["mac"].as<String>();
-    whitelist[whitelistCount].name = device["name"].as<String>();
-    whitelist[whitelistCount].type = device["type"].as<String>();
-    whitelistCount++;
+// Finishes or discards a compaction cut short by a power loss. A complete
+// temp file is the new whitelist (the journal may already be gone); a
+// partial one is dropped, leaving the old file and journal to load.
+void recoverWhitelistFiles() {
+  if (SPIFFS.exists(WHITELIST_IMPORT_PATH)) SPIFFS.remove(WHITELIST_IMPORT_PATH);
+  if (!SPIFFS.exists(WHITELIST_TMP_PATH)) return;
+  if (whitelistFileComplete(WHITELIST_TMP_PATH)) {
+    commitWhitelistFile();
+    Serial.println("Whitelist: finished an interrupted save");
+  } else {
+    SPIFFS.remove(WHITELIST_TMP_PATH);
+    Serial.println("Whitelist: discarded an interrupted save");
   }
+}
 
-  Serial.printf("Loaded %d whitelist entries\n", whitelistCount);
+// Compactions end the file with "]}", so a truncated one doesn't
+bool whitelistFileComplete(const char* path) {
+  File file = SPIFFS.open(path, "r");
+  if (!file) return false;
+  char tail[2] = {};
+  bool complete = file.size() >= 2 && file.seek(file.size() - 2) &&
+                  file.read((uint8_t*)tail, 2) == 2 && tail[0] == ']' && tail[1] == '}';
+  file.close();
+  return complete;
 }
 
-void saveWhitelist() {
-  StaticJsonDocument<4096> doc;
-  JsonArray devicesArray = doc.createNestedArray("devices");
+// Swaps the complete WHITELIST_TMP_PATH in. The stale binary index goes
+// first, and the journal (folded into the temp file) before the old file,
+// so a cut at any step leaves either the old state or the complete temp.
+void commitWhitelistFile() {
+  SPIFFS.remove(WHITELIST_INDEX_PATH);
+  SPIFFS.remove(WHITELIST_JOURNAL_PATH);
+  whitelistJournalCount = 0;
+  SPIFFS.remove(WHITELIST_PATH);
+  SPIFFS.rename(WHITELIST_TMP_PATH, WHITELIST_PATH);
+}
 
-  for (int i = 0; i < whitelistCount; i++) {
-    JsonObject device = devicesArray.createNestedObject();
-    device["mac"] = whitelist[i].mac;
-    device["name"] = whitelist[i].name;
-    device["type"] = whitelist[i].type;
+// Applies the edits logged since the last compaction (boot only). Malformed
+// lines are skipped. A last line torn by a power cut is ended with a newline
+// and read again; left open, the next edit appended would run on from it and
+// be unreadable at the next boot.
+int replayWhitelistJournal() {
+  whitelistJournalCount = 0;
+  File file = SPIFFS.open(WHITELIST_JOURNAL_PATH, "r");
+  if (!file) return 0;
+
+  StaticJsonDocument<WHITELIST_ENTRY_DOC> entry;
+  uint8_t addr[6];
+  bool add;
+  int edits = 0;
+  int bad = 0;
+  bool repaired = false;
+  size_t lineStart = 0;
+  WhitelistRead read;
+  while ((read = nextJournalEntry(file, entry, addr, add)) != WHITELIST_READ_END) {
+    if (read == WHITELIST_READ_BROKEN) {
+      file.close();
+      if (repaired) break;
+      repaired = true;
+      File fix = SPIFFS.open(WHITELIST_JOURNAL_PATH, "a");
+      if (fix) {
+        fix.print('\n');
+        fix.close();
+      }
+      Serial.println("Whitelist journal: ended a torn last line");
+      file = SPIFFS.open(WHITELIST_JOURNAL_PATH, "r");
+      if (!file || !file.seek(lineStart)) break;
+      continue;
+    }
+    if (read == WHITELIST_READ_BAD) {
+      bad++;
+    } else if (add) {
+      insertWhitelistAddr(addr);
+      edits++;
+    } else {
+      removeWhitelistAddr(addr);
+      edits++;
+    }
+    lineStart = file.position();
   }
+  if (file) file.close();
+  if (bad > 0) Serial.printf("Whitelist journal: %d malformed line(s) skipped\n", bad);
+  whitelistJournalCount = edits + bad;
+  return edits;
+}
 
-  File file = SPIFFS.open("/whitelist.json", "w");
-  if (!file) {
-    Serial.println("Failed to open whitelist for writing");
-    return;
+// Reads one journal line: '+' and a JSON entry for an addition, '-' and a
+// MAC for a removal. The line is read whole first, so a malformed one is
+// skipped without losing the lines after it.
+WhitelistRead nextJournalEntry(File& file, JsonDocument& entry, uint8_t* addr, bool& add) {
+  char line[WHITELIST_ENTRY_TEXT + 1];  // Op and entry
+  size_t length = 0;
+  int c;
+  while ((c = file.read()) >= 0 && c != '\n') {
+    if (length < sizeof(line)) line[length] = c;
+    length++;
+  }
+  if (c < 0) return length == 0 ? WHITELIST_READ_END : WHITELIST_READ_BROKEN;
+  if (length < 2 || length > sizeof(line)) return WHITELIST_READ_BAD;
+
+  char mac[18];
+  if (line[0] == '+') {
+    if (deserializeJson(entry, (const char*)line + 1, length - 1)) return WHITELIST_READ_BAD;
+    strlcpy(mac, entry["mac"] | "", sizeof(mac));
+  } else if (line[0] == '-' && length - 1 < sizeof(mac)) {
+    memcpy(mac, line + 1, length - 1);
+    mac[length - 1] = '\0';
+  } else {
+    return WHITELIST_READ_BAD;
   }
+  add = line[0] == '+';
+  return parseMac(mac, addr) == 6 ? WHITELIST_READ_ENTRY : WHITELIST_READ_BAD;
+}
 
-  serializeJson(doc, file);
-  file.close();
+// Appends one edit to the journal (a line, not a rewrite of the whole file),
+// compacting once WHITELIST_JOURNAL_MAX edits have piled up or if the append
+// fails. Caller holds whitelistMutex.
+void journalWhitelistEdit(const WhitelistEntry* added, const uint8_t* removed) {
+  char mac[18];
+  formatMac(added ? added->addr : removed, mac);
+
+  bool ok = false;
+  File file = SPIFFS.open(WHITELIST_JOURNAL_PATH, "a");
+  if (file) {
+    if (added) {
+      StaticJsonDocument<WHITELIST_ENTRY_DOC> entry;
+      entry["mac"] = mac;
+      entry["name"] = added->name;
+      entry["type"] = added->type;
+      file.print('+');
+      serializeJson(entry, file);
+    } else {
+      file.printf("-%s", mac);
+    }
+    file.print('\n');
+    ok = file.getWriteError() == 0;
+    file.close();
+  }
 
-  Serial.printf("Saved %d whitelist entries\n", whitelistCount);
+  if (ok) whitelistJournalCount++;
+  if (!ok || whitelistJournalCount >= WHITELIST_JOURNAL_MAX) compactWhitelist(nullptr);
 }
 
-bool isDeviceKnown(String mac) {
-  mac.toUpperCase();
+// Rewrites WHITELIST_PATH from the index through WHITELIST_TMP_PATH,
+// streaming: entries of importPath (if any), the old file and the journal's
+// additions are copied with their names and types while still in the index,
+// first occurrence winning; index entries found in none are appended as bare
+// MACs. Refused while whitelistIncomplete. Caller holds whitelistMutex, so the
+// index can't change underneath.
+bool compactWhitelist(const char* importPath) {
+  // The index holds only what was read before the file broke off; the rest
+  // would be lost. Journaled edits keep working in the meantime.
+  if (whitelistIncomplete) {
+    Serial.println("Whitelist: not compacting over a file that didn't load in full");
+    return false;
+  }
+
+  unsigned long start = millis();
+  File out = SPIFFS.open(WHITELIST_TMP_PATH, "w");
+  if (!out) {
+    Serial.println("Failed to open whitelist for writing");
+    return false;
+  }
+
+  WhitelistWriter writer = {};
+  StaticJsonDocument<WHITELIST_ENTRY_DOC> entry;
+  out.print("{\"devices\":[");
+  if (importPath) copyWhitelistFile(importPath, out, writer, entry);
+  copyWhitelistFile(WHITELIST_PATH, out, writer, entry);
+  File journal = SPIFFS.open(WHITELIST_JOURNAL_PATH, "r");
+  if (journal) {
+    uint8_t addr[6];
+    bool add;
+    WhitelistRead read;
+    while ((read = nextJournalEntry(journal, entry, addr, add)) <= WHITELIST_READ_BAD) {
+      if (read == WHITELIST_READ_ENTRY && add) writeWhitelistEntry(out, writer, entry, addr, 6);
+    }
+    journal.close();
+  }
+
+  char mac[18];
   for (int i = 0; i < whitelistCount; i++) {
-    String wlMac = whitelist[i].mac;
-    wlMac.toUpperCase();
-    if (mac == wlMac) {
-      return true;
+    if (writer.written[i / 8] & (1 << (i % 8))) continue;
+    formatMac(whitelistAddrs[i], mac);
+    if (writer.count++ > 0) out.print(',');
+    out.printf("{\"mac\":\"%s\"}", mac);
+  }
+  for (int i = 0; i < whitelistOuiCount; i++) {
+    if (writer.ouisWritten & (1ULL << i)) continue;
+    const uint8_t* oui = whitelistOuis[i];
+    if (writer.count++ > 0) out.print(',');
+    out.printf("{\"mac\":\"%02X:%02X:%02X\"}", oui[0], oui[1], oui[2]);
+  }
+  out.print("]}");
+  bool ok = out.getWriteError() == 0;
+  out.close();
+
+  if (!ok) {
+    Serial.println("Whitelist write failed");
+    SPIFFS.remove(WHITELIST_TMP_PATH);
+    return false;
+  }
+  commitWhitelistFile();
+  writeWhitelistIndex();
+
+  Serial.printf("Saved %d whitelist entries in %lu ms\n", writer.count, millis() - start);
+  return true;
+}
+
+void copyWhitelistFile(const char* path, File& out, WhitelistWriter& writer, JsonDocument& entry) {
+  File in = SPIFFS.open(path, "r");
+  if (!in) return;
+  if (in.find("\"devices\"") && in.find("[")) {
+    WhitelistRead read;
+    while ((read = nextWhitelistEntry(in, entry)) <= WHITELIST_READ_BAD) {
+      if (read == WHITELIST_READ_BAD) continue;
+      uint8_t addr[6];
+      int octets = parseMac(entry["mac"] | "", addr);
+      writeWhitelistEntry(out, writer, entry, addr, octets);
     }
   }
-  return false;
+  in.close();
 }
 
-void addToWhitelist(int deviceIndex) {
-  if (deviceIndex < 0 || deviceIndex >= deviceCount) return;
-  if (whitelistCount >= 50) {
-    Serial.println("Whitelist full!");
+// Writes entry if its address is in the index and not written yet
+void writeWhitelistEntry(File& out, WhitelistWriter& writer, JsonDocument& entry, const uint8_t* addr, int octets) {
+  if (octets == 6) {
+    int i = findWhitelistAddr(addr);
+    if (i < 0 || (writer.written[i / 8] & (1 << (i % 8)))) return;
+    writer.written[i / 8] |= 1 << (i % 8);
+  } else if (octets == 3) {
+    int i = findWhitelistOui(addr);
+    if (i < 0 || (writer.ouisWritten & (1ULL << i))) return;
+    writer.ouisWritten |= 1ULL << i;
+  } else {
     return;
   }
+  if (writer.count++ > 0) out.print(',');
+  serializeJson(entry, out);
+}
 
-  BLEDeviceInfo& dev = devices[deviceIndex];
+// Parses "AA:BB:CC:DD:EE:FF" or an OUI prefix "AA:BB:CC" (either case, ':'
+// or '-') into addr. Returns the octet count, 0 if malformed.
+int parseMac(const char* text, uint8_t* addr) {
+  int octets = 0;
+  for (;;) {
+    uint8_t value = 0;
+    for (int k = 0; k < 2; k++) {
+      char c = text[k];
+      uint8_t digit;
+      if (c >= '0' && c <= '9') digit = c - '0';
+      else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+      else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+      else return 0;
+      value = value << 4 | digit;
+    }
+    addr[octets++] = value;
+    text += 2;
+    if (*text == '\0') break;
+    if (octets == 6 || (*text != ':' && *text != '-')) return 0;
+    text++;
+  }
+  return octets == 6 || octets == 3 ? octets : 0;
+}
 
-  // Check if already whitelisted
-  if (isDeviceKnown(dev.mac)) {
-    Serial.println("Device already whitelisted");
-    return;
+// First index position not below addr
+int whitelistLowerBound(const uint8_t* addr) {
+  int lo = 0;
+  int hi = whitelistCount;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (memcmp(whitelistAddrs[mid], addr, 6) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Index position of addr, or -1
+int findWhitelistAddr(const uint8_t* addr) {
+  int i = whitelistLowerBound(addr);
+  return i < whitelistCount && memcmp(whitelistAddrs[i], addr, 6) == 0 ? i : -1;
+}
+
+// OUI rule covering addr (its first three octets), or -1
+int findWhitelistOui(const uint8_t* addr) {
+  for (int i = 0; i < whitelistOuiCount; i++) {
+    if (memcmp(whitelistOuis[i], addr, 3) == 0) return i;
   }
+  return -1;
+}
+
+// Binary search plus the OUI rules; allocates nothing. OUI rules only make
+// sense for public addresses: a random one carries no vendor prefix, and one
+// that happens to start with a listed OUI mustn't be let off its alert.
+bool isDeviceKnown(const uint8_t* addr, bool publicAddr) {
+  return findWhitelistAddr(addr) >= 0 || (publicAddr && findWhitelistOui(addr) >= 0);
+}
 
-  whitelist[whitelistCount].mac = dev.mac;
-  whitelist[whitelistCount].name = dev.name;
-  whitelist[whitelistCount].type = dev.deviceType;
+// Sorted insert; false if addr is already there or the index is full
+bool insertWhitelistAddr(const uint8_t* addr) {
+  int pos = whitelistLowerBound(addr);
+  if (pos < whitelistCount && memcmp(whitelistAddrs[pos], addr, 6) == 0) return false;
+  if (whitelistCount >= WHITELIST_MAX) return false;
+  memmove(whitelistAddrs[pos + 1], whitelistAddrs[pos], (whitelistCount - pos) * 6);
+  memcpy(whitelistAddrs[pos], addr, 6);
   whitelistCount++;
+  return true;
+}
 
-  dev.isKnown = true;
+bool removeWhitelistAddr(const uint8_t* addr) {
+  int i = findWhitelistAddr(addr);
+  if (i < 0) return false;
+  memmove(whitelistAddrs[i], whitelistAddrs[i + 1], (whitelistCount - i - 1) * 6);
+  whitelistCount--;
+  return true;
+}
+
+// deviceMutex held: re-checks every tracked device after the index was
+// replaced. Returns how many changed.
+int refreshKnownDevices() {
+  int changed = 0;
+  for (int i = 0; i < deviceCount; i++) {
+    BLEDeviceInfo& dev = deviceAt(i);
+    bool known = isDeviceKnown(dev.addr, dev.publicAddr);
+    if (known == dev.isKnown) continue;
+    dev.isKnown = known;
+    updateDeviceViews(dev);
+    noteDeviceChange(dev, true);
+    changed++;
+  }
+  return changed;
+}
+
+// Whitelist edits come from the display task; deviceIndex is a position in
+// displayView. The table is locked only for the edit itself, then journaled
+// and redrawn without holding it
+void addToWhitelist(int deviceIndex) {
+  char mac[18];
+  WhitelistEntry added;
+  {
+    ScopedLock whitelistLock(whitelistMutex);
+    {
+      ScopedLock lock(deviceMutex);
+      if (deviceIndex < 0 || deviceIndex >= deviceCount) return;
+      if (whitelistCount >= WHITELIST_MAX) {
+        Serial.println("Whitelist full!");
+        return;
+      }
+
+      BLEDeviceInfo& dev = deviceInView(displayView, deviceIndex);
+      formatMac(dev.addr, mac);
+      if (!insertWhitelistAddr(dev.addr)) {
+        Serial.println("Device already whitelisted");
+        return;
+      }
+
+      memcpy(added.addr, dev.addr, 6);
+      strlcpy(added.name, deviceDisplayName(dev), sizeof(added.name));
+      added.type = deviceTypeName(dev.deviceType);
+
+      dev.isKnown = true;
+      updateDeviceViews(dev);
+      noteDeviceChange(dev, true);
+    }
+    journalWhitelistEdit(&added, nullptr);
+  }
 
-  saveWhitelist();
   alertWhitelistAdded();
   drawDisplay();
 
-  Serial.printf("Added to whitelist: %s (%s)\n", dev.name.c_str(), dev.mac.c_str());
+  Serial.printf("Added to whitelist: %s (%s)\n", added.name, mac);
 }
 
 void removeFromWhitelist(int deviceIndex) {
-  if (deviceIndex < 0 || deviceIndex >= deviceCount) return;
-
-  BLEDeviceInfo& dev = devices[deviceIndex];
-  String macToRemove = dev.mac;
-  macToRemove.toUpperCase();
-
-  // Find and remove from whitelist
-  for (int i = 0; i < whitelistCount; i++) {
-    String wlMac = whitelist[i].mac;
-    wlMac.toUpperCase();
-    if (macToRemove == wlMac) {
-      // Shift remaining entries
-      for (int j = i; j < whitelistCount - 1; j++) {
-        whitelist[j] = whitelist[j + 1];
+  char mac[18];
+  uint8_t removed[6];
+  {
+    ScopedLock whitelistLock(whitelistMutex);
+    {
+      ScopedLock lock(deviceMutex);
+      if (deviceIndex < 0 || deviceIndex >= deviceCount) return;
+
+      BLEDeviceInfo& dev = deviceInView(displayView, deviceIndex);
+      formatMac(dev.addr, mac);
+      if (!removeWhitelistAddr(dev.addr)) {
+        if (dev.publicAddr && findWhitelistOui(dev.addr) >= 0) Serial.printf("%s is known by an OUI rule\n", mac);
+        return;
       }
-      whitelistCount--;
-      dev.isKnown = false;
-      saveWhitelist();
-      drawDisplay();
-      Serial.printf("Removed from whitelist: %s\n", dev.mac.c_str());
-      return;
+      memcpy(removed, dev.addr, 6);
+
+      dev.isKnown = isDeviceKnown(dev.addr, dev.publicAddr);
+      updateDeviceViews(dev);
+      noteDeviceChange(dev, true);
     }
+    journalWhitelistEdit(nullptr, removed);
   }
+
+  drawDisplay();
+  Serial.printf("Removed from whitelist: %s\n", mac);
 }
 
 // ============================================================================
@@ -696,768 +2915,3565 @@ void removeFromWhitelist(int deviceIndex) {
 // ============================================================================
 
 void startBLEScan() {
-  Serial.printf("Starting BLE scan... heap=%d, largest=%d\n", ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+  uint32_t freeHeap = ESP.getFreeHeap();
+  uint32_t largestBlock = ESP.getMaxAllocHeap();
+  if (lastScanFreeHeap == 0) {
+    Serial.printf("Starting BLE scan... heap=%d, largest=%d\n", freeHeap, largestBlock);
+  } else {
+    // Delta since the previous scan shows whether tracking is fragmenting the heap
+    Serial.printf("Starting BLE scan... heap=%d (%+d), largest=%d (%+d)\n",
+                  freeHeap, (int)(freeHeap - lastScanFreeHeap),
+                  largestBlock, (int)(largestBlock - lastScanLargestBlock));
+  }
+  lastScanFreeHeap = freeHeap;
+  lastScanLargestBlock = largestBlock;
+  scanCacheHits = 0;
+  scanCacheMisses = 0;
 
   scanStartTime = millis();
-  scanInProgress = true;
+  if (!scanContinuous && wantActiveScan(scanStartTime) != scanActive) {
+    setScanActive(!scanActive, scanStartTime);
+  }
 
-  // Clear previous scan results
+  // Clear previous scan results (a continuous scan never records any)
   pBLEScan->clearResults();
 
-  // Start async scan (non-blocking)
-  bool started = pBLEScan->start(SCAN_DURATION, nullptr, false);
-  Serial.printf("  Scan started: %s\n", started ? "true" : "false");
+  // Start async scan (non-blocking); a duration of 0 scans until stopped
+  bool started = pBLEScan->start(scanContinuous ? 0 : SCAN_DURATION, nullptr, false);
+  // A cycle that failed to start still runs out its duration, so retries come
+  // SCAN_INTERVAL apart; a continuous scan is retried after SCAN_RETRY_MS
+  scanInProgress = started || !scanContinuous;
+  Serial.printf("  Scan started: %s (%s, %s, %s)\n", started ? "true" : "false",
+                scanContinuous ? "continuous" : "cycle", SCAN_PROFILES[scanProfile].name,
+                scanActive ? "active" : "passive");
 }
 
-void processDevice(BLEAdvertisedDevice& device) {
-  String mac = device.getAddress().toString().c_str();
-  mac.toUpperCase();
-
-  String name = device.haveName() ? device.getName().c_str() : "Unknown";
-  int rssi = device.getRSSI();
-  String deviceType = detectDeviceType(device);
-  String manufacturer = detectManufacturer(device);
-
-  updateDeviceList(mac, name, rssi, deviceType, manufacturer);
+// Called from the BLE callback: copy the advert into the ingest queue.
+// Returns false (and counts a drop) if the tracker task has fallen behind.
+bool ingestAdvert(BLEAdvertisedDevice& device) {
+  BLEAddress address = device.getAddress();
+  const uint8_t* payload = device.getPayload();
+  return ingestRecord(*address.getNative(), device.getAddressType(), device.getRSSI(), payload,
+                      payload ? device.getPayloadLength() : 0);
 }
 
-void updateDeviceList(String mac, String name, int rssi, String deviceType, String manufacturer) {
-  unsigned long currentTime = millis();
+// Producer side of the ingest queue, also fed by the benchmark replay
+bool ingestRecord(const uint8_t* addr, uint8_t addrType, int rssi, const uint8_t* payload, size_t length) {
+  uint32_t head = ingestHead.load(std::memory_order_relaxed);
+  uint32_t depth = head - ingestTail.load(std::memory_order_acquire);
+  if (depth >= INGEST_QUEUE_SIZE) {
+    ingestDropped++;
+    return false;
+  }
 
-  // Check if device already exists
-  for (int i = 0; i < deviceCount; i++) {
-    if (devices[i].mac == mac) {
-      // Update existing device
-      devices[i].rssi = rssi;
-      devices[i].lastSeen = currentTime;
-      if (name != "Unknown" && devices[i].name == "Unknown") {
-        devices[i].name = name;  // Update name if we got a better one
-      }
-      if (deviceType != "Unknown" && devices[i].deviceType == "Unknown") {
-        devices[i].deviceType = deviceType;
-      }
-      if (manufacturer != "Unknown" && devices[i].manufacturer == "Unknown") {
-        devices[i].manufacturer = manufacturer;
-      }
+  AdvertRecord& rec = ingestQueue[head & (INGEST_QUEUE_SIZE - 1)];
+  memcpy(rec.addr, addr, sizeof(rec.addr));
+  rec.addrType = addrType;
+  rec.rssi = (int8_t)rssi;
+  length = min(length, (size_t)ADVERT_PAYLOAD_MAX);
+  memcpy(rec.payload, payload, length);
+  rec.payloadLen = (uint8_t)length;
+  rec.payloadHash = hashPayload(rec.payload, length);
+
+  ingestHead.store(head + 1, std::memory_order_release);
+  ingestEnqueued++;
+  if (firstAdvertMs == 0) firstAdvertMs = millis();
+  if (depth + 1 > ingestHighWater) {
+    ingestHighWater = depth + 1;
+  }
 
-      // Check if still "new"
-      devices[i].isNew = (currentTime - devices[i].firstSeen) < NEW_DEVICE_THRESHOLD;
+  // Wake the tracker; notifications coalesce, so this is cheap per advert
+  if (trackerTask) xTaskNotifyGive(trackerTask);
+  return true;
+}
 
-      return;
-    }
+// FNV-1a, cheap enough to run in the BLE callback on every advert
+uint32_t hashPayload(const uint8_t* payload, size_t length) {
+  return hashMix(2166136261u, payload, length);
+}
+
+// Continues an FNV-1a hash over length more bytes
+uint32_t hashMix(uint32_t hash, const uint8_t* bytes, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
   }
+  return hash;
+}
 
-  // New device - add to list
-  if (deviceCount >= MAX_TRACKED_DEVICES) {
-    // Remove oldest/weakest device
-    int removeIndex = 0;
-    int weakestRSSI = 0;
-    for (int i = 0; i < deviceCount; i++) {
-      if (devices[i].rssi < weakestRSSI) {
-        weakestRSSI = devices[i].rssi;
-        removeIndex = i;
+// Folds one AD structure into an advert fingerprint: its type and the parts
+// that stay put when a phone or tag rotates its private address (flags,
+// service UUIDs, name, TX power, company ID). Fields whose content rotates
+// with the address - Continuity messages, service data - count only by
+// their shape: Apple's message types and lengths, otherwise length alone.
+uint32_t fingerprintField(uint32_t hash, uint8_t adType, const uint8_t* data, uint8_t dataLen) {
+  hash = hashMix(hash, &adType, 1);
+  switch (adType) {
+    case 0x01:  // Flags
+    case 0x02:  // 16-bit service UUIDs
+    case 0x03:
+    case 0x06:  // 128-bit service UUIDs
+    case 0x07:
+    case 0x08:  // Local name
+    case 0x09:
+    case 0x0A:  // TX power level
+    case 0x19:  // Appearance
+      return hashMix(hash, data, dataLen);
+
+    case 0x16:  // Service data: the 16-bit UUID it belongs to
+      hash = hashMix(hash, data, min((int)dataLen, 2));
+      return hashMix(hash, &dataLen, 1);
+
+    case 0xFF: {  // Manufacturer data
+      if (dataLen < 2) return hashMix(hash, &dataLen, 1);
+      hash = hashMix(hash, data, 2);
+      if ((data[0] | (data[1] << 8)) != 0x004C) return hashMix(hash, &dataLen, 1);
+      // Apple Continuity: a run of type, length, value messages
+      size_t pos = 2;
+      while (pos + 1 < dataLen) {
+        hash = hashMix(hash, &data[pos], 2);
+        pos += 2 + data[pos + 1];
       }
+      return hash;
     }
-    // Shift remaining devices
-    for (int i = removeIndex; i < deviceCount - 1; i++) {
-      devices[i] = devices[i + 1];
-    }
-    deviceCount--;
+
+    default:
+      return hashMix(hash, &dataLen, 1);
   }
+}
 
-  // Add new device
-  BLEDeviceInfo newDevice;
-  newDevice.mac = mac;
-  newDevice.name = name;
-  newDevice.rssi = rssi;
-  newDevice.deviceType = deviceType;
-  newDevice.manufacturer = manufacturer;
-  newDevice.isKnown = isDeviceKnown(mac);
-  newDevice.isNew = true;
-  newDevice.firstSeen = currentTime;
-  newDevice.lastSeen = currentTime;
-  newDevice.alertSent = false;
+// Walk the raw AD structures once, picking out the fields used for
+// classification. Runs in the tracker task, called from processDevice() on a
+// classification-cache miss.
+void parseAdvertPayload(const uint8_t* payload, size_t length, AdvertRecord& rec) {
+  rec.flags = 0;
+  rec.mfgId = 0;
+  rec.mfgType = 0;
+  rec.serviceUuid16 = 0;
+  rec.fingerprint = 2166136261u;
+  rec.name[0] = '\0';
+
+  // Bluetooth base UUID (little endian) without the 16-bit part in bytes 12-13
+  static const uint8_t BASE_UUID_LE[12] = {
+    0xFB, 0x34, 0x9B, 0x5F, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00
+  };
+
+  size_t pos = 0;
+  while (payload != nullptr && pos + 1 < length) {
+    uint8_t fieldLen = payload[pos];
+    if (fieldLen == 0 || pos + 1 + fieldLen > length) break;
+
+    uint8_t adType = payload[pos + 1];
+    const uint8_t* data = &payload[pos + 2];
+    uint8_t dataLen = fieldLen - 1;
+    rec.fingerprint = fingerprintField(rec.fingerprint, adType, data, dataLen);
+
+    switch (adType) {
+      case 0x08:  // Shortened local name
+      case 0x09:  // Complete local name
+        if (adType == 0x09 || !(rec.flags & ADV_HAS_NAME)) {
+          uint8_t n = min((int)dataLen, ADVERT_NAME_LEN);
+          memcpy(rec.name, data, n);
+          rec.name[n] = '\0';
+          rec.flags |= ADV_HAS_NAME;
+        }
+        break;
 
-  devices[deviceCount] = newDevice;
-  deviceCount++;
+      case 0x02:  // Incomplete list of 16-bit service UUIDs
+      case 0x03:  // Complete list of 16-bit service UUIDs
+        if (dataLen >= 2 && !(rec.flags & ADV_HAS_UUID16)) {
+          rec.serviceUuid16 = data[0] | (data[1] << 8);
+          rec.flags |= ADV_HAS_UUID16;
+        }
+        break;
+
+      case 0x06:  // Incomplete list of 128-bit service UUIDs
+      case 0x07:  // Complete list of 128-bit service UUIDs
+        // Only SIG-assigned UUIDs written in 128-bit form map to a UUID16
+        if (dataLen >= 16 && !(rec.flags & ADV_HAS_UUID16) &&
+            memcmp(data, BASE_UUID_LE, sizeof(BASE_UUID_LE)) == 0 &&
+            data[14] == 0 && data[15] == 0) {
+          rec.serviceUuid16 = data[12] | (data[13] << 8);
+          rec.flags |= ADV_HAS_UUID16;
+        }
+        break;
+
+      case 0xFF:  // Manufacturer specific data
+        if (dataLen >= 2 && !(rec.flags & ADV_HAS_MFG_ID)) {
+          rec.mfgId = data[0] | (data[1] << 8);
+          rec.flags |= ADV_HAS_MFG_ID;
+          if (dataLen > 2) {
+            rec.mfgType = data[2];
+            rec.flags |= ADV_HAS_MFG_TYPE;
+          }
+        }
+        break;
 
-  // Log to SD card
-  logDeviceToSD(newDevice);
+      default:
+        break;
+    }
 
-  // Alert for unknown devices
-  if (!newDevice.isKnown && !newDevice.alertSent) {
-    Serial.printf("ALERT: Unknown device %s (%s) RSSI: %d\n",
-                  name.c_str(), mac.c_str(), rssi);
-    alertUnknownDevice();
-    sendWebhookAlert(newDevice);
-    devices[deviceCount - 1].alertSent = true;
-  } else if (newDevice.isNew) {
-    Serial.printf("NEW: %s (%s) RSSI: %d\n", name.c_str(), mac.c_str(), rssi);
-    alertNewDevice();
+    pos += 1 + fieldLen;
   }
 }
 
-void pruneStaleDevices() {
-  unsigned long currentTime = millis();
-  int i = 0;
+// Called from the tracker task with deviceMutex held: hand queued adverts to
+// the device tracker, at most one batch. Returns the number processed.
+int drainIngestQueue() {
+  int n = 0;
+  for (; n < INGEST_BATCH_SIZE; n++) {
+    uint32_t tail = ingestTail.load(std::memory_order_relaxed);
+    if (tail == ingestHead.load(std::memory_order_acquire)) break;
 
-  while (i < deviceCount) {
-    unsigned long age = currentTime - devices[i].lastSeen;
-    if (age > DEVICE_TIMEOUT) {
+    processDevice(ingestQueue[tail & (INGEST_QUEUE_SIZE - 1)]);
 
-      // Shift remaining devices
-      for (int j = i; j < deviceCount - 1; j++) {
-        devices[j] = devices[j + 1];
-      }
-      deviceCount--;
-      // Don't increment i - check the device that shifted into this position
-    } else {
-      i++;
-    }
+    // Release the slot only after processing so the producer can't overwrite it
+    ingestTail.store(tail + 1, std::memory_order_release);
+  }
+  return n;
+}
+
+void processDevice(AdvertRecord& rec) {
+  // Fast path: same device re-sending the advert we already classified
+  int slot = findDeviceSlot(packAddress(rec.addr));
+  if (slot != DEVICE_SLOT_EMPTY && devices[slot].payloadHash == rec.payloadHash) {
+    BLEDeviceInfo& dev = devices[slot];
+    dev.rssi = rec.rssi;
+    dev.lastSeen = millis();
+    dev.isNew = (dev.lastSeen - dev.firstSeen) < NEW_DEVICE_THRESHOLD;
+    updateDeviceViews(dev);
+    noteDeviceChange(dev, false);
+    recordRssiSample(dev, rec.rssi, dev.lastSeen);
+    classifyCacheHits++;
+    scanCacheHits++;
+    return;
   }
+  classifyCacheMisses++;
+  scanCacheMisses++;
+
+  uint32_t classifyStart = micros();
+  parseAdvertPayload(rec.payload, rec.payloadLen, rec);
+  const char* name = (rec.flags & ADV_HAS_NAME) ? rec.name : "";
+  DeviceClass cls = classifyAdvert(rec);
+  uint32_t classifyUs = micros() - classifyStart;
+  metricsWindow.classified++;
+  metricsWindow.classifyUs += classifyUs;
+  noteMetricMax(metricsWindow.classifyMaxUs, classifyUs);
+
+  uint32_t fingerprint = isPrivateAddress(rec.addr, rec.addrType) ? rec.fingerprint : 0;
+  updateDeviceList(rec.addr, rec.addrType, name, rec.rssi, cls.type, cls.mfr, rec.payloadHash, fingerprint);
 }
 
 // ============================================================================
-// Device Type Detection
+// Device Table
 // ============================================================================
 
-String detectDeviceType(BLEAdvertisedDevice& device) {
-  // Check manufacturer data
-  if (device.haveManufacturerData()) {
-    String mfgData = device.getManufacturerData();
-    if (mfgData.length() >= 2) {
-      uint16_t mfgId = (uint8_t)mfgData[0] | ((uint8_t)mfgData[1] << 8);
-
-      // Apple devices
-      if (mfgId == 0x004C) {
-        if (mfgData.length() > 2) {
-          uint8_t type = (uint8_t)mfgData[2];
-          if (type == 0x02) return "iBeacon";
-          if (type == 0x05) return "AirDrop";
-          if (type == 0x07) return "AirPods";
-          if (type == 0x09) return "AirPlay";
-          if (type == 0x10) return "AirTag";
-        }
-        return "Apple";
-      }
+void initDeviceTable() {
+  viewSize = 0;
+  lastSeenViewSorted = true;
+  evictHeapSize = 0;
+  for (int i = 0; i < DEVICE_HASH_SIZE; i++) {
+    deviceHash[i] = DEVICE_SLOT_EMPTY;
+  }
+  // Stack the free slots so slot 0 is handed out first
+  freeSlotCount = 0;
+  for (int i = MAX_TRACKED_DEVICES - 1; i >= 0; i--) {
+    freeSlots[freeSlotCount++] = i;
+  }
+  deviceCount = 0;
+  // 20 bits keeps every cursor below 2^53, exact as a JSON number anywhere
+  changeBootId = esp_random() % 0xFFFFF + 1;
 
-      // Samsung
-      if (mfgId == 0x0075) return "Samsung";
-
-      // Google
-      if (mfgId == 0x00E0) return "Google";
-
-      // Microsoft
-      if (mfgId == 0x0006) return "Microsoft";
-
-      // Tile trackers
-      if (mfgId == 0x0477) return "Tile";
-    }
-  }
-
-  // Check service UUIDs
-  if (device.haveServiceUUID()) {
-    BLEUUID uuid = device.getServiceUUID();
-    String uuidStr = uuid.toString().c_str();
-
-    // Standard Bluetooth services
-    if (uuidStr.indexOf("180d") >= 0) return "Wearable";      // Heart Rate
-    if (uuidStr.indexOf("180f") >= 0) return "BLE Device";    // Battery
-    if (uuidStr.indexOf("1812") >= 0) return "HID";           // Human Interface Device
-    if (uuidStr.indexOf("1803") >= 0) return "Beacon";        // Link Loss
-    if (uuidStr.indexOf("fe9f") >= 0) return "Phone";         // Google Nearby
-  }
-
-  // Check device name patterns
-  String name = device.haveName() ? String(device.getName().c_str()) : "";
-  name.toLowerCase();
-
-  if (name.indexOf("airpods") >= 0) return "Audio";
-  if (name.indexOf("galaxy buds") >= 0) return "Audio";
-  if (name.indexOf("beats") >= 0) return "Audio";
-  if (name.indexOf("jbl") >= 0) return "Audio";
-  if (name.indexOf("bose") >= 0) return "Audio";
-  if (name.indexOf("fitbit") >= 0) return "Wearable";
-  if (name.indexOf("watch") >= 0) return "Wearable";
-  if (name.indexOf("band") >= 0) return "Wearable";
-  if (name.indexOf("beacon") >= 0) return "Beacon";
-  if (name.indexOf("tile") >= 0) return "Tracker";
-  if (name.indexOf("airtag") >= 0) return "Tracker";
-  if (name.indexOf("iphone") >= 0) return "Phone";
-  if (name.indexOf("galaxy") >= 0) return "Phone";
-  if (name.indexOf("pixel") >= 0) return "Phone";
-
-  return "Unknown";
-}
-
-String detectManufacturer(BLEAdvertisedDevice& device) {
-  if (device.haveManufacturerData()) {
-    String mfgData = device.getManufacturerData();
-    if (mfgData.length() >= 2) {
-      uint16_t mfgId = (uint8_t)mfgData[0] | ((uint8_t)mfgData[1] << 8);
-
-      switch (mfgId) {
-        case 0x004C: return "Apple";
-        case 0x0075: return "Samsung";
-        case 0x00E0: return "Google";
-        case 0x0006: return "Microsoft";
-        case 0x0477: return "Tile";
-        case 0x0087: return "Garmin";
-        case 0x0157: return "Huawei";
-        case 0x0310: return "Xiaomi";
-        case 0x0059: return "Nordic";
-        case 0x004F: return "Sony";
-        default: break;
-      }
-    }
+  Serial.printf("Device table: %d slots x %d bytes = %d bytes (no per-device heap)\n",
+                MAX_TRACKED_DEVICES, (int)sizeof(BLEDeviceInfo), (int)sizeof(devices));
+}
+
+uint64_t packAddress(const uint8_t* addr) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; i++) {
+    key = (key << 8) | addr[i];
   }
-  return "Unknown";
+  return key;
 }
 
-// ============================================================================
-// Display Functions
-// ============================================================================
+uint32_t hashAddress(uint64_t addrKey) {
+  // Fibonacci hashing: multiply spreads the low-entropy OUI bits across the
+  // word, the top bits select the bucket
+  static_assert((DEVICE_HASH_SIZE & (DEVICE_HASH_SIZE - 1)) == 0, "DEVICE_HASH_SIZE must be a power of 2");
+  static_assert(DEVICE_HASH_SIZE >= 2 * MAX_TRACKED_DEVICES, "DEVICE_HASH_SIZE too small for load factor");
+  return (uint32_t)((addrKey * 0x9E3779B97F4A7C15ULL) >> 40) & (DEVICE_HASH_SIZE - 1);
+}
 
-void drawDisplay() {
-  tft.fillScreen(COLOR_BG);
-  drawHeader();
+// Returns the slot holding addrKey, or DEVICE_SLOT_EMPTY
+int findDeviceSlot(uint64_t addrKey) {
+  uint32_t pos = hashAddress(addrKey);
+  while (deviceHash[pos] != DEVICE_SLOT_EMPTY) {
+    if (packAddress(devices[deviceHash[pos]].addr) == addrKey) {
+      return deviceHash[pos];
+    }
+    pos = (pos + 1) & (DEVICE_HASH_SIZE - 1);
+  }
+  return DEVICE_SLOT_EMPTY;
+}
 
-  // Draw visible devices
-  int visibleCount = min(deviceCount - scrollOffset, MAX_VISIBLE_DEVICES);
-  for (int i = 0; i < visibleCount; i++) {
-    int deviceIndex = i + scrollOffset;
-    int yPos = ROW_START_Y + (i * DEVICE_ROW_HEIGHT);
-    drawDeviceRow(deviceIndex, yPos);
+// Claims a free slot for addrKey and indexes it. Caller must ensure the
+// table is not full and the address is not already present.
+int allocDeviceSlot(uint64_t addrKey) {
+  if (freeSlotCount == 0) return DEVICE_SLOT_EMPTY;
 
-    // Draw divider line
-    if (i < visibleCount - 1) {
-      tft.drawLine(0, yPos + DEVICE_ROW_HEIGHT - 1, SCREEN_WIDTH, yPos + DEVICE_ROW_HEIGHT - 1, COLOR_DIVIDER);
-    }
+  int slot = freeSlots[--freeSlotCount];
+  for (int i = 0; i < 6; i++) {
+    devices[slot].addr[i] = (uint8_t)(addrKey >> (8 * (5 - i)));
   }
+  indexDeviceSlot(slot);
 
-  // Draw scroll indicators if needed
-  if (scrollOffset > 0) {
-    tft.fillTriangle(SCREEN_WIDTH - 20, ROW_START_Y + 5,
-                     SCREEN_WIDTH - 10, ROW_START_Y + 5,
-                     SCREEN_WIDTH - 15, ROW_START_Y, COLOR_TEXT);
+  activeSlots[deviceCount] = slot;
+  slotPosition[slot] = deviceCount;
+  deviceCount++;
+  return slot;
+}
+
+// Adds slot to the hash index under its current address
+void indexDeviceSlot(int slot) {
+  uint32_t pos = hashAddress(packAddress(devices[slot].addr));
+  while (deviceHash[pos] != DEVICE_SLOT_EMPTY) {
+    pos = (pos + 1) & (DEVICE_HASH_SIZE - 1);
   }
-  if (scrollOffset + MAX_VISIBLE_DEVICES < deviceCount) {
-    int bottomY = ROW_START_Y + (MAX_VISIBLE_DEVICES * DEVICE_ROW_HEIGHT) - 10;
-    tft.fillTriangle(SCREEN_WIDTH - 20, bottomY,
-                     SCREEN_WIDTH - 10, bottomY,
-                     SCREEN_WIDTH - 15, bottomY + 5, COLOR_TEXT);
+  deviceHash[pos] = slot;
+}
+
+// Drops slot's hash entry, keyed by its current address. False if it had none.
+bool unindexDeviceSlot(int slot) {
+  // Locate the slot's hash entry
+  uint32_t hole = hashAddress(packAddress(devices[slot].addr));
+  while (deviceHash[hole] != slot) {
+    if (deviceHash[hole] == DEVICE_SLOT_EMPTY) return false;
+    hole = (hole + 1) & (DEVICE_HASH_SIZE - 1);
   }
 
-  // Show "No SD" indicator if SD card not present
-  if (!sdCardPresent) {
-    tft.setTextColor(COLOR_UNKNOWN);
-    tft.setTextSize(1);
-    tft.setTextDatum(BR_DATUM);
-    tft.drawString("No SD", SCREEN_WIDTH - 5, SCREEN_HEIGHT - 5);
+  // Backward-shift deletion: pull later entries of the probe run into the
+  // hole unless their home bucket lies cyclically in (hole, next]
+  uint32_t next = hole;
+  while (true) {
+    next = (next + 1) & (DEVICE_HASH_SIZE - 1);
+    if (deviceHash[next] == DEVICE_SLOT_EMPTY) break;
+
+    uint32_t home = hashAddress(packAddress(devices[deviceHash[next]].addr));
+    bool staysPut = (hole <= next) ? (hole < home && home <= next)
+                                   : (hole < home || home <= next);
+    if (!staysPut) {
+      deviceHash[hole] = deviceHash[next];
+      hole = next;
+    }
   }
+  deviceHash[hole] = DEVICE_SLOT_EMPTY;
+  return true;
 }
 
-void drawHeader() {
-  // Header background
-  tft.fillRect(0, 0, SCREEN_WIDTH, HEADER_HEIGHT, COLOR_HEADER_BG);
-
-  // Title (smaller font)
-  tft.setTextColor(COLOR_TEXT);
-  tft.setTextSize(1);
-  tft.setTextDatum(ML_DATUM);
-  tft.drawString("BLE SCANNER", 5, HEADER_HEIGHT / 2);
+void freeDeviceSlot(int slot) {
+  removeDeviceViews(slot);
+  recordDeviceRemoval(devices[slot]);
+  if (!unindexDeviceSlot(slot)) return;  // Not indexed
 
-  // IP address (if connected)
-  if (wifiConnected) {
-    tft.setTextColor(COLOR_KNOWN);
-    tft.drawString(WiFi.localIP().toString(), 80, HEADER_HEIGHT / 2);
-  }
+  // Swap-remove from the dense list
+  int pos = slotPosition[slot];
+  int lastSlot = activeSlots[deviceCount - 1];
+  activeSlots[pos] = lastSlot;
+  slotPosition[lastSlot] = pos;
+  deviceCount--;
 
-  // Device count
-  tft.setTextColor(COLOR_TEXT);
-  tft.setTextDatum(MC_DATUM);
-  char countStr[20];
-  sprintf(countStr, "[%d]", deviceCount);
-  tft.drawString(countStr, SCREEN_WIDTH / 2 + 40, HEADER_HEIGHT / 2);
+  freeSlots[freeSlotCount++] = slot;
+}
 
-  // Elapsed time since last scan
-  tft.setTextDatum(MR_DATUM);
-  String elapsed = formatElapsedTime(millis() - lastScanTime);
-  tft.drawString(elapsed, SCREEN_WIDTH - 5, HEADER_HEIGHT / 2);
+BLEDeviceInfo& deviceAt(int index) {
+  return devices[activeSlots[index]];
 }
 
-void drawDeviceRow(int index, int yPos) {
-  if (index < 0 || index >= deviceCount) return;
+// ============================================================================
+// Sorted Views
+// ============================================================================
 
-  BLEDeviceInfo& dev = devices[index];
+// The rssi and status views are kept sorted as the table changes instead of
+// being re-sorted on read: a new device is placed by binary search, a device
+// whose RSSI or status changed is shifted to its new position (usually a short
+// move), and a freed slot is closed up. Readers index a view in O(1).
+//
+// last_seen is the exception. Every sighting makes its device the most recent,
+// so shifting it to the front would cost up to the whole view per advert.
+// Sightings only mark the view unsorted, and the first read after that
+// re-sorts it (see sortLastSeenView()).
+
+uint8_t deviceStatusRank(const BLEDeviceInfo& dev) {
+  return dev.isKnown ? 2 : (dev.isNew ? 1 : 0);  // Unknown first
+}
 
-  // Determine status color
-  uint16_t statusColor;
-  if (dev.isKnown) {
-    statusColor = COLOR_KNOWN;
-  } else if (dev.isNew) {
-    statusColor = COLOR_NEW;
-  } else {
-    statusColor = COLOR_UNKNOWN;
+// True if a sorts strictly before b in view
+bool viewPrecedes(int view, const BLEDeviceInfo& a, const BLEDeviceInfo& b) {
+  switch (view) {
+    case VIEW_RSSI:
+      return a.rssi > b.rssi;
+    case VIEW_LAST_SEEN:
+      return (long)(a.lastSeen - b.lastSeen) > 0;  // Wrap-safe
+    case VIEW_STATUS: {
+      uint8_t rankA = deviceStatusRank(a);
+      uint8_t rankB = deviceStatusRank(b);
+      return rankA != rankB ? rankA < rankB : a.rssi > b.rssi;
+    }
+    default:
+      return false;
+  }
+}
+
+// Call once the new device's fields are set (allocDeviceSlot() leaves them stale)
+void insertDeviceViews(int slot) {
+  const BLEDeviceInfo& dev = devices[slot];
+  for (int v = 1; v < VIEW_COUNT; v++) {
+    int16_t* order = viewSlots[v - 1];
+    int16_t* position = viewPosition[v - 1];
+
+    // After any equal keys, so ties keep arrival order. An unsorted last_seen
+    // view takes it at the end; the next read puts it in place.
+    int lo = 0;
+    int hi = viewSize;
+    if (v == VIEW_LAST_SEEN && !lastSeenViewSorted) lo = hi;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (viewPrecedes(v, dev, devices[order[mid]])) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    for (int i = viewSize; i > lo; i--) {
+      order[i] = order[i - 1];
+      position[order[i]] = i;
+    }
+    order[lo] = slot;
+    position[slot] = lo;
+  }
+  viewSize++;
+  insertEvictHeap(slot);
+}
+
+void removeDeviceViews(int slot) {
+  for (int v = 1; v < VIEW_COUNT; v++) {
+    int16_t* order = viewSlots[v - 1];
+    int16_t* position = viewPosition[v - 1];
+    for (int i = position[slot]; i < viewSize - 1; i++) {
+      order[i] = order[i + 1];
+      position[order[i]] = i;
+    }
+  }
+  viewSize--;
+  removeEvictHeap(slot);
+}
+
+// Re-sorts one device after its RSSI, lastSeen, isNew or isKnown changed.
+// Everything else in each view is still ordered, so one insertion step fixes
+// it; the eviction heap needs one sift. last_seen is only checked against its
+// neighbours and marked unsorted if the device is now out of place.
+void updateDeviceViews(BLEDeviceInfo& dev) {
+  int slot = &dev - devices;
+  for (int v = 1; v < VIEW_COUNT; v++) {
+    int16_t* order = viewSlots[v - 1];
+    int16_t* position = viewPosition[v - 1];
+    int p = position[slot];
+    if (v == VIEW_LAST_SEEN) {
+      if (lastSeenViewSorted &&
+          ((p > 0 && viewPrecedes(v, dev, devices[order[p - 1]])) ||
+           (p < viewSize - 1 && viewPrecedes(v, devices[order[p + 1]], dev)))) {
+        lastSeenViewSorted = false;
+      }
+      continue;
+    }
+    while (p > 0 && viewPrecedes(v, dev, devices[order[p - 1]])) {
+      order[p] = order[p - 1];
+      position[order[p]] = p;
+      p--;
+    }
+    while (p < viewSize - 1 && viewPrecedes(v, devices[order[p + 1]], dev)) {
+      order[p] = order[p + 1];
+      position[order[p]] = p;
+      p++;
+    }
+    order[p] = slot;
+    position[slot] = p;
+  }
+  siftEvictHeap(evictPosition[slot]);
+}
+
+// Insertion sort from the previous order: stable, so ties keep arrival order,
+// and a pass after a few sightings moves only those devices
+void sortLastSeenView() {
+  int16_t* order = viewSlots[VIEW_LAST_SEEN - 1];
+  int16_t* position = viewPosition[VIEW_LAST_SEEN - 1];
+  for (int i = 1; i < viewSize; i++) {
+    int slot = order[i];
+    int p = i;
+    while (p > 0 && viewPrecedes(VIEW_LAST_SEEN, devices[slot], devices[order[p - 1]])) {
+      order[p] = order[p - 1];
+      position[order[p]] = p;
+      p--;
+    }
+    order[p] = slot;
+    position[slot] = p;
+  }
+  lastSeenViewSorted = true;
+}
+
+// The index-th device (0..deviceCount-1) in view order. May re-sort last_seen,
+// so callers hold deviceMutex as for any table access.
+BLEDeviceInfo& deviceInView(DeviceView view, int index) {
+  if (view == VIEW_TABLE) return deviceAt(index);
+  if (view == VIEW_LAST_SEEN && !lastSeenViewSorted) sortLastSeenView();
+  return devices[viewSlots[view - 1][index]];
+}
+
+DeviceView parseDeviceView(const String& name, DeviceView fallback) {
+  for (int v = 0; v < VIEW_COUNT; v++) {
+    if (name == DEVICE_VIEW_NAMES[v]) return (DeviceView)v;
+  }
+  return fallback;
+}
+
+// ============================================================================
+// Eviction
+// ============================================================================
+
+// True if a should be evicted before b under evictionPolicy
+bool evictsBefore(const BLEDeviceInfo& a, const BLEDeviceInfo& b) {
+  switch (evictionPolicy) {
+    case EVICT_RSSI:
+      return a.rssi < b.rssi;
+    case EVICT_PRIORITY:
+      // Known go first. Of the unknown, the new ones (just alerted) stay longest.
+      if (a.isKnown != b.isKnown) return a.isKnown;
+      if (!a.isKnown && a.isNew != b.isNew) return b.isNew;
+      return (long)(a.lastSeen - b.lastSeen) < 0;
+    case EVICT_WEIGHTED:
+      // A device heard now at -80 dBm ranks with one heard 20 s ago at -40
+      return (long)((a.lastSeen + a.rssi * EVICT_WEIGHT_MS_PER_DB) -
+                    (b.lastSeen + b.rssi * EVICT_WEIGHT_MS_PER_DB)) < 0;
+    case EVICT_LRU:
+    default:
+      return (long)(a.lastSeen - b.lastSeen) < 0;  // Wrap-safe
+  }
+}
+
+void placeEvictHeap(int pos, int slot) {
+  evictHeap[pos] = slot;
+  evictPosition[slot] = pos;
+}
+
+// Moves the entry at pos up or down until the heap is ordered again
+void siftEvictHeap(int pos) {
+  int slot = evictHeap[pos];
+  const BLEDeviceInfo& dev = devices[slot];
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (!evictsBefore(dev, devices[evictHeap[parent]])) break;
+    placeEvictHeap(pos, evictHeap[parent]);
+    pos = parent;
+  }
+  for (;;) {
+    int child = 2 * pos + 1;
+    if (child >= evictHeapSize) break;
+    if (child + 1 < evictHeapSize && evictsBefore(devices[evictHeap[child + 1]], devices[evictHeap[child]])) {
+      child++;
+    }
+    if (!evictsBefore(devices[evictHeap[child]], dev)) break;
+    placeEvictHeap(pos, evictHeap[child]);
+    pos = child;
+  }
+  placeEvictHeap(pos, slot);
+}
+
+void insertEvictHeap(int slot) {
+  placeEvictHeap(evictHeapSize++, slot);
+  siftEvictHeap(evictHeapSize - 1);
+}
+
+void removeEvictHeap(int slot) {
+  int pos = evictPosition[slot];
+  int last = evictHeap[--evictHeapSize];
+  if (pos == evictHeapSize) return;
+  placeEvictHeap(pos, last);
+  siftEvictHeap(pos);
+}
+
+// Reorders the whole heap after evictionPolicy changed
+void rebuildEvictHeap() {
+  evictHeapSize = 0;
+  for (int i = 0; i < deviceCount; i++) {
+    insertEvictHeap(activeSlots[i]);
+  }
+}
+
+// Makes room in the full table: frees the device evictionPolicy puts first,
+// or the one after it if that is sparedSlot (DEVICE_SLOT_EMPTY spares none)
+void evictDevice(int sparedSlot) {
+  int slot = evictHeap[0];
+  if (slot == sparedSlot) {
+    slot = evictHeap[1];
+    if (evictHeapSize > 2 && evictsBefore(devices[evictHeap[2]], devices[slot])) slot = evictHeap[2];
+  }
+  BLEDeviceInfo& victim = devices[slot];
+  devicesEvicted++;
+  if (!victim.isKnown) {
+    evictedUnknown++;
+    if (victim.isNew) evictedNewUnknown++;
+  }
+  lastEvictionMs = millis();
+  closeRssiBucket(victim);
+  freeDeviceSlot(slot);
+}
+
+int parseEvictionPolicy(const char* name) {
+  for (int e = 0; e < EVICT_POLICY_COUNT; e++) {
+    if (strcmp(name, EVICTION_POLICY_NAMES[e]) == 0) return e;
+  }
+  return -1;
+}
+
+// ============================================================================
+// Address Rotation
+// ============================================================================
+
+// Phones, earbuds and tags advertise from a private address they replace
+// every few minutes. Without correlation each new address is a new device:
+// another sighting logged and uploaded, another alert, and the old address
+// holding a slot until DEVICE_TIMEOUT. A new private address is instead
+// taken as the device it rotated from when exactly one tracked private
+// device sends the same advert fingerprint, was heard within
+// ROTATION_HANDOFF_MS and at a similar RSSI; the device record moves over
+// to the new address and keeps its history, status and alert.
+
+// Random addresses with top bits other than 11 (resolvable or non-resolvable
+// private); public and random static addresses are kept for life
+bool isPrivateAddress(const uint8_t* addr, uint8_t addrType) {
+  return addrType != BLE_ADDR_TYPE_PUBLIC && (addr[0] & 0xC0) != 0xC0;
+}
+
+// The slot of the device that private address addr (not in the table) most
+// likely rotated from, or DEVICE_SLOT_EMPTY. Two or more candidates are as
+// likely as each other, so none is followed. A device that was followed
+// from addr is returned regardless: addr is still advertising, so it and
+// the device's current address are two devices (see moveDeviceAddress()).
+// Only runs for addresses the index missed; a linear pass is fine there.
+int matchRotatedDevice(const uint8_t* addr, uint32_t fingerprint, int rssi, unsigned long now) {
+  if (ROTATION_HANDOFF_MS == 0) return DEVICE_SLOT_EMPTY;
+  int match = DEVICE_SLOT_EMPTY;
+  int candidates = 0;
+  for (int i = 0; i < deviceCount; i++) {
+    const BLEDeviceInfo& dev = deviceAt(i);
+    if (dev.fingerprint != fingerprint) continue;
+    if (dev.rotations > 0 && memcmp(dev.prevAddr, addr, sizeof(dev.prevAddr)) == 0) {
+      return activeSlots[i];
+    }
+    if (now - dev.lastSeen > ROTATION_HANDOFF_MS || abs(dev.rssi - rssi) > ROTATION_RSSI_DELTA) continue;
+    match = activeSlots[i];
+    candidates++;
+  }
+  if (candidates > 1) {
+    rotationsAmbiguous++;
+    return DEVICE_SLOT_EMPTY;
+  }
+  return match;
+}
+
+// Re-keys the device in slot to addr: the private address it rotated to, or
+// (handBack) the one it was followed from, which turned out to be another
+// device. The address it leaves is reported as a removal to /status?since
+// and the live feed, and its open RSSI bucket is logged under it.
+void moveDeviceAddress(int slot, const uint8_t* addr, bool handBack) {
+  BLEDeviceInfo& dev = devices[slot];
+  char from[18];
+  char to[18];
+  formatMac(dev.addr, from);
+  formatMac(addr, to);
+
+  closeRssiBucket(dev);
+  recordDeviceRemoval(dev);
+  unindexDeviceSlot(slot);
+  if (handBack) {
+    memset(dev.prevAddr, 0, sizeof(dev.prevAddr));
+    dev.rotations--;
+    rotationSplits++;
+  } else {
+    memcpy(dev.prevAddr, dev.addr, sizeof(dev.prevAddr));
+    dev.rotations++;
+    addressRotations++;
+  }
+  memcpy(dev.addr, addr, sizeof(dev.addr));
+  indexDeviceSlot(slot);
+  dev.isKnown = dev.isKnown || isDeviceKnown(addr, dev.publicAddr);  // Known under any of its addresses
+
+  Serial.printf("%s: %s (%s -> %s), %u address change(s)\n", handBack ? "SPLIT" : "ROTATED",
+                deviceDisplayName(dev), from, to, dev.rotations);
+}
+
+// ============================================================================
+// Change Tracking
+// ============================================================================
+
+// Gives dev a new changeSeq if anything /status?since reports has moved: its
+// status, its RSSI by CHANGE_RSSI_DELTA or more, or (fieldsChanged) its name,
+// type or manufacturer. A sighting that only refreshes lastSeen is not a change.
+void noteDeviceChange(BLEDeviceInfo& dev, bool fieldsChanged) {
+  uint8_t status = deviceLogStatus(dev);
+  if (!fieldsChanged && status == dev.reportedStatus &&
+      abs(dev.rssi - dev.reportedRssi) < CHANGE_RSSI_DELTA) {
+    return;
+  }
+  dev.changeSeq = ++deviceChangeSeq;
+  dev.reportedRssi = dev.rssi;
+  dev.reportedStatus = status;
+}
+
+void recordDeviceRemoval(const BLEDeviceInfo& dev) {
+  DeviceRemoval& entry = removedLog[removedCount % REMOVED_LOG_SIZE];
+  if (removedCount >= REMOVED_LOG_SIZE) removedHorizon = entry.seq;
+  memcpy(entry.addr, dev.addr, sizeof(entry.addr));
+  entry.seq = ++deviceChangeSeq;
+  removedCount++;
+  queueDeviceEvent(LIVE_EXPIRED, dev);
+}
+
+// fingerprint is the advert's fingerprint for a private address, else 0
+void updateDeviceList(const uint8_t* addr, uint8_t addrType, const char* name, int rssi, DeviceType deviceType, Manufacturer manufacturer, uint32_t payloadHash, uint32_t fingerprint) {
+  unsigned long currentTime = millis();
+
+  // Check if device already exists, possibly under the address it rotated from
+  int slot = findDeviceSlot(packAddress(addr));
+  bool moved = false;
+  bool handedBack = false;
+  uint8_t otherAddr[6];
+  int otherRssi = 0;
+  if (slot == DEVICE_SLOT_EMPTY && fingerprint != 0) {
+    slot = matchRotatedDevice(addr, fingerprint, rssi, currentTime);
+    if (slot != DEVICE_SLOT_EMPTY) {
+      BLEDeviceInfo& dev = devices[slot];
+      handedBack = dev.rotations > 0 && memcmp(dev.prevAddr, addr, sizeof(dev.prevAddr)) == 0;
+      memcpy(otherAddr, dev.addr, sizeof(otherAddr));
+      otherRssi = dev.rssi;
+      moveDeviceAddress(slot, addr, handedBack);
+      moved = true;
+    }
+  }
+
+  if (slot != DEVICE_SLOT_EMPTY) {
+    BLEDeviceInfo& dev = devices[slot];
+    bool unresolved = deviceUnresolved(dev);
+
+    // Update existing device
+    dev.rssi = rssi;
+    dev.lastSeen = currentTime;
+    dev.payloadHash = payloadHash;
+    if (fingerprint != 0) dev.fingerprint = fingerprint;
+    bool fieldsChanged = moved;
+    if (name[0] != '\0' && dev.name[0] == '\0') {
+      strlcpy(dev.name, name, sizeof(dev.name));  // Update name if we got a better one
+      fieldsChanged = true;
+    }
+    if (deviceType != TYPE_UNKNOWN && dev.deviceType == TYPE_UNKNOWN) {
+      dev.deviceType = deviceType;
+      fieldsChanged = true;
+    }
+    if (manufacturer != MFR_UNKNOWN && dev.manufacturer == MFR_UNKNOWN) {
+      dev.manufacturer = manufacturer;
+      fieldsChanged = true;
+    }
+    if (unresolved && !deviceUnresolved(dev)) noteDeviceResolved(dev, currentTime);
+
+    // Check if still "new"
+    dev.isNew = (currentTime - dev.firstSeen) < NEW_DEVICE_THRESHOLD;
+    updateDeviceViews(dev);
+    noteDeviceChange(dev, fieldsChanged);
+    recordRssiSample(dev, rssi, currentTime);
+    if (moved) {
+      dev.addedSeq = dev.changeSeq;  // Listed as added under its new address
+      queueDeviceEvent(LIVE_DEVICE, dev);
+    }
+
+    // The address it had been followed to is a device of its own, seen with
+    // the same fingerprint (so the same class) and not announced until now.
+    // Room is made here so the eviction spares the device just handed back,
+    // and the name is copied out of the table before addDevice() writes to it.
+    if (handedBack) {
+      if (deviceCount >= MAX_TRACKED_DEVICES) evictDevice(slot);
+      char otherName[sizeof(dev.name)];
+      strlcpy(otherName, dev.name, sizeof(otherName));
+      addDevice(otherAddr, addrType, otherName, otherRssi, (DeviceType)dev.deviceType,
+                (Manufacturer)dev.manufacturer, 0, dev.fingerprint);
+    }
+    return;
+  }
+
+  addDevice(addr, addrType, name, rssi, deviceType, manufacturer, payloadHash, fingerprint);
+}
+
+// A device the table doesn't hold: makes room if it's full, then adds and
+// announces it (SD log, uplink, live feed, alerts)
+void addDevice(const uint8_t* addr, uint8_t addrType, const char* name, int rssi, DeviceType deviceType, Manufacturer manufacturer, uint32_t payloadHash, uint32_t fingerprint) {
+  unsigned long currentTime = millis();
+  if (deviceCount >= MAX_TRACKED_DEVICES) {
+    evictDevice(DEVICE_SLOT_EMPTY);
+  }
+
+  char mac[18];
+  formatMac(addr, mac);
+
+  // Add new device
+  int slot = allocDeviceSlot(packAddress(addr));
+  BLEDeviceInfo& newDevice = devices[slot];
+  strlcpy(newDevice.name, name, sizeof(newDevice.name));
+  newDevice.rssi = rssi;
+  newDevice.deviceType = deviceType;
+  newDevice.manufacturer = manufacturer;
+  newDevice.payloadHash = payloadHash;
+  newDevice.fingerprint = fingerprint;
+  newDevice.rotations = 0;
+  newDevice.publicAddr = addrType == BLE_ADDR_TYPE_PUBLIC;
+  newDevice.isKnown = isDeviceKnown(addr, newDevice.publicAddr);
+  newDevice.isNew = true;
+  newDevice.firstSeen = currentTime;
+  newDevice.lastSeen = currentTime;
+  newDevice.alertSent = false;
+  newDevice.activeBursts = 0;
+  newDevice.rssiSamples = 0;
+  if (deviceUnresolved(newDevice)) {
+    unresolvedCount++;
+    activeCandidates++;  // An adaptive burst can start before the next recount
+  }
+  insertDeviceViews(slot);
+  noteDeviceChange(newDevice, true);
+  newDevice.addedSeq = newDevice.changeSeq;
+  recordRssiSample(newDevice, rssi, currentTime);
+
+  // Log to SD card and the server
+  queueDeviceLog(newDevice);
+  queueUplinkSighting(newDevice);
+  queueDeviceEvent(LIVE_DEVICE, newDevice);
+
+  // Alert for unknown devices
+  if (!newDevice.isKnown && !newDevice.alertSent) {
+    Serial.printf("ALERT: Unknown device %s (%s) RSSI: %d\n",
+                  deviceDisplayName(newDevice), mac, rssi);
+    alertUnknownDevice();
+    queueWebhookAlert(newDevice);
+    queueDeviceEvent(LIVE_ALERT, newDevice);
+    newDevice.alertSent = true;
+  } else if (newDevice.isNew) {
+    Serial.printf("NEW: %s (%s) RSSI: %d\n", deviceDisplayName(newDevice), mac, rssi);
+    alertNewDevice();
+  }
+}
+
+void pruneStaleDevices() {
+  unsigned long currentTime = millis();
+  int i = 0;
+
+  while (i < deviceCount) {
+    unsigned long age = currentTime - deviceAt(i).lastSeen;
+    if (age > DEVICE_TIMEOUT) {
+      closeRssiBucket(deviceAt(i));
+      freeDeviceSlot(activeSlots[i]);
+      // Don't increment i - the last device was swapped into this position
+    } else {
+      i++;
+    }
+  }
+}
+
+// ============================================================================
+// Device Type Detection
+// ============================================================================
+
+// Classification is table driven: company IDs and 16-bit service UUIDs are
+// looked up by binary search in constexpr tables sorted by key, and name
+// patterns are matched in one pass with an Aho-Corasick automaton built at
+// compile time. Adding rows grows the tables in flash, not the per-advert cost.
+
+struct CompanyEntry {
+  uint16_t key;           // Bluetooth SIG company identifier
+  DeviceType type;        // Type implied by the company, TYPE_UNKNOWN to fall through
+  Manufacturer mfr;
+};
+
+// Must stay sorted by company identifier (checked below)
+constexpr CompanyEntry COMPANY_TABLE[] = {
+  {0x0006, TYPE_MICROSOFT, MFR_MICROSOFT},
+  {0x004C, TYPE_APPLE,     MFR_APPLE},
+  {0x004F, TYPE_UNKNOWN,   MFR_SONY},
+  {0x0059, TYPE_UNKNOWN,   MFR_NORDIC},
+  {0x0075, TYPE_SAMSUNG,   MFR_SAMSUNG},
+  {0x0087, TYPE_UNKNOWN,   MFR_GARMIN},
+  {0x00E0, TYPE_GOOGLE,    MFR_GOOGLE},
+  {0x0157, TYPE_UNKNOWN,   MFR_HUAWEI},
+  {0x0310, TYPE_UNKNOWN,   MFR_XIAOMI},
+  {0x0477, TYPE_TILE,      MFR_TILE},
+};
+
+struct KeyedType {
+  uint16_t key;
+  DeviceType type;
+};
+
+// Apple Continuity message type (first byte after the company ID)
+constexpr KeyedType APPLE_SUBTYPE_TABLE[] = {
+  {0x02, TYPE_IBEACON},
+  {0x05, TYPE_AIRDROP},
+  {0x07, TYPE_AIRPODS},
+  {0x09, TYPE_AIRPLAY},
+  {0x10, TYPE_AIRTAG},
+};
+
+// Standard and member 16-bit service UUIDs
+constexpr KeyedType SERVICE_UUID_TABLE[] = {
+  {0x1803, TYPE_BEACON},      // Link Loss
+  {0x180D, TYPE_WEARABLE},    // Heart Rate
+  {0x180F, TYPE_BLE_DEVICE},  // Battery
+  {0x1812, TYPE_HID},         // Human Interface Device
+  {0xFE9F, TYPE_PHONE},       // Google Nearby
+};
+
+struct NamePattern {
+  const char* text;       // Lowercase letters and spaces only
+  DeviceType type;
+};
+
+// Earlier patterns win when several occur in the same name
+constexpr NamePattern NAME_PATTERNS[] = {
+  {"airpods",     TYPE_AUDIO},
+  {"galaxy buds", TYPE_AUDIO},
+  {"beats",       TYPE_AUDIO},
+  {"jbl",         TYPE_AUDIO},
+  {"bose",        TYPE_AUDIO},
+  {"fitbit",      TYPE_WEARABLE},
+  {"watch",       TYPE_WEARABLE},
+  {"band",        TYPE_WEARABLE},
+  {"beacon",      TYPE_BEACON},
+  {"tile",        TYPE_TRACKER},
+  {"airtag",      TYPE_TRACKER},
+  {"iphone",      TYPE_PHONE},
+  {"galaxy",      TYPE_PHONE},
+  {"pixel",       TYPE_PHONE},
+};
+
+template <typename T, size_t N>
+constexpr bool isSortedByKey(const T (&table)[N]) {
+  for (size_t i = 1; i < N; i++) {
+    if (!(table[i - 1].key < table[i].key)) return false;
+  }
+  return true;
+}
+
+static_assert(isSortedByKey(COMPANY_TABLE), "COMPANY_TABLE must be sorted");
+static_assert(isSortedByKey(APPLE_SUBTYPE_TABLE), "APPLE_SUBTYPE_TABLE must be sorted");
+static_assert(isSortedByKey(SERVICE_UUID_TABLE), "SERVICE_UUID_TABLE must be sorted");
+
+// Name automaton alphabet: 0 = any other byte, 1-26 = a-z (either case), 27 = space
+constexpr int NAME_ALPHABET = 28;
+constexpr uint8_t NAME_NO_MATCH = 0xFF;
+
+constexpr uint8_t nameSymbol(char c) {
+  return (c >= 'a' && c <= 'z') ? (uint8_t)(c - 'a' + 1)
+       : (c >= 'A' && c <= 'Z') ? (uint8_t)(c - 'A' + 1)
+       : (c == ' ') ? (uint8_t)27 : (uint8_t)0;
+}
+
+constexpr size_t namePatternChars() {
+  size_t total = 0;
+  for (const NamePattern& p : NAME_PATTERNS) {
+    for (const char* c = p.text; *c; c++) total++;
+  }
+  return total;
+}
+
+constexpr size_t NAME_PATTERN_COUNT = sizeof(NAME_PATTERNS) / sizeof(NAME_PATTERNS[0]);
+constexpr size_t NAME_MAX_STATES = namePatternChars() + 1;
+static_assert(NAME_MAX_STATES <= 256, "Name automaton state must fit in uint8_t");
+static_assert(NAME_PATTERN_COUNT < NAME_NO_MATCH, "Too many name patterns");
+
+struct NameAutomaton {
+  uint8_t next[NAME_MAX_STATES][NAME_ALPHABET];  // Full DFA transition table
+  uint8_t match[NAME_MAX_STATES];                // Best pattern ending here, or NAME_NO_MATCH
+};
+
+constexpr NameAutomaton buildNameAutomaton() {
+  NameAutomaton a = {};
+  int16_t trie[NAME_MAX_STATES][NAME_ALPHABET] = {};
+  uint8_t fail[NAME_MAX_STATES] = {};
+  uint8_t queue[NAME_MAX_STATES] = {};
+  size_t states = 1;
+
+  for (size_t s = 0; s < NAME_MAX_STATES; s++) {
+    a.match[s] = NAME_NO_MATCH;
+    for (int c = 0; c < NAME_ALPHABET; c++) trie[s][c] = -1;
+  }
+
+  // Trie of all patterns, recording the highest-priority pattern per node
+  for (size_t p = 0; p < NAME_PATTERN_COUNT; p++) {
+    size_t s = 0;
+    for (const char* c = NAME_PATTERNS[p].text; *c; c++) {
+      uint8_t sym = nameSymbol(*c);
+      if (trie[s][sym] < 0) trie[s][sym] = (int16_t)states++;
+      s = (size_t)trie[s][sym];
+    }
+    if (p < a.match[s]) a.match[s] = (uint8_t)p;
+  }
+
+  // Breadth-first pass filling failure links and the dense transition table
+  size_t head = 0, tail = 0;
+  for (int c = 0; c < NAME_ALPHABET; c++) {
+    if (trie[0][c] >= 0) {
+      a.next[0][c] = (uint8_t)trie[0][c];
+      fail[trie[0][c]] = 0;
+      queue[tail++] = (uint8_t)trie[0][c];
+    } else {
+      a.next[0][c] = 0;
+    }
+  }
+  while (head < tail) {
+    uint8_t s = queue[head++];
+    if (a.match[fail[s]] < a.match[s]) a.match[s] = a.match[fail[s]];
+    for (int c = 0; c < NAME_ALPHABET; c++) {
+      if (trie[s][c] >= 0) {
+        uint8_t t = (uint8_t)trie[s][c];
+        fail[t] = a.next[fail[s]][c];
+        a.next[s][c] = t;
+        queue[tail++] = t;
+      } else {
+        a.next[s][c] = a.next[fail[s]][c];
+      }
+    }
+  }
+  return a;
+}
+
+constexpr NameAutomaton NAME_AUTOMATON = buildNameAutomaton();
+
+// Binary search over a constexpr table sorted by .key
+template <typename T, size_t N>
+const T* findByKey(const T (&table)[N], uint16_t key) {
+  size_t lo = 0, hi = N;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (table[mid].key == key) return &table[mid];
+    if (table[mid].key < key) lo = mid + 1;
+    else hi = mid;
+  }
+  return nullptr;
+}
+
+// Single scan of the name; returns the type of the earliest-listed pattern found
+DeviceType matchNamePatterns(const char* name) {
+  uint8_t state = 0;
+  uint8_t best = NAME_NO_MATCH;
+  for (const char* c = name; *c; c++) {
+    state = NAME_AUTOMATON.next[state][nameSymbol(*c)];
+    if (NAME_AUTOMATON.match[state] < best) {
+      best = NAME_AUTOMATON.match[state];
+      if (best == 0) break;
+    }
+  }
+  return best == NAME_NO_MATCH ? TYPE_UNKNOWN : NAME_PATTERNS[best].type;
+}
+
+DeviceClass classifyAdvert(const AdvertRecord& rec) {
+  DeviceClass result = {TYPE_UNKNOWN, MFR_UNKNOWN};
+
+  // Manufacturer data: company ID, refined by Apple Continuity subtype
+  if (rec.flags & ADV_HAS_MFG_ID) {
+    const CompanyEntry* company = findByKey(COMPANY_TABLE, rec.mfgId);
+    if (company) {
+      result.mfr = company->mfr;
+      result.type = company->type;
+      if (company->mfr == MFR_APPLE && (rec.flags & ADV_HAS_MFG_TYPE)) {
+        const KeyedType* sub = findByKey(APPLE_SUBTYPE_TABLE, rec.mfgType);
+        if (sub) result.type = sub->type;
+      }
+      if (result.type != TYPE_UNKNOWN) return result;
+    }
+  }
+
+  // Service UUIDs
+  if (rec.flags & ADV_HAS_UUID16) {
+    const KeyedType* service = findByKey(SERVICE_UUID_TABLE, rec.serviceUuid16);
+    if (service) {
+      result.type = service->type;
+      return result;
+    }
+  }
+
+  // Device name patterns
+  if (rec.flags & ADV_HAS_NAME) {
+    result.type = matchNamePatterns(rec.name);
+  }
+
+  return result;
+}
+
+const char* deviceTypeName(uint8_t type) {
+  return type < TYPE_COUNT ? DEVICE_TYPE_NAMES[type] : DEVICE_TYPE_NAMES[TYPE_UNKNOWN];
+}
+
+const char* manufacturerName(uint8_t mfr) {
+  return mfr < MFR_COUNT ? MANUFACTURER_NAMES[mfr] : MANUFACTURER_NAMES[MFR_UNKNOWN];
+}
+
+const char* deviceDisplayName(const BLEDeviceInfo& dev) {
+  return dev.name[0] != '\0' ? dev.name : "Unknown";
+}
+
+// Writes "AA:BB:CC:DD:EE:FF" into out (at least 18 bytes)
+void formatMac(const uint8_t* addr, char* out) {
+  snprintf(out, 18, "%02X:%02X:%02X:%02X:%02X:%02X",
+           addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
+}
+
+// ============================================================================
+// Display Functions
+// ============================================================================
+
+// Frames are diffed against shownView, the retained model of what is on the
+// panel, and only widgets whose content changed are repainted. Text widgets
+// are cleared with a fillRect first, the same way updateElapsedTime() redraws
+// the header clock. invalidateDisplay() forces the next frame to repaint all.
+void invalidateDisplay() {
+  shownView.valid = false;
+}
+
+void buildRowView(const BLEDeviceInfo& dev, RowView& view) {
+  view.occupied = true;
+
+  // Determine status color
+  if (dev.isKnown) {
+    view.statusColor = COLOR_KNOWN;
+  } else if (dev.isNew) {
+    view.statusColor = COLOR_NEW;
+  } else {
+    view.statusColor = COLOR_UNKNOWN;
   }
 
-  // Status dot
-  tft.fillCircle(15, yPos + DEVICE_ROW_HEIGHT / 2, 8, statusColor);
-
   // Device name (truncated to 14 chars)
-  tft.setTextColor(COLOR_TEXT);
-  tft.setTextSize(2);
-  tft.setTextDatum(ML_DATUM);
-  String displayName = dev.name.substring(0, 14);
-  if (dev.name.length() > 14) displayName += "..";
-  tft.drawString(displayName, 30, yPos + 15);
+  const char* name = deviceDisplayName(dev);
+  strlcpy(view.name, name, 15);
+  if (strlen(name) > 14) strcat(view.name, "..");
 
   // Device type and manufacturer
-  tft.setTextSize(1);
-  tft.setTextColor(COLOR_FADING);
-  String subInfo = dev.deviceType;
-  if (dev.manufacturer != "Unknown") {
-    subInfo += " | " + dev.manufacturer;
+  if (dev.manufacturer != MFR_UNKNOWN) {
+    snprintf(view.subInfo, sizeof(view.subInfo), "%s | %s", deviceTypeName(dev.deviceType), manufacturerName(dev.manufacturer));
+  } else {
+    snprintf(view.subInfo, sizeof(view.subInfo), "%s", deviceTypeName(dev.deviceType));
   }
-  tft.drawString(subInfo.substring(0, 25), 30, yPos + 35);
-
-  // RSSI value
-  tft.setTextColor(COLOR_TEXT);
-  tft.setTextSize(1);
-  tft.setTextDatum(MR_DATUM);
-  char rssiStr[10];
-  sprintf(rssiStr, "%ddBm", dev.rssi);
-  tft.drawString(rssiStr, 280, yPos + DEVICE_ROW_HEIGHT / 2);
 
-  // RSSI bars
-  drawRSSIBars(290, yPos + 12, dev.rssi);
+  sprintf(view.rssiText, "%ddBm", dev.rssi);
+  view.bars = rssiToBars(dev.rssi);
 
   // MAC address (last 8 chars)
-  tft.setTextColor(COLOR_FADING);
-  tft.setTextSize(1);
-  tft.setTextDatum(MR_DATUM);
-  String shortMac = dev.mac.substring(dev.mac.length() - 8);
-  tft.drawString(shortMac, SCREEN_WIDTH - 10, yPos + DEVICE_ROW_HEIGHT / 2);
+  char mac[18];
+  formatMac(dev.addr, mac);
+  strlcpy(view.macSuffix, mac + 9, sizeof(view.macSuffix));
 }
 
-void drawRSSIBars(int x, int y, int rssi) {
-  int bars = rssiToBars(rssi);
-  int barWidth = 6;
-  int barSpacing = 2;
-  int maxHeight = 20;
+// Strip buffers for composited list rendering. Fewer buffers than configured
+// (down to none) are used if the heap can't spare them.
+void initDisplaySprites() {
+  stripUseDma = tft.initDMA();
+  for (int i = 0; i < DISPLAY_STRIP_BUFFERS; i++) {
+    TFT_eSprite* sprite = new TFT_eSprite(&tft);
+    sprite->setColorDepth(16);  // DMA pushes 16-bit pixels straight from the buffer
+    if (!sprite->createSprite(SCREEN_WIDTH, DISPLAY_STRIP_HEIGHT)) {
+      delete sprite;
+      break;
+    }
+    stripSprites[stripBufferCount++] = sprite;
+  }
+  Serial.printf("Display: %d strip buffer(s) of %d bytes, DMA %s\n", stripBufferCount,
+                SCREEN_WIDTH * DISPLAY_STRIP_HEIGHT * 2, stripUseDma ? "on" : "off");
+}
 
-  for (int i = 0; i < 10; i++) {
-    int barHeight = (i + 1) * 2;
-    int barX = x + (i * (barWidth + barSpacing));
-    int barY = y + (maxHeight - barHeight);
+void drawDisplay() {
+  unsigned long frameStart = micros();
+
+  // Ease the list toward the row scrollOffset selects (a jump without sprites)
+  int targetY = scrollOffset * DEVICE_ROW_HEIGHT;
+  if (stripBufferCount == 0 || !shownView.valid) {
+    scrollY = targetY;
+  } else if (scrollY < targetY) {
+    scrollY = min(scrollY + SCROLL_STEP_PX, targetY);
+  } else if (scrollY > targetY) {
+    scrollY = max(scrollY - SCROLL_STEP_PX, targetY);
+  }
 
-    uint16_t barColor;
-    if (i < bars) {
-      if (bars >= 7) barColor = COLOR_RSSI_HIGH;
-      else if (bars >= 4) barColor = COLOR_RSSI_MED;
-      else barColor = COLOR_RSSI_LOW;
-    } else {
-      barColor = COLOR_DIVIDER;
+  // Copy the visible rows out so the table isn't held during SPI transfers
+  DisplayView next = {};
+  next.valid = true;
+  next.scrollY = scrollY;
+  {
+    ScopedLock lock(deviceMutex);
+    next.deviceCount = deviceCount;
+    int firstRow = scrollY / DEVICE_ROW_HEIGHT;
+    int rowCount = min(deviceCount - firstRow, MAX_VISIBLE_DEVICES + 1);
+    for (int i = 0; i < rowCount; i++) {
+      buildRowView(deviceInView(displayView, firstRow + i), next.rows[i]);
     }
+  }
+  next.scrollUp = scrollOffset > 0;
+  next.scrollDown = scrollOffset + MAX_VISIBLE_DEVICES < next.deviceCount;
+  for (int i = 0; i < MAX_VISIBLE_DEVICES - 1; i++) {
+    next.divider[i] = next.rows[i].occupied && next.rows[i + 1].occupied;
+  }
+
+  bool full = !shownView.valid;
+  int widgets = 0;
+  if (full) {
+    tft.fillScreen(COLOR_BG);
+    drawHeader();
+    widgets++;
+  } else if (next.deviceCount != shownView.deviceCount) {
+    drawDeviceCount(next.deviceCount);
+    widgets++;
+  }
+
+  widgets += stripBufferCount > 0 ? drawListComposited(next, full) : drawListDirect(next, full);
+
+  // Scroll-up arrow sits between the header and the list
+  if (full ? next.scrollUp : next.scrollUp != shownView.scrollUp) {
+    tft.fillTriangle(SCREEN_WIDTH - 20, ROW_START_Y + 5,
+                     SCREEN_WIDTH - 10, ROW_START_Y + 5,
+                     SCREEN_WIDTH - 15, ROW_START_Y, next.scrollUp ? COLOR_TEXT : COLOR_BG);
+    widgets++;
+  }
+
+  shownView = next;
+
+  uint32_t frameUs = micros() - frameStart;
+  displayFrames++;
+  displayFrameLastUs = frameUs;
+  if (frameUs > displayFrameMaxUs) displayFrameMaxUs = frameUs;
+  noteMetricMax(metricsWindow.frameMaxUs, frameUs);
+  displayFrameTotalUs += frameUs;
+  displayWidgetsLast = widgets;
+  if (full) {
+    displayFullFrames++;
+    displayFullFrameUs = frameUs;
+  }
+}
+
+// Widget-level repaint straight to the panel, used when no strip buffers exist
+int drawListDirect(const DisplayView& next, bool full) {
+  int widgets = 0;
+
+  // Draw visible devices
+  bool lastRowCleared = false;
+  for (int i = 0; i < MAX_VISIBLE_DEVICES; i++) {
+    int yPos = ROW_START_Y + (i * DEVICE_ROW_HEIGHT);
+    const RowView& row = next.rows[i];
+    const RowView* shown = (!full && shownView.rows[i].occupied) ? &shownView.rows[i] : nullptr;
+
+    if (!row.occupied) {
+      if (shown) {
+        tft.fillRect(0, yPos, SCREEN_WIDTH, DEVICE_ROW_HEIGHT, COLOR_BG);
+        widgets++;
+        lastRowCleared |= (i == MAX_VISIBLE_DEVICES - 1);
+      }
+      continue;
+    }
+    widgets += drawDeviceRow(tft, row, shown, yPos);
+  }
+
+  // Divider lines between occupied rows
+  for (int i = 0; i < MAX_VISIBLE_DEVICES - 1; i++) {
+    if (full ? !next.divider[i] : next.divider[i] == shownView.divider[i]) continue;
+    int lineY = ROW_START_Y + (i + 1) * DEVICE_ROW_HEIGHT - 1;
+    tft.drawLine(0, lineY, SCREEN_WIDTH, lineY, next.divider[i] ? COLOR_DIVIDER : COLOR_BG);
+    widgets++;
+  }
+
+  // The down arrow sits inside the last row, so clearing that row erases it
+  if ((full || lastRowCleared) ? next.scrollDown : next.scrollDown != shownView.scrollDown) {
+    int bottomY = ROW_START_Y + LIST_HEIGHT - 10;
+    tft.fillTriangle(SCREEN_WIDTH - 20, bottomY,
+                     SCREEN_WIDTH - 10, bottomY,
+                     SCREEN_WIDTH - 15, bottomY + 5, next.scrollDown ? COLOR_TEXT : COLOR_BG);
+    widgets++;
+  }
+
+  // Show "No SD" indicator if SD card not present (overlaps the last row's clear)
+  if (!sdCardPresent && (full || lastRowCleared)) {
+    drawNoSdIndicator(tft, SCREEN_HEIGHT - 5);
+    widgets++;
+  }
+  return widgets;
+}
+
+// Recomposes the list strips that changed and pushes them. While one strip is
+// on its way to the panel by DMA the next is drawn into the other buffer.
+// Returns the number of strips pushed.
+int drawListComposited(const DisplayView& next, bool full) {
+  // A moving or misaligned list is redrawn whole; otherwise only changed rows
+  bool moved = full || next.scrollY != shownView.scrollY ||
+               next.scrollY % DEVICE_ROW_HEIGHT != 0;
+  bool rowDirty[MAX_VISIBLE_DEVICES];
+  for (int i = 0; i < MAX_VISIBLE_DEVICES; i++) {
+    // Views are zero-initialised before filling, so memcmp is exact
+    rowDirty[i] = moved || memcmp(&next.rows[i], &shownView.rows[i], sizeof(RowView)) != 0 ||
+                  (i < MAX_VISIBLE_DEVICES - 1 && next.divider[i] != shownView.divider[i]);
+  }
+  rowDirty[MAX_VISIBLE_DEVICES - 1] |= next.scrollDown != shownView.scrollDown;
+
+  int strips = 0;
+  int buffer = 0;
+  tft.startWrite();
+  for (int top = 0; top < LIST_HEIGHT; top += DISPLAY_STRIP_HEIGHT) {
+    int lines = min(DISPLAY_STRIP_HEIGHT, LIST_HEIGHT - top);
+    bool dirty = false;
+    for (int i = top / DEVICE_ROW_HEIGHT; i <= (top + lines - 1) / DEVICE_ROW_HEIGHT; i++) {
+      dirty |= rowDirty[i];
+    }
+    if (!dirty) continue;
+
+    TFT_eSprite& sprite = *stripSprites[buffer];
+    // A single buffer can't be redrawn until its previous push has finished;
+    // with two, pushImageDMA() itself waits for the transfer before last
+    if (stripUseDma && stripBufferCount == 1) tft.dmaWait();
+    composeListStrip(sprite, next, top, lines);
+    if (stripUseDma) {
+      tft.pushImageDMA(0, ROW_START_Y + top, SCREEN_WIDTH, lines, (uint16_t*)sprite.getPointer());
+    } else {
+      tft.pushImage(0, ROW_START_Y + top, SCREEN_WIDTH, lines, (uint16_t*)sprite.getPointer());
+    }
+    buffer = (buffer + 1) % stripBufferCount;
+    strips++;
+  }
+  if (stripUseDma) tft.dmaWait();
+  tft.endWrite();
+  return strips;
+}
+
+// Renders list lines [top, top + lines) into sprite, rows offset by scrollY
+void composeListStrip(TFT_eSprite& sprite, const DisplayView& view, int top, int lines) {
+  sprite.fillSprite(COLOR_BG);
+
+  int offset = view.scrollY % DEVICE_ROW_HEIGHT;
+  for (int k = 0; k <= MAX_VISIBLE_DEVICES && view.rows[k].occupied; k++) {
+    int rowTop = k * DEVICE_ROW_HEIGHT - offset - top;
+    if (rowTop >= lines || rowTop + DEVICE_ROW_HEIGHT <= 0) continue;
+    drawDeviceRow(sprite, view.rows[k], nullptr, rowTop);
+
+    // Divider below, unless the following row is entirely out of view
+    bool nextVisible = (k + 1) * DEVICE_ROW_HEIGHT - offset < LIST_HEIGHT;
+    if (k < MAX_VISIBLE_DEVICES && view.rows[k + 1].occupied && nextVisible) {
+      sprite.drawFastHLine(0, rowTop + DEVICE_ROW_HEIGHT - 1, SCREEN_WIDTH, COLOR_DIVIDER);
+    }
+  }
+
+  // Overlays that fall inside the list area; the sprite clips the rest
+  if (view.scrollDown) {
+    int bottomY = LIST_HEIGHT - 10 - top;
+    sprite.fillTriangle(SCREEN_WIDTH - 20, bottomY,
+                        SCREEN_WIDTH - 10, bottomY,
+                        SCREEN_WIDTH - 15, bottomY + 5, COLOR_TEXT);
+  }
+  if (!sdCardPresent) {
+    drawNoSdIndicator(sprite, SCREEN_HEIGHT - 5 - ROW_START_Y - top);
+  }
+}
+
+void drawNoSdIndicator(TFT_eSPI& gfx, int bottomY) {
+  gfx.setTextColor(COLOR_UNKNOWN);
+  gfx.setTextSize(1);
+  gfx.setTextDatum(BR_DATUM);
+  gfx.drawString("No SD", SCREEN_WIDTH - 5, bottomY);
+}
+
+void drawHeader() {
+  // Header background
+  tft.fillRect(0, 0, SCREEN_WIDTH, HEADER_HEIGHT, COLOR_HEADER_BG);
+
+  // Title (smaller font)
+  tft.setTextColor(COLOR_TEXT);
+  tft.setTextSize(1);
+  tft.setTextDatum(ML_DATUM);
+  tft.drawString("BLE SCANNER", 5, HEADER_HEIGHT / 2);
+
+  // IP address (if connected), or the boot step still running
+  const char* booting = bootStepInProgress();
+  if (wifiConnected) {
+    tft.setTextColor(COLOR_KNOWN);
+    tft.drawString(WiFi.localIP().toString(), 80, HEADER_HEIGHT / 2);
+  } else if (booting) {
+    tft.setTextColor(COLOR_FADING);
+    tft.drawString(String(booting) + "...", 80, HEADER_HEIGHT / 2);
+  }
+
+  // Device count
+  drawDeviceCount(deviceCount);
+
+  // Elapsed time since last scan
+  tft.setTextColor(COLOR_TEXT);
+  tft.setTextDatum(MR_DATUM);
+  String elapsed = formatElapsedTime(millis() - lastScanTime);
+  tft.drawString(elapsed, SCREEN_WIDTH - 5, HEADER_HEIGHT / 2);
+}
+
+// Splash lines below "Initializing...", one per BootStep
+void drawBootProgress() {
+  tft.setTextSize(1);
+  tft.setTextDatum(MC_DATUM);
+  for (int i = 0; i < BOOT_STEP_COUNT; i++) {
+    int y = SCREEN_HEIGHT / 2 + 30 + i * 20;
+    uint8_t state = bootSteps[i];
+    char line[40];
+    if (state == BOOT_PENDING || state == BOOT_RUNNING) {
+      snprintf(line, sizeof(line), "%s%s", BOOT_STEP_LABELS[i], state == BOOT_RUNNING ? "..." : "");
+    } else {
+      snprintf(line, sizeof(line), "%s: %s", BOOT_STEP_LABELS[i], BOOT_STATE_NAMES[state]);
+    }
+    tft.fillRect(0, y - 8, SCREEN_WIDTH, 16, COLOR_BG);
+    tft.setTextColor(state == BOOT_PENDING ? COLOR_FADING : state == BOOT_FAILED ? COLOR_UNKNOWN : COLOR_TEXT);
+    tft.drawString(line, SCREEN_WIDTH / 2, y);
+  }
+}
+
+// Label of the first background step still running (NTP aside, which can
+// take minutes), or nullptr
+const char* bootStepInProgress() {
+  for (int i = BOOT_SD; i < BOOT_STEP_COUNT; i++) {
+    if (i != BOOT_NTP && bootSteps[i] == BOOT_RUNNING) return BOOT_STEP_LABELS[i];
+  }
+  return nullptr;
+}
+
+void drawDeviceCount(int count) {
+  // Only the count portion of the header (up to "[999]")
+  tft.fillRect(SCREEN_WIDTH / 2 + 20, 0, 40, HEADER_HEIGHT, COLOR_HEADER_BG);
+
+  tft.setTextColor(COLOR_TEXT);
+  tft.setTextSize(1);
+  tft.setTextDatum(MC_DATUM);
+  char countStr[20];
+  sprintf(countStr, "[%d]", count);
+  tft.drawString(countStr, SCREEN_WIDTH / 2 + 40, HEADER_HEIGHT / 2);
+}
+
+// Paints the widgets of row that differ from shown (all of them when shown is
+// nullptr, i.e. the area is blank) onto the panel or a strip sprite.
+// Returns the number of widgets painted.
+int drawDeviceRow(TFT_eSPI& gfx, const RowView& row, const RowView* shown, int yPos) {
+  int widgets = 0;
+
+  // Status dot (opaque, so it simply overdraws the old colour)
+  if (!shown || shown->statusColor != row.statusColor) {
+    gfx.fillCircle(15, yPos + DEVICE_ROW_HEIGHT / 2, 8, row.statusColor);
+    widgets++;
+  }
+
+  // Device name: size 2, up to 16 chars of 12 px
+  if (!shown || strcmp(shown->name, row.name) != 0) {
+    if (shown) gfx.fillRect(30, yPos + 7, 16 * 12, 16, COLOR_BG);
+    gfx.setTextColor(COLOR_TEXT);
+    gfx.setTextSize(2);
+    gfx.setTextDatum(ML_DATUM);
+    gfx.drawString(row.name, 30, yPos + 15);
+    widgets++;
+  }
+
+  // Device type and manufacturer: size 1, up to 25 chars of 6 px
+  if (!shown || strcmp(shown->subInfo, row.subInfo) != 0) {
+    if (shown) gfx.fillRect(30, yPos + 31, 25 * 6, 8, COLOR_BG);
+    gfx.setTextSize(1);
+    gfx.setTextColor(COLOR_FADING);
+    gfx.setTextDatum(ML_DATUM);
+    gfx.drawString(row.subInfo, 30, yPos + 35);
+    widgets++;
+  }
+
+  // RSSI value, right-aligned at x=280 ("-100dBm" is 7 chars)
+  if (!shown || strcmp(shown->rssiText, row.rssiText) != 0) {
+    if (shown) gfx.fillRect(280 - 7 * 6, yPos + DEVICE_ROW_HEIGHT / 2 - 4, 7 * 6, 8, COLOR_BG);
+    gfx.setTextColor(COLOR_TEXT);
+    gfx.setTextSize(1);
+    gfx.setTextDatum(MR_DATUM);
+    gfx.drawString(row.rssiText, 280, yPos + DEVICE_ROW_HEIGHT / 2);
+    widgets++;
+  }
+
+  // RSSI bars paint every bar, lit or not, so no clear is needed
+  if (!shown || shown->bars != row.bars) {
+    drawRSSIBars(gfx, 290, yPos + 12, row.bars);
+    widgets++;
+  }
+
+  // MAC address (last 8 chars)
+  if (!shown || strcmp(shown->macSuffix, row.macSuffix) != 0) {
+    if (shown) gfx.fillRect(SCREEN_WIDTH - 10 - 8 * 6, yPos + DEVICE_ROW_HEIGHT / 2 - 4, 8 * 6, 8, COLOR_BG);
+    gfx.setTextColor(COLOR_FADING);
+    gfx.setTextSize(1);
+    gfx.setTextDatum(MR_DATUM);
+    gfx.drawString(row.macSuffix, SCREEN_WIDTH - 10, yPos + DEVICE_ROW_HEIGHT / 2);
+    widgets++;
+  }
+
+  return widgets;
+}
+
+void drawRSSIBars(TFT_eSPI& gfx, int x, int y, int bars) {
+  int barWidth = 6;
+  int barSpacing = 2;
+  int maxHeight = 20;
+
+  for (int i = 0; i < 10; i++) {
+    int barHeight = (i + 1) * 2;
+    int barX = x + (i * (barWidth + barSpacing));
+    int barY = y + (maxHeight - barHeight);
+
+    uint16_t barColor;
+    if (i < bars) {
+      if (bars >= 7) barColor = COLOR_RSSI_HIGH;
+      else if (bars >= 4) barColor = COLOR_RSSI_MED;
+      else barColor = COLOR_RSSI_LOW;
+    } else {
+      barColor = COLOR_DIVIDER;
+    }
+
+    gfx.fillRect(barX, barY, barWidth, barHeight, barColor);
+  }
+}
+
+void updateElapsedTime() {
+  // Only update the elapsed time portion of header (right side)
+  tft.fillRect(SCREEN_WIDTH - 60, 0, 60, HEADER_HEIGHT, COLOR_HEADER_BG);
+
+  tft.setTextColor(COLOR_TEXT);
+  tft.setTextSize(1);
+  tft.setTextDatum(MR_DATUM);
+  String elapsed = formatElapsedTime(millis() - lastScanTime);
+  tft.drawString(elapsed, SCREEN_WIDTH - 5, HEADER_HEIGHT / 2);
+}
+
+int rssiToBars(int rssi) {
+  if (rssi >= -50) return 10;
+  if (rssi >= -55) return 9;
+  if (rssi >= -60) return 8;
+  if (rssi >= -65) return 7;
+  if (rssi >= -70) return 6;
+  if (rssi >= -75) return 5;
+  if (rssi >= -80) return 4;
+  if (rssi >= -85) return 3;
+  if (rssi >= -90) return 2;
+  return 1;
+}
+
+String formatElapsedTime(unsigned long ms) {
+  unsigned long seconds = ms / 1000;
+  if (seconds < 60) {
+    return String(seconds) + "s ago";
+  } else {
+    unsigned long minutes = seconds / 60;
+    return String(minutes) + "m ago";
+  }
+}
+
+// ============================================================================
+// Touch Handling
+// ============================================================================
+
+// Note: ESP32-3248S035C uses GT911 capacitive touch controller via I2C
+// For full touch support, add GT911 library. For now, touch is placeholder.
+// Touch pins: SDA=33, SCL=32, INT=21, RST=25
+
+bool touchAvailable = false;
+uint16_t lastTouchX = 0;
+uint16_t lastTouchY = 0;
+
+bool getTouchPoint(uint16_t* x, uint16_t* y) {
+  // Placeholder for GT911 touch reading
+  // TODO: Implement GT911 I2C touch reading or add GT911 library
+  // For now, return false (no touch)
+  //
+  // To add touch support, install a GT911 library and implement:
+  // - Initialize GT911 on I2C with SDA=33, SCL=32
+  // - Read touch points from GT911 registers
+  //
+  return false;
+}
+
+void handleTouch() {
+  uint16_t touchX, touchY;
+
+  if (getTouchPoint(&touchX, &touchY)) {
+    // Debounce
+    static unsigned long lastTouch = 0;
+    if (millis() - lastTouch < 300) return;
+    lastTouch = millis();
+
+    // Check if touch is in header (force rescan)
+    if (touchY < HEADER_HEIGHT) {
+      Serial.println("Header touched - forcing rescan");
+      rescanRequested = true;  // Picked up by the tracker task
+      return;
+    }
+
+    // Check if touch is on a device row
+    int rowIndex = (touchY - ROW_START_Y) / DEVICE_ROW_HEIGHT;
+    if (rowIndex >= 0 && rowIndex < MAX_VISIBLE_DEVICES) {
+      int deviceIndex = rowIndex + scrollOffset;
+      if (deviceIndex < deviceCount) {
+        // Detect long press for whitelist toggle
+        unsigned long pressStart = millis();
+        while (getTouchPoint(&touchX, &touchY)) {
+          if (millis() - pressStart > 1000) {
+            // Long press - toggle whitelist
+            bool known;
+            {
+              ScopedLock lock(deviceMutex);
+              if (deviceIndex >= deviceCount) return;
+              known = deviceInView(displayView, deviceIndex).isKnown;
+            }
+            if (known) {
+              removeFromWhitelist(deviceIndex);
+            } else {
+              addToWhitelist(deviceIndex);
+            }
+            return;
+          }
+          delay(50);
+        }
+
+        // Short tap - show device details (future feature)
+        ScopedLock lock(deviceMutex);
+        if (deviceIndex < deviceCount) {
+          Serial.printf("Tapped device: %s\n", deviceDisplayName(deviceInView(displayView, deviceIndex)));
+        }
+      }
+    }
+
+    // Scroll handling
+    static uint16_t lastTouchY = 0;
+    if (lastTouchY > 0) {
+      int deltaY = touchY - lastTouchY;
+      if (abs(deltaY) > 30) {
+        if (deltaY > 0 && scrollOffset > 0) {
+          scrollOffset--;
+          drawDisplay();
+        } else if (deltaY < 0 && scrollOffset + MAX_VISIBLE_DEVICES < deviceCount) {
+          scrollOffset++;
+          drawDisplay();
+        }
+      }
+    }
+    lastTouchY = touchY;
+  }
+}
+
+// ============================================================================
+// SD Card Logging
+// ============================================================================
+
+// Log records are appended to a RAM buffer and written to the day's file, which
+// stays open, in sector-aligned chunks. Durability: a record reaches the card
+// at most LOG_FLUSH_INTERVAL ms after it is logged, and the buffer never holds
+// more than LOG_FLUSH_THRESHOLD bytes (~30 CSV lines or ~128 binary records),
+// so that is the most a power loss can cost. flushLogBuffer(true) forces
+// everything out, e.g. before a download.
+//
+// With useBinaryLog the day's log is YYYY-MM-DD.bin (16-byte LogRecords) plus
+// YYYY-MM-DD.nam, a table of fixed LOG_NAME_SLOT byte names each written once
+// per day and referenced by LogRecord.nameRef. /download?format=csv converts
+// it back to the CSV layout on the fly.
+
+// Returns false until NTP has set the clock; unlike getLocalTime() never waits
+bool currentLocalTime(struct tm& timeinfo) {
+  time_t now = time(nullptr);
+  if (now < VALID_TIME_EPOCH) return false;
+  localtime_r(&now, &timeinfo);
+  return true;
+}
+
+void formatLogFilename(char* out, size_t size) {
+  const char* ext = useBinaryLog ? ".bin" : ".csv";
+  struct tm timeinfo;
+  if (BENCHMARK_MODE) {
+    snprintf(out, size, BENCH_LOG_NAME "%s", ext);  // Keep synthetic sightings out of real logs
+  } else if (currentLocalTime(timeinfo)) {
+    size_t n = strftime(out, size, LOG_DIR "/%Y-%m-%d", &timeinfo);
+    snprintf(out + n, size - n, "%s", ext);
+  } else if (wifiConnected) {
+    snprintf(out, size, LOG_DIR "/unknown-date%s", ext);
+  } else {
+    // Use fixed name without NTP
+    snprintf(out, size, LOG_DIR "/scan-log%s", ext);
+  }
+}
+
+// Name table path for a .bin log path
+void nameTablePath(const char* binPath, char* out, size_t size) {
+  strlcpy(out, binPath, size);
+  char* ext = strrchr(out, '.');
+  if (ext && (size_t)(ext - out) + 5 <= size) strcpy(ext, ".nam");
+}
+
+bool openLogFile(const char* path) {
+  bool newFile = !SD.exists(path);
+  logFile = SD.open(path, FILE_APPEND);
+  if (!logFile) {
+    Serial.printf("Failed to open log file %s\n", path);
+    logWriteErrors++;
+    return false;
+  }
+
+  strlcpy(logFilePath, path, sizeof(logFilePath));
+  logFileSize = logFile.size();
+  Serial.printf("Logging to %s (%lu bytes)\n", logFilePath, logFileSize);
+
+  if (useBinaryLog) {
+    // Complete a record torn by a power loss mid-write so later records stay
+    // aligned; the 0xFF filler has an unknown kind and is skipped on export
+    size_t torn = logFileSize % sizeof(LogRecord);
+    if (torn > 0) {
+      uint8_t filler[sizeof(LogRecord)];
+      memset(filler, 0xFF, sizeof(filler));
+      appendLogBytes(filler, sizeof(LogRecord) - torn);
+    }
+    openNameTable(path);
+  } else if (newFile) {
+    // Write header if new file
+    appendLogBytes(LOG_CSV_HEADER, sizeof(LOG_CSV_HEADER) - 1);
+  }
+  return true;
+}
+
+// Opens the .nam table beside a .bin log and re-indexes names already in it
+void openNameTable(const char* binPath) {
+  char path[sizeof(logFilePath)];
+  nameTablePath(binPath, path, sizeof(path));
+
+  memset(logNameHashes, 0, sizeof(logNameHashes));
+  memset(logNameRefs, 0, sizeof(logNameRefs));
+  logNameCount = 0;
+  logNameBufferUsed = 0;
+
+  size_t torn = 0;
+  File existing = SD.open(path, FILE_READ);
+  if (existing) {
+    char slot[LOG_NAME_SLOT + 1];
+    slot[LOG_NAME_SLOT] = '\0';
+    while (existing.read((uint8_t*)slot, LOG_NAME_SLOT) == LOG_NAME_SLOT) {
+      indexLogName(slot, logNameCount++);
+    }
+    torn = existing.size() % LOG_NAME_SLOT;
+    existing.close();
+  }
+
+  logNameFile = SD.open(path, FILE_APPEND);
+  if (!logNameFile) {
+    Serial.printf("Failed to open name table %s\n", path);
+    logWriteErrors++;
+    return;
+  }
+
+  // Pad a torn slot so later refs keep matching file offsets; it is never referenced
+  if (torn > 0) {
+    uint8_t filler[LOG_NAME_SLOT] = {0};
+    logNameFile.write(filler, LOG_NAME_SLOT - torn);
+    logNameCount++;
+  }
+}
+
+uint32_t hashLogName(const char* name) {
+  return hashPayload((const uint8_t*)name, strlen(name)) | 1;  // 0 marks an empty slot
+}
+
+void indexLogName(const char* name, uint16_t ref) {
+  uint32_t hash = hashLogName(name);
+  uint32_t pos = hash & (LOG_NAME_INDEX_SIZE - 1);
+  for (int probe = 0; probe < LOG_NAME_INDEX_SIZE; probe++) {
+    if (logNameHashes[pos] == 0) {
+      logNameHashes[pos] = hash;
+      logNameRefs[pos] = ref;
+      return;
+    }
+    if (logNameHashes[pos] == hash) return;  // Keep the first slot for a name
+    pos = (pos + 1) & (LOG_NAME_INDEX_SIZE - 1);
+  }
+  // Index full: later repeats of this name just get new slots
+}
+
+// Returns the name table slot for name, appending it if not yet in today's table
+uint16_t logNameRef(const char* name) {
+  if (name[0] == '\0') return LOG_NAME_NONE;
+
+  uint32_t hash = hashLogName(name);
+  uint32_t pos = hash & (LOG_NAME_INDEX_SIZE - 1);
+  for (int probe = 0; probe < LOG_NAME_INDEX_SIZE && logNameHashes[pos] != 0; probe++) {
+    if (logNameHashes[pos] == hash) return logNameRefs[pos];
+    pos = (pos + 1) & (LOG_NAME_INDEX_SIZE - 1);
+  }
+
+  if (!logNameFile || logNameCount >= LOG_NAME_NONE) return LOG_NAME_NONE;
+  if (logNameBufferUsed + LOG_NAME_SLOT > sizeof(logNameBuffer)) {
+    flushLogBuffer(true);
+  }
+
+  uint16_t ref = logNameCount++;
+  char* slot = logNameBuffer + logNameBufferUsed;
+  memset(slot, 0, LOG_NAME_SLOT);
+  memcpy(slot, name, min(strlen(name), (size_t)LOG_NAME_SLOT));
+  logNameBufferUsed += LOG_NAME_SLOT;
+  indexLogName(name, ref);
+  return ref;
+}
+
+void closeLogFile() {
+  if (!logFile) return;
+  flushLogBuffer(true);
+  logFile.close();
+  if (logNameFile) logNameFile.close();
+  logFilePath[0] = '\0';
+}
+
+void appendLogBytes(const void* data, size_t length) {
+  if (logBufferUsed + length > LOG_BUFFER_SIZE) {
+    // Card writes are failing and the buffer is full - drop rather than block
+    logLinesDropped++;
+    return;
+  }
+  if (logBufferUsed == 0) {
+    lastLogFlush = millis();  // Age of the oldest pending record
+  }
+  memcpy(logBuffer + logBufferUsed, data, length);
+  logBufferUsed += length;
+
+  if (logBufferUsed >= LOG_FLUSH_THRESHOLD) {
+    flushLogBuffer(false);
+  }
+}
+
+void flushLogBuffer(bool all) {
+  if (!logFile) return;
+
+  // Names go first so no record on the card references a missing slot
+  if (logNameBufferUsed > 0 && logNameFile) {
+    size_t written = logNameFile.write((const uint8_t*)logNameBuffer, logNameBufferUsed);
+    logNameFile.flush();
+    logBytesWritten += written;
+    if (written != logNameBufferUsed) logWriteErrors++;
+    logNameBufferUsed = 0;
+  }
+
+  if (logBufferUsed == 0) return;
+
+  size_t length = logBufferUsed;
+  if (!all) {
+    // End the write on a sector boundary so no sector is rewritten by the next flush
+    size_t toBoundary = LOG_SECTOR_SIZE - (logFileSize % LOG_SECTOR_SIZE);
+    if (length < toBoundary) return;
+    length = toBoundary + ((length - toBoundary) / LOG_SECTOR_SIZE) * LOG_SECTOR_SIZE;
+  }
+
+  unsigned long start = micros();
+  size_t written = logFile.write((const uint8_t*)logBuffer, length);
+  logFile.flush();  // Commit data and directory entry
+  uint32_t elapsed = micros() - start;
+
+  logFlushCount++;
+  logFlushLastUs = elapsed;
+  if (elapsed > logFlushMaxUs) logFlushMaxUs = elapsed;
+  noteMetricMax(metricsWindow.sdFlushMaxUs, elapsed);
+  logBytesWritten += written;
+  logFileSize += written;
+
+  if (written != length) {
+    // Card removed or full: drop the chunk and reopen on the next record
+    Serial.printf("SD log write failed (%u of %u bytes)\n", (unsigned)written, (unsigned)length);
+    logWriteErrors++;
+    logFile.close();
+    if (logNameFile) logNameFile.close();
+    logFilePath[0] = '\0';
+  }
+
+  memmove(logBuffer, logBuffer + length, logBufferUsed - length);
+  logBufferUsed -= length;
+  lastLogFlush = millis();
+}
+
+// Called from the storage task: bounds how long a logged record can sit in RAM
+void serviceLogWriter() {
+  if (logBufferUsed > 0 && millis() - lastLogFlush >= LOG_FLUSH_INTERVAL) {
+    flushLogBuffer(true);
+  }
+}
+
+uint8_t deviceLogStatus(const BLEDeviceInfo& device) {
+  if (device.isKnown) return LOG_STATUS_KNOWN;
+  if (device.isNew) return LOG_STATUS_NEW;
+  return LOG_STATUS_UNKNOWN;
+}
+
+void formatLogTimestamp(char* out, size_t size, uint32_t time, bool uptime) {
+  if (uptime) {
+    snprintf(out, size, "%lu", (unsigned long)time);
+    return;
+  }
+  time_t t = time;
+  struct tm timeinfo;
+  localtime_r(&t, &timeinfo);
+  strftime(out, size, "%Y-%m-%dT%H:%M:%S", &timeinfo);
+}
+
+// Shared by the CSV writer and the binary-to-CSV converter so both emit the same layout
+int formatLogCsvLine(char* out, size_t size, const char* timestamp, const uint8_t* addr,
+                     const char* name, int rssi, uint8_t deviceType, uint8_t status,
+                     uint8_t manufacturer) {
+  // Escape commas in name
+  char safeName[DEVICE_NAME_LEN + 1];
+  strlcpy(safeName, name[0] != '\0' ? name : "Unknown", sizeof(safeName));
+  for (char* c = safeName; *c; c++) {
+    if (*c == ',') *c = ';';
+  }
+
+  char mac[18];
+  formatMac(addr, mac);
+
+  int length = snprintf(out, size, "%s,%s,%s,%d,%s,%s,%s\n",
+                        timestamp,
+                        mac,
+                        safeName,
+                        rssi,
+                        deviceTypeName(deviceType),
+                        LOG_STATUS_NAMES[status & LOG_STATUS_MASK],
+                        manufacturerName(manufacturer));
+  return min(length, (int)size - 1);
+}
+
+// Opens (or rolls over to) the log for the current date
+bool ensureLogFileOpen() {
+  if (!sdCardPresent) return false;
+
+  // Roll over to a new file when the date (or NTP availability) changes
+  char path[sizeof(logFilePath)];
+  formatLogFilename(path, sizeof(path));
+  if (strcmp(path, logFilePath) != 0) {
+    closeLogFile();
+    logCompressScan = true;  // The previous day's log may now be complete
+    if (!openLogFile(path)) return false;
+  }
+  return true;
+}
+
+// Storage task only (sdMutex held); the tracker goes through queueDeviceLog()
+void logDeviceToSD(const BLEDeviceInfo& device) {
+  if (!ensureLogFileOpen()) return;
+
+  // Get timestamp
+  struct tm timeinfo;
+  bool haveTime = currentLocalTime(timeinfo);
+  uint32_t timestamp = haveTime ? (uint32_t)time(nullptr) : millis();
+
+  if (useBinaryLog) {
+    LogRecord rec;
+    rec.time = timestamp;
+    memcpy(rec.addr, device.addr, sizeof(rec.addr));
+    rec.rssi = device.rssi;
+    rec.flags = (LOG_KIND_SIGHTING << LOG_KIND_SHIFT) | deviceLogStatus(device) |
+                (haveTime ? 0 : LOG_FLAG_UPTIME);
+    rec.deviceType = device.deviceType;
+    rec.manufacturer = device.manufacturer;
+    rec.nameRef = logNameRef(device.name);
+    appendLogBytes(&rec, sizeof(rec));
+    return;
+  }
+
+  char timeStr[25];
+  formatLogTimestamp(timeStr, sizeof(timeStr), timestamp, !haveTime);
+
+  // Buffer log entry
+  char line[LOG_LINE_MAX];
+  int length = formatLogCsvLine(line, sizeof(line), timeStr, device.addr, device.name,
+                                device.rssi, device.deviceType, deviceLogStatus(device),
+                                device.manufacturer);
+  appendLogBytes(line, length);
+}
+
+// Tracker side of the log: never blocks, a full queue drops the item
+void queueDeviceLog(const BLEDeviceInfo& device) {
+  if (!sdCardPresent) return;
+  LogItem item;
+  item.kind = LOG_KIND_SIGHTING;
+  item.device = device;
+  if (xQueueSend(logQueue, &item, 0) != pdTRUE) {
+    logQueueDropped++;
+  }
+}
+
+void writeLogItem(const LogItem& item) {
+  if (item.kind == LOG_KIND_SIGHTING) {
+    logDeviceToSD(item.device);
+  } else if (item.kind == LOG_KIND_RSSI && ensureLogFileOpen()) {
+    appendLogBytes(&item.rssi, sizeof(item.rssi));
+    rssiRecordsLogged++;
+  }
+}
+
+// RSSI history: every advert is folded into the device's open bucket, and one
+// LogRssiRecord per device per rssiBucketInterval reaches the log, so write
+// bandwidth is bounded by tracked devices rather than advert rate.
+void recordRssiSample(BLEDeviceInfo& device, int rssi, unsigned long now) {
+  if (device.rssiSamples > 0 &&
+      (now - device.bucketStart >= rssiBucketInterval || device.rssiSamples == UINT16_MAX)) {
+    closeRssiBucket(device);
+  }
+  if (device.rssiSamples == 0) {
+    device.bucketStart = now;
+    device.rssiSum = 0;
+    device.rssiMin = rssi;
+    device.rssiMax = rssi;
+  }
+  device.rssiSum += rssi;
+  device.rssiSamples++;
+  if (rssi < device.rssiMin) device.rssiMin = rssi;
+  if (rssi > device.rssiMax) device.rssiMax = rssi;
+}
+
+// Hands the open bucket (if any) to the storage task and clears it
+void closeRssiBucket(BLEDeviceInfo& device) {
+  if (device.rssiSamples == 0) return;
+  uint16_t samples = device.rssiSamples;
+  device.rssiSamples = 0;
+
+  // RSSI records only exist in the binary format; CSV keeps its sighting layout
+  if (rssiBucketInterval == 0 || !useBinaryLog || !sdCardPresent) return;
+
+  LogItem item;
+  item.kind = LOG_KIND_RSSI;
+  LogRssiRecord& rec = item.rssi;
+  struct tm timeinfo;
+  if (currentLocalTime(timeinfo)) {
+    rec.time = (uint32_t)time(nullptr) - (millis() - device.bucketStart) / 1000;
+    rec.flags = LOG_KIND_RSSI << LOG_KIND_SHIFT;
+  } else {
+    rec.time = device.bucketStart;
+    rec.flags = (LOG_KIND_RSSI << LOG_KIND_SHIFT) | LOG_FLAG_UPTIME;
+  }
+  memcpy(rec.addr, device.addr, sizeof(rec.addr));
+  rec.rssiMean = (int8_t)(device.rssiSum / samples);
+  rec.rssiMin = device.rssiMin;
+  rec.rssiMax = device.rssiMax;
+  rec.samples = samples;
+  if (xQueueSend(logQueue, &item, 0) != pdTRUE) {
+    logQueueDropped++;
+  }
+}
+
+// Called after each scan: closes buckets that ended without a later advert
+void flushExpiredRssiBuckets() {
+  if (rssiBucketInterval == 0) return;
+  unsigned long now = millis();
+  for (int i = 0; i < deviceCount; i++) {
+    BLEDeviceInfo& dev = deviceAt(i);
+    if (dev.rssiSamples > 0 && now - dev.bucketStart >= rssiBucketInterval) {
+      closeRssiBucket(dev);
+    }
+  }
+}
+
+bool openLogCsvExport(LogCsvExport& csv, const char* binPath, bool rssiSeries) {
+  ScopedLock lock(sdMutex);
+  csv.bin = SD.open(binPath, FILE_READ);
+  if (!csv.bin) return false;
+  char namPath[sizeof(logFilePath)];
+  nameTablePath(binPath, namPath, sizeof(namPath));
+  csv.nam = SD.open(namPath, FILE_READ);
+  csv.rssiSeries = rssiSeries;
+  csv.headerDone = false;
+  csv.batchCount = 0;
+  csv.batchPos = 0;
+  csv.records = 0;
+  for (int i = 0; i < LOG_NAME_CACHE_SIZE; i++) csv.nameCache[i].ref = LOG_NAME_NONE;
+  return true;
+}
+
+// Fills out with whole CSV lines, the header first: sightings in the
+// LOG_CSV_HEADER layout, or with rssiSeries the RSSI bucket records. Returns
+// 0 at the end of the log. sdMutex is taken per read.
+size_t readLogCsv(LogCsvExport& csv, char* out, size_t size) {
+  size_t used = 0;
+  if (!csv.headerDone) {
+    used = strlcpy(out, csv.rssiSeries ? LOG_RSSI_CSV_HEADER : LOG_CSV_HEADER, size);
+    csv.headerDone = true;
+  }
+
+  while (size - used >= LOG_LINE_MAX) {
+    if (csv.batchPos == csv.batchCount) {
+      size_t bytesRead;
+      {
+        ScopedLock lock(sdMutex);
+        bytesRead = csv.bin.read((uint8_t*)csv.batch, sizeof(csv.batch));
+      }
+      csv.batchCount = bytesRead / sizeof(LogRecord);
+      csv.batchPos = 0;
+      if (csv.batchCount == 0) break;
+    }
+
+    const LogRecord& rec = csv.batch[csv.batchPos++];
+    uint8_t kind = rec.flags >> LOG_KIND_SHIFT;
+    char timeStr[25];
+
+    if (csv.rssiSeries) {
+      if (kind != LOG_KIND_RSSI) continue;
+      const LogRssiRecord& agg = (const LogRssiRecord&)rec;
+      char mac[18];
+      formatLogTimestamp(timeStr, sizeof(timeStr), agg.time, agg.flags & LOG_FLAG_UPTIME);
+      formatMac(agg.addr, mac);
+      int length = snprintf(out + used, size - used, "%s,%s,%u,%d,%d,%d\n",
+                            timeStr, mac, agg.samples, agg.rssiMin, agg.rssiMax, agg.rssiMean);
+      used += min(length, (int)(size - used) - 1);
+      csv.records++;
+      continue;
+    }
+
+    if (kind != LOG_KIND_SIGHTING) continue;
+
+    const char* name = "";
+    if (rec.nameRef != LOG_NAME_NONE && csv.nam) {
+      auto& cached = csv.nameCache[rec.nameRef % LOG_NAME_CACHE_SIZE];
+      if (cached.ref != rec.nameRef) {
+        ScopedLock lock(sdMutex);
+        cached.name[LOG_NAME_SLOT] = '\0';
+        if (csv.nam.seek((uint32_t)rec.nameRef * LOG_NAME_SLOT) &&
+            csv.nam.read((uint8_t*)cached.name, LOG_NAME_SLOT) == LOG_NAME_SLOT) {
+          cached.ref = rec.nameRef;
+        } else {
+          cached.name[0] = '\0';
+        }
+      }
+      name = cached.name;
+    }
+
+    formatLogTimestamp(timeStr, sizeof(timeStr), rec.time, rec.flags & LOG_FLAG_UPTIME);
+    used += formatLogCsvLine(out + used, size - used, timeStr, rec.addr, name,
+                             rec.rssi, rec.deviceType, rec.flags, rec.manufacturer);
+    csv.records++;
+  }
+  return used;
+}
+
+void closeLogCsvExport(LogCsvExport& csv) {
+  ScopedLock lock(sdMutex);
+  csv.bin.close();
+  if (csv.nam) csv.nam.close();
+}
+
+// Streams a .bin log and its name table to the client as CSV, gzip
+// compressed if asked. sdMutex is taken per read, never across a network
+// send. The output is generated, so Range requests get the whole export.
+void streamBinaryLogAsCsv(httpd_req_t* req, const String& binPath, const String& csvName, bool rssiSeries, bool gzip) {
+  // On the stack, as two workers may export at once
+  LogCsvExport csv;
+  if (!openLogCsvExport(csv, binPath.c_str(), rssiSeries)) {
+    sendResponse(req, "500 Internal Server Error", "text/plain", "Failed to open file");
+    return;
+  }
+
+  // Header values are sent with the first chunk, so must outlive this call's sends
+  char disposition[64];
+  snprintf(disposition, sizeof(disposition), "attachment; filename=%s", csvName.c_str());
+  httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+  {
+    ChunkedResponse response(req, "200 OK", "text/csv");
+    GzipWriter* gzipOut = gzip ? newGzipWriter(response) : nullptr;
+    if (gzipOut) httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+
+    char out[LOG_CSV_CHUNK];
+    size_t used;
+    while (response.ok() && (used = readLogCsv(csv, out, sizeof(out))) > 0) {
+      if (gzipOut) {
+        gzipOut->write((const uint8_t*)out, used);
+      } else {
+        response.send(out, used);
+      }
+    }
+    if (gzipOut) endGzipResponse(gzipOut);
+  }
+
+  closeLogCsvExport(csv);
+  Serial.printf("Converted %lu binary log records to CSV\n", csv.records);
+}
+
+// Streams a file, dropping sdMutex between chunks so a slow client can't
+// stall the storage task. Sent as stored, a single byte Range is honoured
+// (206), so downloads can be resumed or split across connections; with
+// CODING_GZIP the body is compressed on the way out.
+void streamSdFile(httpd_req_t* req, const String& path, const String& filename, const char* contentType, ContentCoding coding) {
+  File file;
+  size_t size = 0;
+  {
+    ScopedLock lock(sdMutex);
+    file = SD.open(path, FILE_READ);
+    if (file) size = file.size();
+  }
+  if (!file) {
+    sendResponse(req, "500 Internal Server Error", "text/plain", "Failed to open file");
+    return;
+  }
+
+  // Header values are sent with the first chunk, so must outlive the sends
+  char range[64];
+  char contentRange[48];
+  char disposition[64];
+  size_t start = 0;
+  size_t end = size - 1;
+  int ranged = -1;
+  if (coding == CODING_IDENTITY &&
+      httpd_req_get_hdr_value_str(req, "Range", range, sizeof(range)) == ESP_OK) {
+    ranged = parseByteRange(range, size, start, end);
+  }
+  if (ranged == 0) {
+    snprintf(contentRange, sizeof(contentRange), "bytes */%u", (unsigned)size);
+    httpd_resp_set_hdr(req, "Content-Range", contentRange);
+    sendResponse(req, "416 Range Not Satisfiable", "text/plain", "Range not satisfiable");
+    ScopedLock lock(sdMutex);
+    file.close();
+    return;
+  }
 
-    tft.fillRect(barX, barY, barWidth, barHeight, barColor);
+  snprintf(disposition, sizeof(disposition), "attachment; filename=%s", filename.c_str());
+  httpd_resp_set_hdr(req, "Content-Disposition", disposition);
+  if (coding == CODING_IDENTITY) httpd_resp_set_hdr(req, "Accept-Ranges", "bytes");
+  if (coding == CODING_GZIP_FILE) {
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    gzipFilesServed++;
+  }
+  size_t remaining = size;
+  if (ranged == 1) {
+    snprintf(contentRange, sizeof(contentRange), "bytes %u-%u/%u",
+             (unsigned)start, (unsigned)end, (unsigned)size);
+    httpd_resp_set_hdr(req, "Content-Range", contentRange);
+    remaining = end - start + 1;
+    ScopedLock lock(sdMutex);
+    file.seek(start);
   }
-}
 
-void updateElapsedTime() {
-  // Only update the elapsed time portion of header (right side)
-  tft.fillRect(SCREEN_WIDTH - 60, 0, 60, HEADER_HEIGHT, COLOR_HEADER_BG);
+  {
+    ChunkedResponse response(req, ranged == 1 ? "206 Partial Content" : "200 OK", contentType);
+    GzipWriter* gzipOut = coding == CODING_GZIP ? newGzipWriter(response) : nullptr;
+    if (gzipOut) httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+
+    char chunk[LOG_CSV_CHUNK];
+    while (remaining > 0 && response.ok()) {
+      size_t bytesRead;
+      {
+        ScopedLock lock(sdMutex);
+        bytesRead = file.read((uint8_t*)chunk, min(remaining, sizeof(chunk)));
+      }
+      if (bytesRead == 0) break;
+      if (gzipOut) {
+        gzipOut->write((const uint8_t*)chunk, bytesRead);
+      } else {
+        response.send(chunk, bytesRead);
+      }
+      remaining -= bytesRead;
+    }
+    if (gzipOut) endGzipResponse(gzipOut);
+  }
 
-  tft.setTextColor(COLOR_TEXT);
-  tft.setTextSize(1);
-  tft.setTextDatum(MR_DATUM);
-  String elapsed = formatElapsedTime(millis() - lastScanTime);
-  tft.drawString(elapsed, SCREEN_WIDTH - 5, HEADER_HEIGHT / 2);
+  ScopedLock lock(sdMutex);
+  file.close();
 }
 
-int rssiToBars(int rssi) {
-  if (rssi >= -50) return 10;
-  if (rssi >= -55) return 9;
-  if (rssi >= -60) return 8;
-  if (rssi >= -65) return 7;
-  if (rssi >= -70) return 6;
-  if (rssi >= -75) return 5;
-  if (rssi >= -80) return 4;
-  if (rssi >= -85) return 3;
-  if (rssi >= -90) return 2;
+// Parses a single "bytes=a-b", "bytes=a-" or "bytes=-n" Range against size.
+// Returns 1 with [start, end] set, 0 if unsatisfiable, or -1 if the header
+// isn't understood (multiple ranges included), which is served as a 200.
+int parseByteRange(const char* header, size_t size, size_t& start, size_t& end) {
+  if (strncmp(header, "bytes=", 6) != 0 || strchr(header, ',')) return -1;
+  const char* spec = header + 6;
+  char* rest;
+
+  if (*spec == '-') {
+    unsigned long suffix = strtoul(spec + 1, &rest, 10);
+    if (rest == spec + 1 || *rest) return -1;
+    if (suffix == 0 || size == 0) return 0;
+    start = size > suffix ? size - suffix : 0;
+    end = size - 1;
+    return 1;
+  }
+
+  unsigned long first = strtoul(spec, &rest, 10);
+  if (rest == spec || *rest != '-') return -1;
+  const char* lastSpec = rest + 1;
+  unsigned long last = ULONG_MAX;
+  if (*lastSpec) {
+    last = strtoul(lastSpec, &rest, 10);
+    if (*rest || last < first) return -1;
+  }
+  if (first >= size) return 0;
+  start = first;
+  end = min((size_t)last, size - 1);
   return 1;
 }
 
-String formatElapsedTime(unsigned long ms) {
-  unsigned long seconds = ms / 1000;
-  if (seconds < 60) {
-    return String(seconds) + "s ago";
-  } else {
-    unsigned long minutes = seconds / 60;
-    return String(minutes) + "m ago";
-  }
+// True if the client's Accept-Encoding lists gzip (and not with q=0)
+bool acceptsGzip(httpd_req_t* req) {
+  char value[96];
+  esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", value, sizeof(value));
+  if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) return false;
+  const char* gzip = strstr(value, "gzip");
+  if (!gzip) return false;
+  const char* params = gzip + 4;
+  while (*params == ' ') params++;
+  if (*params != ';') return true;
+  const char* q = strstr(params, "q=");
+  return !q || strtod(q + 2, nullptr) > 0;
 }
 
 // ============================================================================
-// Touch Handling
+// Gzip Compression
 // ============================================================================
 
-// Note: ESP32-3248S035C uses GT911 capacitive touch controller via I2C
-// For full touch support, add GT911 library. For now, touch is placeholder.
-// Touch pins: SDA=33, SCL=32, INT=21, RST=25
-
-bool touchAvailable = false;
-uint16_t lastTouchX = 0;
-uint16_t lastTouchY = 0;
+constexpr uint16_t GZIP_LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                           35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr uint8_t GZIP_LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                           3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t GZIP_DIST_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                         257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                         8193, 12289, 16385, 24577};
+constexpr uint8_t GZIP_DIST_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                         7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+GzipWriter::GzipWriter(Print& out) : out_(out) {
+  memset(head_, 0, sizeof(head_));
+  // Member header: deflate, no name or mtime, Unix
+  const uint8_t header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+  memcpy(output_, header, sizeof(header));
+  outputUsed_ = sizeof(header);
+  putBits(1, 1);  // BFINAL: the whole stream is a single block...
+  putBits(1, 2);  // ...of BTYPE 01, fixed Huffman codes
+}
 
-bool getTouchPoint(uint16_t* x, uint16_t* y) {
-  // Placeholder for GT911 touch reading
-  // TODO: Implement GT911 I2C touch reading or add GT911 library
-  // For now, return false (no touch)
-  //
-  // To add touch support, install a GT911 library and implement:
-  // - Initialize GT911 on I2C with SDA=33, SCL=32
-  // - Read touch points from GT911 registers
-  //
-  return false;
+size_t GzipWriter::write(const uint8_t* data, size_t size) {
+  if (finished_) return 0;
+  crc_ = esp_rom_crc32_le(crc_, data, size);
+  size_ += size;
+  for (size_t done = 0; done < size;) {
+    if (fill_ == sizeof(window_)) {
+      compress(false);
+      slide();
+    }
+    size_t n = min(size - done, sizeof(window_) - fill_);
+    memcpy(window_ + fill_, data + done, n);
+    fill_ += n;
+    done += n;
+  }
+  return size;
 }
 
-void handleTouch() {
-  uint16_t touchX, touchY;
+void GzipWriter::finish() {
+  if (finished_) return;
+  compress(true);
+  putHuffman(0, 7);  // End of block (symbol 256)
+  if (bitCount_ > 0) putBits(0, 8 - bitCount_);
+  putBits(crc_ & 0xFFFF, 16);  // Trailer: CRC-32 and length, little-endian
+  putBits(crc_ >> 16, 16);
+  putBits(size_ & 0xFFFF, 16);
+  putBits(size_ >> 16, 16);
+  flushOutput();
+  finished_ = true;
+}
 
-  if (getTouchPoint(&touchX, &touchY)) {
-    // Debounce
-    static unsigned long lastTouch = 0;
-    if (millis() - lastTouch < 300) return;
-    lastTouch = millis();
+uint32_t GzipWriter::hash(const uint8_t* p) {
+  uint32_t prefix = (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+  return (prefix * 2654435761u) >> (32 - GZIP_HASH_BITS);
+}
 
-    // Check if touch is in header (force rescan)
-    if (touchY < HEADER_HEIGHT) {
-      Serial.println("Header touched - forcing rescan");
-      lastScanTime = 0;  // Force immediate scan
-      return;
+// Encodes the window up to its end, or while a full-length match could
+// still be found before it
+void GzipWriter::compress(bool final) {
+  size_t limit = final ? fill_ : fill_ - min(fill_, (size_t)GZIP_MAX_MATCH);
+  while (pos_ < limit) {
+    size_t distance = 0;
+    size_t length = longestMatch(distance);
+    if (length == 0) {
+      putLiteral(window_[pos_]);
+      insertHash(pos_++);
+      continue;
     }
+    putMatch(length, distance);
+    for (size_t end = pos_ + length; pos_ < end; pos_++) insertHash(pos_);
+  }
+}
 
-    // Check if touch is on a device row
-    int rowIndex = (touchY - ROW_START_Y) / DEVICE_ROW_HEIGHT;
-    if (rowIndex >= 0 && rowIndex < MAX_VISIBLE_DEVICES) {
-      int deviceIndex = rowIndex + scrollOffset;
-      if (deviceIndex < deviceCount) {
-        // Detect long press for whitelist toggle
-        unsigned long pressStart = millis();
-        while (getTouchPoint(&touchX, &touchY)) {
-          if (millis() - pressStart > 1000) {
-            // Long press - toggle whitelist
-            if (devices[deviceIndex].isKnown) {
-              removeFromWhitelist(deviceIndex);
-            } else {
-              addToWhitelist(deviceIndex);
-            }
-            return;
-          }
-          delay(50);
-        }
+// Drops the oldest GZIP_WINDOW bytes; stored positions move down with them
+void GzipWriter::slide() {
+  memmove(window_, window_ + GZIP_WINDOW, fill_ - GZIP_WINDOW);
+  fill_ -= GZIP_WINDOW;
+  pos_ -= GZIP_WINDOW;
+  for (uint16_t& p : head_) p = p > GZIP_WINDOW ? p - GZIP_WINDOW : 0;
+  for (uint16_t& p : prev_) p = p > GZIP_WINDOW ? p - GZIP_WINDOW : 0;
+}
 
-        // Short tap - show device details (future feature)
-        Serial.printf("Tapped device: %s\n", devices[deviceIndex].name.c_str());
-      }
-    }
+void GzipWriter::insertHash(size_t pos) {
+  if (pos + GZIP_MIN_MATCH > fill_) return;
+  uint32_t h = hash(window_ + pos);
+  prev_[pos & (GZIP_WINDOW - 1)] = head_[h];
+  head_[h] = pos + 1;
+}
 
-    // Scroll handling
-    static uint16_t lastTouchY = 0;
-    if (lastTouchY > 0) {
-      int deltaY = touchY - lastTouchY;
-      if (abs(deltaY) > 30) {
-        if (deltaY > 0 && scrollOffset > 0) {
-          scrollOffset--;
-          drawDisplay();
-        } else if (deltaY < 0 && scrollOffset + MAX_VISIBLE_DEVICES < deviceCount) {
-          scrollOffset++;
-          drawDisplay();
-        }
+// Longest earlier occurrence of the bytes at pos_, or 0 if none of
+// GZIP_MIN_MATCH bytes is within the window
+size_t GzipWriter::longestMatch(size_t& distance) {
+  size_t maxLength = min((size_t)GZIP_MAX_MATCH, fill_ - pos_);
+  if (maxLength < GZIP_MIN_MATCH) return 0;
+
+  const uint8_t* current = window_ + pos_;
+  size_t best = 0;
+  uint16_t candidate = head_[hash(current)];
+  for (int chain = 0; chain < GZIP_MAX_CHAIN && candidate != 0; chain++) {
+    size_t match = candidate - 1;
+    // prev_ slots are reused after GZIP_WINDOW bytes, so older links are stale
+    if (pos_ - match >= GZIP_WINDOW) break;
+
+    const uint8_t* earlier = window_ + match;
+    if (earlier[best] == current[best]) {  // Can't beat best otherwise
+      size_t length = 0;
+      while (length < maxLength && earlier[length] == current[length]) length++;
+      if (length > best) {
+        best = length;
+        distance = pos_ - match;
+        if (best == maxLength) break;
       }
     }
-    lastTouchY = touchY;
+
+    uint16_t next = prev_[match & (GZIP_WINDOW - 1)];
+    if (next >= candidate) break;  // Chains only run backwards
+    candidate = next;
   }
+  return best >= GZIP_MIN_MATCH ? best : 0;
 }
 
-// ============================================================================
-// SD Card Logging
-// ============================================================================
+void GzipWriter::putLiteral(uint8_t c) {
+  if (c < 144) {
+    putHuffman(0x30 + c, 8);
+  } else {
+    putHuffman(0x190 + c - 144, 9);
+  }
+}
 
-void logDeviceToSD(BLEDeviceInfo& device) {
-  if (!sdCardPresent) return;
+void GzipWriter::putMatch(size_t length, size_t distance) {
+  int code = 28;
+  while (GZIP_LENGTH_BASE[code] > length) code--;
+  int symbol = 257 + code;
+  if (symbol <= 279) {
+    putHuffman(symbol - 256, 7);
+  } else {
+    putHuffman(0xC0 + symbol - 280, 8);
+  }
+  putBits(length - GZIP_LENGTH_BASE[code], GZIP_LENGTH_EXTRA[code]);
 
-  String filename = getLogFilename();
-  bool newFile = !SD.exists(filename);
+  code = 29;
+  while (GZIP_DIST_BASE[code] > distance) code--;
+  putHuffman(code, 5);
+  putBits(distance - GZIP_DIST_BASE[code], GZIP_DIST_EXTRA[code]);
+}
 
-  File logFile = SD.open(filename, FILE_APPEND);
-  if (!logFile) {
-    Serial.println("Failed to open log file");
-    return;
+// Huffman codes are packed most significant bit first
+void GzipWriter::putHuffman(uint32_t code, int length) {
+  uint32_t reversed = 0;
+  for (int i = 0; i < length; i++) {
+    reversed = (reversed << 1) | (code & 1);
+    code >>= 1;
   }
+  putBits(reversed, length);
+}
 
-  // Write header if new file
-  if (newFile) {
-    logFile.println("timestamp,mac,name,rssi,device_type,status,manufacturer");
+void GzipWriter::putBits(uint32_t bits, int count) {
+  bitBuffer_ |= bits << bitCount_;
+  bitCount_ += count;
+  while (bitCount_ >= 8) {
+    output_[outputUsed_++] = bitBuffer_ & 0xFF;
+    bitBuffer_ >>= 8;
+    bitCount_ -= 8;
+    if (outputUsed_ == sizeof(output_)) flushOutput();
   }
+}
 
-  // Get timestamp
-  String timestamp;
-  if (wifiConnected) {
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-      char timeStr[25];
-      strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%S", &timeinfo);
-      timestamp = String(timeStr);
-    } else {
-      timestamp = String(millis());
-    }
-  } else {
-    timestamp = String(millis());
-  }
+void GzipWriter::flushOutput() {
+  if (outputUsed_ == 0) return;
+  if (out_.write(output_, outputUsed_) != outputUsed_) ok_ = false;
+  written_ += outputUsed_;
+  outputUsed_ = 0;
+}
 
-  // Determine status
-  String status;
-  if (device.isKnown) status = "known";
-  else if (device.isNew) status = "new";
-  else status = "unknown";
+// Writers are too large for task stacks. nullptr (counted) if the heap
+// can't spare one, in which case the caller sends uncompressed.
+GzipWriter* newGzipWriter(Print& out) {
+  GzipWriter* gzip = new (std::nothrow) GzipWriter(out);
+  if (!gzip) gzipAllocFailures++;
+  return gzip;
+}
 
-  // Escape commas in name
-  String safeName = device.name;
-  safeName.replace(",", ";");
-
-  // Write log entry
-  logFile.printf("%s,%s,%s,%d,%s,%s,%s\n",
-                 timestamp.c_str(),
-                 device.mac.c_str(),
-                 safeName.c_str(),
-                 device.rssi,
-                 device.deviceType.c_str(),
-                 status.c_str(),
-                 device.manufacturer.c_str());
+void endGzipResponse(GzipWriter* gzip) {
+  gzip->finish();
+  gzipResponses++;
+  gzipBytesIn += gzip->bytesIn();
+  gzipBytesOut += gzip->bytesOut();
+  delete gzip;
+}
 
-  logFile.close();
+// Previous days' logs never change, so the storage task compresses each once
+// into YYYY-MM-DD.csv.gz beside it (a .bin is converted to CSV first), which
+// /download then serves as is. The work is done in LOG_COMPRESS_SLICE_MS
+// steps between log writes, and the output only gets its name once complete,
+// so a reset never leaves a truncated .csv.gz. Logs are looked for at boot
+// and after each rollover, once the date is known.
+
+// A dated log (YYYY-MM-DD.bin or .csv) from before today
+bool isPastLogName(const char* name, const char* today) {
+  if (strlen(name) != 14 || name[4] != '-' || name[7] != '-') return false;
+  for (int i = 0; i < 10; i++) {
+    if (i != 4 && i != 7 && !isdigit((uint8_t)name[i])) return false;
+  }
+  if (strcmp(name + 10, ".bin") != 0 && strcmp(name + 10, ".csv") != 0) return false;
+  return strncmp(name, today, 10) < 0;
+}
+
+// Finds a past log without a .csv.gz (sdMutex held)
+bool findLogToCompress(const char* today, char* source, size_t size) {
+  File root = SD.open(LOG_DIR);
+  if (!root || !root.isDirectory()) return false;
+
+  bool found = false;
+  while (!found) {
+    File file = root.openNextFile();
+    if (!file) break;
+    if (!file.isDirectory() && isPastLogName(file.name(), today)) {
+      char target[40];
+      snprintf(target, sizeof(target), LOG_DIR "/%.10s.csv.gz", file.name());
+      if (!SD.exists(target)) {
+        snprintf(source, size, LOG_DIR "/%s", file.name());
+        found = true;
+      }
+    }
+    file.close();
+  }
+  root.close();
+  return found;
 }
 
-String getLogFilename() {
-  String filename = "/ble-logs/";
+bool startLogCompression(const char* source) {
+  LogCompressJob& job = compressJob;
+  const char* name = strrchr(source, '/') + 1;
+  strlcpy(job.source, source, sizeof(job.source));
+  snprintf(job.target, sizeof(job.target), LOG_DIR "/%.10s.csv.gz", name);
+  snprintf(job.temp, sizeof(job.temp), "%s.tmp", job.target);
+  job.fromBinary = strcmp(name + 10, ".bin") == 0;
+
+  ScopedLock lock(sdMutex);
+  bool opened = job.fromBinary ? openLogCsvExport(job.csv, source, false)
+                               : (bool)(job.raw = SD.open(source, FILE_READ));
+  if (!opened) {
+    Serial.printf("Log compression: cannot open %s\n", source);
+    return false;
+  }
+  job.out = SD.open(job.temp, FILE_WRITE);
+  job.gzip = job.out ? newGzipWriter(job.out) : nullptr;
+  if (!job.gzip) {
+    Serial.printf("Log compression: cannot start %s\n", job.temp);
+    if (job.out) job.out.close();
+    if (job.fromBinary) {
+      closeLogCsvExport(job.csv);
+    } else {
+      job.raw.close();
+    }
+    return false;
+  }
+  job.active = true;
+  Serial.printf("Compressing %s\n", source);
+  return true;
+}
 
-  if (wifiConnected) {
+// Storage task, outside sdMutex: runs the current compression for one slice,
+// or starts the next one
+void serviceLogCompression() {
+  LogCompressJob& job = compressJob;
+  if (!job.active) {
     struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-      char dateStr[12];
-      strftime(dateStr, sizeof(dateStr), "%Y-%m-%d", &timeinfo);
-      filename += String(dateStr);
+    if (!logCompressScan || !sdCardPresent || !currentLocalTime(timeinfo)) return;
+    char today[11];
+    strftime(today, sizeof(today), "%Y-%m-%d", &timeinfo);
+
+    char source[sizeof(job.source)];
+    bool found;
+    {
+      ScopedLock lock(sdMutex);
+      found = findLogToCompress(today, source, sizeof(source));
+    }
+    // On a failure, wait for the next rollover rather than retrying every pass
+    if (!found || !startLogCompression(source)) {
+      logCompressScan = false;
+      return;
+    }
+  }
+
+  char chunk[LOG_CSV_CHUNK];
+  unsigned long start = millis();
+  while (millis() - start < LOG_COMPRESS_SLICE_MS) {
+    size_t length;
+    if (job.fromBinary) {
+      length = readLogCsv(job.csv, chunk, sizeof(chunk));
     } else {
-      filename += "unknown-date";
+      ScopedLock lock(sdMutex);
+      length = job.raw.read((uint8_t*)chunk, sizeof(chunk));
     }
+    if (length == 0) {
+      finishLogCompression();
+      return;
+    }
+    ScopedLock lock(sdMutex);
+    job.gzip->write((const uint8_t*)chunk, length);
+  }
+}
+
+void finishLogCompression() {
+  LogCompressJob& job = compressJob;
+  ScopedLock lock(sdMutex);
+  job.gzip->finish();
+  bool ok = job.gzip->ok();
+  uint32_t bytesIn = job.gzip->bytesIn();
+  uint32_t bytesOut = job.gzip->bytesOut();
+  delete job.gzip;
+  job.gzip = nullptr;
+  job.out.close();
+  if (job.fromBinary) {
+    closeLogCsvExport(job.csv);
   } else {
-    // Use boot count or fixed name without NTP
-    filename += "scan-log";
+    job.raw.close();
   }
+  job.active = false;
 
-  filename += ".csv";
-  return filename;
+  if (ok) ok = SD.rename(job.temp, job.target);
+  if (!ok) {
+    SD.remove(job.temp);
+    Serial.printf("Log compression of %s failed\n", job.source);
+    logCompressScan = false;
+    return;
+  }
+  logsCompressed++;
+  Serial.printf("Compressed %s: %lu -> %lu bytes\n", job.target, bytesIn, bytesOut);
 }
 
 // ============================================================================
 // Audio Functions
 // ============================================================================
 
-void playTone(int frequency, int duration) {
-  if (!audioEnabled) return;
+// Tone patterns, indexed by AudioAlert. A pattern can only be interrupted by
+// one of higher priority; equal or lower priority requests wait their turn.
+constexpr ToneStep PATTERN_UNKNOWN[] = {      // 3 short urgent beeps at 2kHz
+  {2000, 100}, {0, 100}, {2000, 100}, {0, 100}, {2000, 100}, {0, 100}
+};
+constexpr ToneStep PATTERN_NEW[] = {          // Single short beep at 1kHz
+  {1000, 150}
+};
+constexpr ToneStep PATTERN_WHITELIST[] = {    // Two ascending tones
+  {800, 150}, {0, 50}, {1200, 200}
+};
+constexpr ToneStep PATTERN_STARTUP[] = {
+  {1000, 100}, {0, 50}, {1500, 100}
+};
 
+struct AudioPattern {
+  const ToneStep* steps;
+  uint8_t length;
+  uint8_t priority;               // Higher preempts lower
+};
+
+#define PATTERN(steps, priority) {steps, sizeof(steps) / sizeof(steps[0]), priority}
+constexpr AudioPattern AUDIO_PATTERNS[] = {
+  PATTERN(PATTERN_UNKNOWN, 3),    // AUDIO_UNKNOWN_DEVICE
+  PATTERN(PATTERN_NEW, 1),        // AUDIO_NEW_DEVICE
+  PATTERN(PATTERN_WHITELIST, 2),  // AUDIO_WHITELIST_ADDED
+  PATTERN(PATTERN_STARTUP, 0),    // AUDIO_STARTUP
+};
+#undef PATTERN
+static_assert(sizeof(AUDIO_PATTERNS) / sizeof(AUDIO_PATTERNS[0]) == AUDIO_ALERT_COUNT,
+              "AUDIO_PATTERNS must cover every AudioAlert");
+
+void setTone(uint16_t frequency) {
   int audioPin = useSpeaker ? AUDIO_PIN : BUZZER_PIN;
-  ledcWriteTone(audioPin, frequency);  // ESP32 Arduino Core 3.x API
-  delay(duration);
-  ledcWriteTone(audioPin, 0);    // Silence
+  ledcWriteTone(audioPin, frequency);  // ESP32 Arduino Core 3.x API, 0 = silence
 }
 
-void alertUnknownDevice() {
+// Alerts are queued so the caller never waits on a tone
+void queueAudioAlert(AudioAlert alert) {
   if (!audioEnabled) return;
+  xQueueSend(audioQueue, &alert, 0);  // Dropping a beep is harmless
+}
 
-  // 3 short urgent beeps at 2kHz
-  for (int i = 0; i < 3; i++) {
-    playTone(2000, 100);
-    delay(100);
+// Sequencer: the task sleeps in xQueueReceive() until either the current step
+// ends or a new request arrives, so it never delays and can preempt mid-pattern.
+// Requests are held as one pending bit per pattern, which coalesces repeats;
+// a pattern also is not restarted within AUDIO_COALESCE_MS of its last start.
+void audioTaskMain(void* param) {
+  uint32_t pending = 0;                        // Bit per AudioAlert
+  unsigned long lastStarted[AUDIO_ALERT_COUNT] = {};
+  bool everStarted[AUDIO_ALERT_COUNT] = {};
+  int current = -1;                            // Playing AudioAlert, -1 when idle
+  uint8_t step = 0;
+  unsigned long stepEnd = 0;
+
+  for (;;) {
+    TickType_t wait = portMAX_DELAY;
+    if (current >= 0) {
+      long remaining = (long)(stepEnd - millis());
+      wait = remaining > 0 ? pdMS_TO_TICKS(remaining) : 0;
+    }
+
+    AudioAlert alert;
+    if (xQueueReceive(audioQueue, &alert, wait) == pdTRUE && alert < AUDIO_ALERT_COUNT) {
+      unsigned long now = millis();
+      if (alert == current || (pending & (1u << alert)) ||
+          (everStarted[alert] && now - lastStarted[alert] < AUDIO_COALESCE_MS)) {
+        audioCoalesced++;
+      } else {
+        pending |= 1u << alert;
+      }
+
+      // A more urgent pattern cuts the current one short
+      if (current >= 0 && (pending & (1u << alert)) &&
+          AUDIO_PATTERNS[alert].priority > AUDIO_PATTERNS[current].priority) {
+        setTone(0);
+        current = -1;
+        audioPreempted++;
+      }
+    }
+
+    unsigned long now = millis();
+    if (current >= 0 && (long)(now - stepEnd) >= 0) {
+      if (++step < AUDIO_PATTERNS[current].length) {
+        const ToneStep& next = AUDIO_PATTERNS[current].steps[step];
+        setTone(next.frequency);
+        stepEnd = now + next.duration;
+      } else {
+        setTone(0);
+        current = -1;
+      }
+    }
+
+    // Start the highest-priority pending pattern
+    if (current < 0 && pending) {
+      for (int i = 0; i < AUDIO_ALERT_COUNT; i++) {
+        if ((pending & (1u << i)) &&
+            (current < 0 || AUDIO_PATTERNS[i].priority > AUDIO_PATTERNS[current].priority)) {
+          current = i;
+        }
+      }
+      pending &= ~(1u << current);
+      lastStarted[current] = now;
+      everStarted[current] = true;
+      step = 0;
+      setTone(AUDIO_PATTERNS[current].steps[0].frequency);
+      stepEnd = now + AUDIO_PATTERNS[current].steps[0].duration;
+      audioPlayed++;
+    }
   }
 }
 
-void alertNewDevice() {
-  if (!audioEnabled) return;
+void alertUnknownDevice() {
+  queueAudioAlert(AUDIO_UNKNOWN_DEVICE);
+}
 
-  // Single short beep at 1kHz
-  playTone(1000, 150);
+void alertNewDevice() {
+  queueAudioAlert(AUDIO_NEW_DEVICE);
 }
 
 void alertWhitelistAdded() {
-  if (!audioEnabled) return;
-
-  // Two ascending tones
-  playTone(800, 150);
-  delay(50);
-  playTone(1200, 200);
+  queueAudioAlert(AUDIO_WHITELIST_ADDED);
 }
 
 // ============================================================================
 // WiFi Webhook Alerts
 // ============================================================================
 
-void sendWebhookAlert(BLEDeviceInfo& device) {
-  if (!wifiConnected) return;
-  if (strlen(ALERT_WEBHOOK_URL) == 0 || strcmp(ALERT_WEBHOOK_URL, "") == 0) return;
+// Alerts go out from the uplink task, never the tracker. The tracker queues
+// a small AlertEvent per unknown device; the uplink task admits it past two
+// limits - an address alerted for within ALERT_DEVICE_INTERVAL is held back,
+// and a token bucket caps all alerts at ALERT_RATE_PER_MIN with bursts of
+// ALERT_RATE_BURST - and collects admitted alerts in alertBatch. The batch is
+// sent ALERT_COALESCE_MS after its first alert (or once full) as one POST,
+// so a burst of unknowns costs one request instead of one each. alertHttp
+// stays open between POSTs when the webhook allows keep-alive.
+//
+// A lone alert keeps the original unknown_device body. Several go as one
+// unknown_devices body with a devices array of the same fields. Failed POSTs
+// are retried with backoff (ALERT_BACKOFF_MIN to ALERT_BACKOFF_MAX); alerts
+// still undelivered after ALERT_MAX_AGE_MS are dropped.
+
+// Tracker side: hands the alert to the uplink task, never blocks. Alerts
+// raised while WiFi is still associating (or reconnecting) are queued all
+// the same; serviceWebhookAlerts() holds them until it is up.
+void queueWebhookAlert(const BLEDeviceInfo& device) {
+  if (!wifiConfigured()) return;
+  if (strlen(ALERT_WEBHOOK_URL) == 0) return;
+  AlertEvent alert;
+  time_t now = time(nullptr);
+  alert.time = now >= VALID_TIME_EPOCH ? (uint32_t)now : 0;
+  alert.raisedMs = millis();
+  memcpy(alert.addr, device.addr, sizeof(alert.addr));
+  alert.rssi = device.rssi;
+  alert.deviceType = device.deviceType;
+  alert.manufacturer = device.manufacturer;
+  strlcpy(alert.name, deviceDisplayName(device), sizeof(alert.name));
+  if (xQueueSend(alertQueue, &alert, 0) != pdTRUE) {
+    alertQueueDropped++;
+  }
+}
+
+// Uplink task only: applies the per-device and global limits. Returns false
+// if the alert is held back.
+bool admitWebhookAlert(const AlertEvent& alert, unsigned long now) {
+  int recent = -1;
+  for (int i = 0; i < min(alertRecentCount, ALERT_RECENT_SIZE); i++) {
+    if (memcmp(alertRecentAddrs[i], alert.addr, sizeof(alert.addr)) == 0) {
+      recent = i;
+      break;
+    }
+  }
+  if (recent >= 0 && now - alertRecentMs[recent] < ALERT_DEVICE_INTERVAL) {
+    alertsLimitedDevice++;
+    return false;
+  }
 
-  HTTPClient http;
-  http.begin(ALERT_WEBHOOK_URL);
-  http.addHeader("Content-Type", "application/json");
+  // One token per 60000 / ALERT_RATE_PER_MIN ms, up to ALERT_RATE_BURST
+  const uint32_t refillMs = 60000 / ALERT_RATE_PER_MIN;
+  uint32_t earned = (now - alertTokensRefilled) / refillMs;
+  alertTokensRefilled += earned * refillMs;
+  alertTokens = min(alertTokens + earned, (uint32_t)ALERT_RATE_BURST);
+  if (alertTokens == ALERT_RATE_BURST) alertTokensRefilled = now;
+  if (alertTokens == 0) {
+    alertsLimitedGlobal++;
+    return false;
+  }
+  alertTokens--;
 
-  // Build JSON payload
-  StaticJsonDocument<512> doc;
-  doc["event"] = "unknown_device";
-  doc["mac"] = device.mac;
-  doc["name"] = device.name;
-  doc["rssi"] = device.rssi;
-  doc["device_type"] = device.deviceType;
-  doc["manufacturer"] = device.manufacturer;
-  doc["scanner_id"] = SCANNER_ID;
+  if (recent < 0) {
+    recent = alertRecentCount++ % ALERT_RECENT_SIZE;
+    memcpy(alertRecentAddrs[recent], alert.addr, sizeof(alert.addr));
+  }
+  alertRecentMs[recent] = now;
+  return true;
+}
 
-  // Add timestamp
-  struct tm timeinfo;
-  if (getLocalTime(&timeinfo)) {
+// Uplink task only: moves queued alerts into the batch while it has room,
+// then sends it once its window has closed
+void serviceWebhookAlerts() {
+  AlertEvent alert;
+  while (alertBatchCount < ALERT_BATCH_MAX && xQueueReceive(alertQueue, &alert, 0) == pdTRUE) {
+    unsigned long now = millis();
+    if (!admitWebhookAlert(alert, now)) continue;
+    if (alertBatchCount == 0) alertBatchStart = now;
+    alertBatch[alertBatchCount++] = alert;
+  }
+
+  // Alerts that waited out a long outage are no longer worth sending
+  unsigned long now = millis();
+  int expired = 0;
+  while (expired < alertBatchCount && now - alertBatch[expired].raisedMs >= ALERT_MAX_AGE_MS) expired++;
+  if (expired > 0) {
+    alertBatchCount -= expired;
+    memmove(alertBatch, alertBatch + expired, alertBatchCount * sizeof(AlertEvent));
+    alertsExpired += expired;
+    if (alertBatchCount > 0) alertBatchStart = now;
+  }
+
+  if (alertBatchCount == 0) return;
+  bool due = alertBatchCount == ALERT_BATCH_MAX || now - alertBatchStart >= ALERT_COALESCE_MS;
+  if (!due || WiFi.status() != WL_CONNECTED) return;
+  if (alertBackoffMs > 0 && now - alertLastAttempt < alertBackoffMs) return;
+
+  int done = postWebhookBatch();
+  if (done > 0) {
+    alertBatchCount -= done;
+    memmove(alertBatch, alertBatch + done, alertBatchCount * sizeof(AlertEvent));
+    alertBatchStart = millis();  // Whatever is left goes after a fresh window
+  }
+}
+
+// One alert's fields, as the webhook has always received them
+void fillWebhookAlert(JsonDocument& doc, const AlertEvent& alert) {
+  char mac[18];
+  formatMac(alert.addr, mac);
+  doc["mac"] = mac;
+  doc["name"] = alert.name;
+  doc["rssi"] = alert.rssi;
+  doc["device_type"] = deviceTypeName(alert.deviceType);
+  doc["manufacturer"] = manufacturerName(alert.manufacturer);
+  if (alert.time != 0) {
     char timeStr[25];
-    strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
+    time_t t = alert.time;
+    struct tm utc;
+    gmtime_r(&t, &utc);
+    strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%SZ", &utc);
     doc["timestamp"] = timeStr;
   }
+}
+
+// Webhook body for the leading alerts that fit in size; returns how many
+// were encoded and sets length. One alert is an unknown_device body, more
+// an unknown_devices body with a devices array.
+int encodeWebhookBody(const AlertEvent* alerts, int count, char* out, size_t size, size_t& length) {
+  if (count == 1) {
+    StaticJsonDocument<384> doc;
+    doc["event"] = "unknown_device";
+    fillWebhookAlert(doc, alerts[0]);
+    doc["scanner_id"] = SCANNER_ID;
+    if (measureJson(doc) + 1 > size) return 0;
+    length = serializeJson(doc, out, size);
+    return 1;
+  }
 
-  String payload;
-  serializeJson(doc, payload);
+  StaticJsonDocument<96> head;
+  head["event"] = "unknown_devices";
+  head["scanner_id"] = SCANNER_ID;
+  size_t used = serializeJson(head, out, size);
+  const char devicesKey[] = ",\"devices\":[";
+  if (used < 2 || used + sizeof(devicesKey) + 2 > size) return 0;
+  used--;  // Reopen the object over its closing brace
+  memcpy(out + used, devicesKey, sizeof(devicesKey) - 1);
+  used += sizeof(devicesKey) - 1;
+
+  int encoded = 0;
+  for (; encoded < count; encoded++) {
+    StaticJsonDocument<384> doc;
+    fillWebhookAlert(doc, alerts[encoded]);
+    // Separator, then room left for the closing "]}" and NUL
+    if (used + measureJson(doc) + 4 > size) break;
+    if (encoded > 0) out[used++] = ',';
+    used += serializeJson(doc, out + used, size - used);
+  }
+  if (encoded == 0) return 0;
+  out[used++] = ']';
+  out[used++] = '}';
+  out[used] = '\0';
+  length = used;
+  return encoded;
+}
 
-  int httpCode = http.POST(payload);
-  if (httpCode > 0) {
-    Serial.printf("Webhook sent, response: %d\n", httpCode);
-  } else {
-    Serial.printf("Webhook failed: %s\n", http.errorToString(httpCode).c_str());
+// Uplink task only. POSTs the oldest alerts of the batch and returns how
+// many are done with: delivered, or refused with a 4xx that a retry would
+// get again. 0 means the POST failed and the backoff grew.
+int postWebhookBatch() {
+  size_t length = 0;
+  int encoded = encodeWebhookBody(alertBatch, alertBatchCount, alertPayload, sizeof(alertPayload), length);
+  if (encoded == 0) return 0;
+
+  alertLastAttempt = millis();
+  bool reused = alertHttp.connected();
+  int httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+  if (alertHttp.begin(ALERT_WEBHOOK_URL)) {
+    alertHttp.setConnectTimeout(ALERT_TIMEOUT_MS);
+    alertHttp.setTimeout(ALERT_TIMEOUT_MS);
+    alertHttp.addHeader("Content-Type", "application/json");
+    httpCode = alertHttp.POST((uint8_t*)alertPayload, length);
+    alertHttp.end();  // Keeps the socket open when the server allows it
+  }
+  unsigned long now = millis();
+  alertLastStatus = httpCode;
+
+  if (httpCode <= 0 || httpCode == 429 || httpCode >= 500) {
+    alertPostsFailed++;
+    alertBackoffMs = constrain(alertBackoffMs * 2, (uint32_t)ALERT_BACKOFF_MIN, (uint32_t)ALERT_BACKOFF_MAX);
+    if (httpCode > 0) {
+      Serial.printf("Webhook: HTTP %d, retrying in %lu ms\n", httpCode, (unsigned long)alertBackoffMs);
+    } else {
+      Serial.printf("Webhook failed: %s, retrying in %lu ms\n", alertHttp.errorToString(httpCode).c_str(),
+                    (unsigned long)alertBackoffMs);
+    }
+    return 0;
+  }
+  alertBackoffMs = 0;
+  if (httpCode >= 300) {
+    alertsRejected += encoded;
+    Serial.printf("Webhook: HTTP %d, %d alert(s) dropped\n", httpCode, encoded);
+    return encoded;
   }
 
-  http.end();
+  alertPostsOk++;
+  if (reused) alertConnectionsReused++;
+  alertsSent += encoded;
+  if (encoded > alertMaxBatch) alertMaxBatch = encoded;
+  for (int i = 0; i < encoded; i++) {
+    uint32_t latency = now - alertBatch[i].raisedMs;
+    alertLatencyTotalMs += latency;
+    if (latency > alertMaxLatencyMs) alertMaxLatencyMs = latency;
+    alertLastLatencyMs = latency;
+  }
+  Serial.printf("Webhook sent: %d alert(s), HTTP %d, %lu ms after raised%s\n", encoded, httpCode,
+                (unsigned long)alertLastLatencyMs, reused ? ", connection reused" : "");
+  return encoded;
 }
 
 // ============================================================================
-// Server Log Posting
+// Server Uplink
 // ============================================================================
 
-void postLogsToServer() {
-  // Check if server URL is configured
-  if (strlen(BLE_SERVER_URL) == 0 || strcmp(BLE_SERVER_URL, "") == 0) return;
-  if (strlen(BLE_API_KEY) == 0 || strcmp(BLE_API_KEY, "CHANGE_ME_AFTER_DEPLOY") == 0) {
-    Serial.println("WARNING: BLE_API_KEY not configured - skipping server post");
+// New sightings go to the Go server's /api/logs (HandlePostLogs) in batches.
+// The tracker queues an UplinkRecord per sighting; the uplink task collects
+// them in uplinkBatch[] and posts a batch once it is full or UPLINK_INTERVAL
+// old. BLE and WiFi share the radio, so a post is only started in the gap
+// between scans (the tracker idles for SCAN_INTERVAL after each one) and its
+// timeouts end before the next scan is due. A continuous scan has no gap, so
+// posts share the radio with it (under the profile's window) and may take up
+// to UPLINK_CONTINUOUS_WINDOW. HTTPClient is kept between posts
+// with reuse on, so consecutive batches ride the same keep-alive connection.
+//
+// While WiFi is down or the server is failing (retries back off from
+// UPLINK_BACKOFF_MIN to UPLINK_BACKOFF_MAX), due batches are appended to
+// UPLINK_SPOOL_PATH on the SD card and posted oldest first once the server
+// answers again. UPLINK_SPOOL_POS_PATH records how much of the spool the
+// server has acknowledged, so a reboot resumes there; a post that succeeded
+// just before power was lost may be sent twice, never dropped.
+//
+// Bodies use the compact binary batch encoding of server/batch.go (packed
+// MAC, type/manufacturer/status codes, varint time deltas: 10-36 bytes a
+// sighting against ~180 as JSON), so one post can carry a whole spool
+// read of UPLINK_POST_MAX. A server that predates it answers 415 or (reading
+// the body as JSON) 400, and the uplink falls back to LogBatch JSON. A 415
+// holds for the rest of the boot. A 400 could equally be one batch the
+// server failed to decode, so binary is tried again after UPLINK_BINARY_REPROBE.
+
+// Both settings come from secrets.h
+bool uplinkConfigured() {
+  if (strlen(BLE_SERVER_URL) == 0) return false;
+  return strlen(BLE_API_KEY) > 0 && strcmp(BLE_API_KEY, "CHANGE_ME_AFTER_DEPLOY") != 0;
+}
+
+// Setup, after initSDCard(): picks up a spool left by the previous boot
+void initUplink() {
+  uplinkEnabled = uplinkConfigured();
+  if (!uplinkEnabled) {
+    Serial.println("Server uplink not configured (BLE_SERVER_URL / BLE_API_KEY)");
     return;
   }
+  uplinkHttp.setReuse(true);
+
+  if (sdCardPresent && SD.exists(UPLINK_SPOOL_PATH)) {
+    File spool = SD.open(UPLINK_SPOOL_PATH, FILE_READ);
+    if (spool) {
+      // A torn append is ignored here and overwritten by the next spill
+      uplinkSpoolRecords = spool.size() / sizeof(UplinkRecord);
+      spool.close();
+    }
+    File pos = SD.open(UPLINK_SPOOL_POS_PATH, FILE_READ);
+    if (pos) {
+      uint32_t sent = 0;
+      if (pos.read((uint8_t*)&sent, sizeof(sent)) == sizeof(sent) && sent <= uplinkSpoolRecords) {
+        uplinkSpoolSent = sent;
+      }
+      pos.close();
+    }
+  }
+  Serial.printf("Server uplink: %s, %lu spooled sightings pending\n", BLE_SERVER_URL,
+                (unsigned long)(uplinkSpoolRecords - uplinkSpoolSent));
+}
 
-  // Check WiFi status first
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi not connected - skipping server post");
-    return;
+// Tracker side: never blocks, a full queue drops the sighting
+void queueUplinkSighting(const BLEDeviceInfo& device) {
+  if (!uplinkEnabled) return;
+  UplinkRecord rec;
+  time_t now = time(nullptr);
+  rec.time = now >= VALID_TIME_EPOCH ? (uint32_t)now : 0;
+  memcpy(rec.addr, device.addr, sizeof(rec.addr));
+  rec.rssi = device.rssi;
+  rec.status = deviceLogStatus(device);
+  rec.deviceType = device.deviceType;
+  rec.manufacturer = device.manufacturer;
+  strlcpy(rec.name, device.name, sizeof(rec.name));
+  if (xQueueSend(uplinkQueue, &rec, 0) != pdTRUE) {
+    uplinkQueueDropped++;
   }
+}
 
-  Serial.printf("Server URL: %s\n", BLE_SERVER_URL);
-  Serial.printf("WiFi RSSI: %d dBm, Gateway: %s\n", WiFi.RSSI(), WiFi.gatewayIP().toString().c_str());
+// Uplink task only: moves queued sightings into the batch, spilling a full
+// batch to the card to make room
+void drainUplinkQueue() {
+  UplinkRecord rec;
+  while (xQueueReceive(uplinkQueue, &rec, 0) == pdTRUE) {
+    if (uplinkBatchCount == UPLINK_BATCH_MAX && !spillUplinkBatch()) {
+      uplinkRecordsDropped++;
+      continue;
+    }
+    if (uplinkBatchCount == 0) uplinkBatchStart = millis();
+    uplinkBatch[uplinkBatchCount++] = rec;
+  }
+}
 
-  // Stop BLE scan during POST (but don't deinit - that breaks reinit!)
-  Serial.println("Pausing BLE scan for HTTP POST...");
-  pBLEScan->stop();
-  delay(100);
+// Milliseconds until the tracker starts the next scan; 0 while one runs.
+// A continuous scan has no gap: WiFi shares the radio with it throughout,
+// as the profile's window allows.
+uint32_t scanGapRemaining() {
+  if (scanContinuous) return UPLINK_CONTINUOUS_WINDOW;
+  if (scanInProgress) return 0;
+  unsigned long idle = millis() - lastScanTime;
+  return idle < SCAN_INTERVAL ? SCAN_INTERVAL - idle : 0;
+}
 
-  Serial.printf("Free heap: %d bytes, Largest block: %d bytes\n", ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+// Uplink task only: posts at most one batch per call
+void serviceUplink() {
+  if (!uplinkEnabled) return;
+  unsigned long now = millis();
+  bool online = WiFi.status() == WL_CONNECTED &&
+                (uplinkBackoffMs == 0 || now - uplinkLastAttempt >= uplinkBackoffMs);
+  bool due = uplinkBatchCount == UPLINK_BATCH_MAX ||
+             (uplinkBatchCount > 0 && now - uplinkBatchStart >= UPLINK_INTERVAL);
+  bool spoolPending = uplinkSpoolSent < uplinkSpoolRecords;
+
+  // A due batch that can't go now, or would overtake the spool, joins the spool
+  if (due && (!online || spoolPending) && spillUplinkBatch()) {
+    due = false;
+    spoolPending = true;
+  }
+  if (!online || (!due && !spoolPending)) return;
+
+  uint32_t gap = scanGapRemaining();
+  if (gap < UPLINK_MIN_WINDOW) return;
+  uint32_t timeout = gap - UPLINK_GAP_MARGIN;
+
+  if (spoolPending) {
+    int count = readUplinkSpool(uplinkSendBuffer, UPLINK_POST_MAX);
+    if (count == 0) return;
+    int posted = postUplinkBatch(uplinkSendBuffer, count, timeout);
+    if (posted > 0) advanceUplinkSpool(posted);
+  } else {
+    int posted = postUplinkBatch(uplinkBatch, uplinkBatchCount, timeout);
+    if (posted > 0) {
+      uplinkBatchCount -= posted;
+      memmove(uplinkBatch, uplinkBatch + posted, uplinkBatchCount * sizeof(UplinkRecord));
+    }
+  }
+}
+
+// LogBatch JSON for HandlePostLogs. Encodes as many leading records as fit
+// in size and returns how many; length receives the body size. Timestamps
+// are UTC; records from before NTP synced go without one and the server
+// stamps them on arrival.
+int encodeUplinkJson(const UplinkRecord* records, int count, char* out, size_t size, size_t& length) {
+  StaticJsonDocument<64> head;
+  head["scanner_id"] = SCANNER_ID;
+  size_t used = serializeJson(head, out, size);
+  const char devicesKey[] = ",\"devices\":[";
+  if (used < 2 || used + sizeof(devicesKey) + 2 > size) return 0;
+  used--;  // Reopen the object over its closing brace
+  memcpy(out + used, devicesKey, sizeof(devicesKey) - 1);
+  used += sizeof(devicesKey) - 1;
+
+  int encoded = 0;
+  for (; encoded < count; encoded++) {
+    const UplinkRecord& rec = records[encoded];
+    StaticJsonDocument<384> doc;
+    if (rec.time != 0) {
+      char timeStr[25];
+      time_t t = rec.time;
+      struct tm utc;
+      gmtime_r(&t, &utc);
+      strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%SZ", &utc);
+      doc["timestamp"] = timeStr;
+    }
+    char mac[18];
+    formatMac(rec.addr, mac);
+    doc["mac"] = mac;
+    doc["name"] = rec.name[0] ? rec.name : "Unknown";
+    doc["rssi"] = rec.rssi;
+    doc["device_type"] = deviceTypeName(rec.deviceType);
+    doc["status"] = LOG_STATUS_NAMES[rec.status & LOG_STATUS_MASK];
+    doc["manufacturer"] = manufacturerName(rec.manufacturer);
+
+    // Separator, then room left for the closing "]}" and NUL
+    if (used + measureJson(doc) + 4 > size) break;
+    if (encoded > 0) out[used++] = ',';
+    used += serializeJson(doc, out + used, size - used);
+  }
+  if (encoded == 0) return 0;
+  out[used++] = ']';
+  out[used++] = '}';
+  out[used] = '\0';
+  length = used;
+  return encoded;
+}
+
+// Same contract as encodeUplinkJson(), in the BinaryBatchContentType layout
+// (all little endian):
+//   header: version, scanner ID length + bytes, u32 base time, u16 count
+//   record: flags (status | UPLINK_FLAG_*), addr[6], rssi, deviceType,
+//           manufacturer, [zigzag varint seconds since the previous
+//           timestamped record, or the base time], [name length + bytes]
+int encodeUplinkBinary(const UplinkRecord* records, int count, uint8_t* out, size_t size, size_t& length) {
+  size_t idLength = min(strlen(SCANNER_ID), (size_t)UINT8_MAX);
+  if (size < 8 + idLength) return 0;
+  uint32_t lastTime = 0;
+  for (int i = 0; i < count && lastTime == 0; i++) lastTime = records[i].time;
+
+  size_t used = 0;
+  out[used++] = UPLINK_BINARY_VERSION;
+  out[used++] = idLength;
+  memcpy(out + used, SCANNER_ID, idLength);
+  used += idLength;
+  memcpy(out + used, &lastTime, sizeof(lastTime));
+  used += sizeof(lastTime);
+  size_t countAt = used;
+  used += sizeof(uint16_t);
+
+  int encoded = 0;
+  for (; encoded < count && encoded < UINT16_MAX; encoded++) {
+    const UplinkRecord& rec = records[encoded];
+    size_t nameLength = strnlen(rec.name, sizeof(rec.name) - 1);
+    if (used + UPLINK_BINARY_RECORD_MAX > size) break;
+
+    uint8_t flags = rec.status & LOG_STATUS_MASK;
+    if (rec.time != 0) flags |= UPLINK_FLAG_TIME;
+    if (nameLength > 0) flags |= UPLINK_FLAG_NAME;
+    out[used++] = flags;
+    memcpy(out + used, rec.addr, sizeof(rec.addr));
+    used += sizeof(rec.addr);
+    out[used++] = (uint8_t)rec.rssi;
+    out[used++] = rec.deviceType;
+    out[used++] = rec.manufacturer;
+    if (rec.time != 0) {
+      int32_t delta = (int32_t)(rec.time - lastTime);
+      uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+      do {
+        out[used++] = (zigzag & 0x7F) | (zigzag > 0x7F ? 0x80 : 0);
+        zigzag >>= 7;
+      } while (zigzag);
+      lastTime = rec.time;
+    }
+    if (nameLength > 0) {
+      out[used++] = nameLength;
+      memcpy(out + used, rec.name, nameLength);
+      used += nameLength;
+    }
+  }
+  if (encoded == 0) return 0;
+  uint16_t encodedCount = encoded;
+  memcpy(out + countAt, &encodedCount, sizeof(encodedCount));
+  length = used;
+  return encoded;
+}
 
-  // Build JSON payload using StaticJsonDocument (stack, not heap)
-  // Limit to 10 devices max to keep payload small
-  int devicesToSend = min(deviceCount, 10);
-  StaticJsonDocument<2048> doc;
-  doc["scanner_id"] = SCANNER_ID;
+// Uplink task only. Posts up to count records, with connect and response
+// timeouts of timeoutMs, and returns how many the server accepted (0 on
+// failure, which also extends the backoff).
+int postUplinkBatch(const UplinkRecord* records, int count, uint32_t timeoutMs) {
+  size_t length = 0;
+  if (!uplinkBinary && uplinkBinaryReprobe && millis() - uplinkBinaryOffAt >= UPLINK_BINARY_REPROBE) {
+    Serial.println("Uplink: trying the binary encoding again");
+    uplinkBinary = true;
+  }
+  bool binary = uplinkBinary;
+  int encoded = binary ? encodeUplinkBinary(records, count, uplinkPayload, sizeof(uplinkPayload), length)
+                       : encodeUplinkJson(records, count, (char*)uplinkPayload, sizeof(uplinkPayload), length);
+  if (encoded == 0) return 0;
+
+  uplinkLastAttempt = millis();
+  bool reused = uplinkHttp.connected();
+  int httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+  if (uplinkHttp.begin(BLE_SERVER_URL)) {
+    uplinkHttp.setConnectTimeout(timeoutMs);
+    uplinkHttp.setTimeout(timeoutMs);
+    uplinkHttp.addHeader("Content-Type", binary ? UPLINK_BINARY_TYPE : "application/json");
+    uplinkHttp.addHeader("Authorization", String("Bearer ") + BLE_API_KEY);
+    httpCode = uplinkHttp.POST(uplinkPayload, length);
+    uplinkHttp.end();  // Keeps the socket open when the server allows it
+  }
+  uint32_t latency = millis() - uplinkLastAttempt;
+  uplinkLastStatus = httpCode;
+
+  // An older server reads every body as JSON; retry as JSON right away
+  if (binary && (httpCode == 400 || httpCode == 415)) {
+    Serial.printf("Uplink: server turned down the binary encoding (HTTP %d), using JSON%s\n", httpCode,
+                  httpCode == 400 ? " for now" : "");
+    uplinkBinary = false;
+    uplinkBinaryReprobe = httpCode == 400;
+    uplinkBinaryOffAt = millis();
+    postFailCount++;
+    return 0;
+  }
 
-  struct tm timeinfo;
-  if (getLocalTime(&timeinfo)) {
-    char timeStr[25];
-    strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
-    doc["timestamp"] = timeStr;
+  if (httpCode < 200 || httpCode >= 300) {
+    postFailCount++;
+    uplinkBackoffMs = constrain(uplinkBackoffMs * 2, (uint32_t)UPLINK_BACKOFF_MIN, (uint32_t)UPLINK_BACKOFF_MAX);
+    if (httpCode > 0) {
+      Serial.printf("Uplink: HTTP %d, retrying in %lu ms\n", httpCode, (unsigned long)uplinkBackoffMs);
+    } else {
+      Serial.printf("Uplink: %s, retrying in %lu ms\n", uplinkHttp.errorToString(httpCode).c_str(),
+                    (unsigned long)uplinkBackoffMs);
+    }
+    return 0;
   }
 
-  JsonArray devicesArray = doc.createNestedArray("devices");
+  postSuccessCount++;
+  uplinkBackoffMs = 0;
+  if (reused) uplinkConnectionsReused++;
+  uplinkRecordsSent += encoded;
+  uplinkBytesSent += length;
+  uplinkLastBatch = encoded;
+  if (encoded > uplinkMaxBatch) uplinkMaxBatch = encoded;
+  uplinkLastLatencyMs = latency;
+  if (latency > uplinkMaxLatencyMs) uplinkMaxLatencyMs = latency;
+  Serial.printf("Uplink: posted %d sightings (%u bytes) in %lu ms%s\n", encoded, (unsigned)length,
+                (unsigned long)latency, reused ? ", connection reused" : "");
+  return encoded;
+}
 
-  for (int i = 0; i < devicesToSend; i++) {
-    JsonObject devObj = devicesArray.createNestedObject();
-    devObj["mac"] = devices[i].mac;
-    devObj["name"] = devices[i].name;
-    devObj["rssi"] = devices[i].rssi;
-    devObj["type"] = devices[i].deviceType;
-    devObj["status"] = devices[i].isKnown ? "known" : (devices[i].isNew ? "new" : "unknown");
+// Uplink task only: appends the whole batch to the spool. Writes start at the
+// last whole record, so a torn append from a power loss is overwritten.
+bool spillUplinkBatch() {
+  if (!sdCardPresent || uplinkBatchCount == 0) return false;
+  if (uplinkSpoolRecords + uplinkBatchCount > UPLINK_SPOOL_MAX) return false;
+
+  ScopedLock lock(sdMutex);
+  File spool = uplinkSpoolRecords > 0 ? SD.open(UPLINK_SPOOL_PATH, "r+") : File();
+  if (!spool) {
+    // Nothing usable on the card: start over
+    spool = SD.open(UPLINK_SPOOL_PATH, FILE_WRITE);
+    uplinkSpoolRecords = 0;
+    uplinkSpoolSent = 0;
+    SD.remove(UPLINK_SPOOL_POS_PATH);
   }
+  if (!spool) return false;
+
+  size_t bytes = uplinkBatchCount * sizeof(UplinkRecord);
+  bool ok = spool.seek(uplinkSpoolRecords * sizeof(UplinkRecord)) &&
+            spool.write((const uint8_t*)uplinkBatch, bytes) == bytes;
+  spool.close();
+  if (!ok) {
+    logWriteErrors++;
+    return false;
+  }
+  uplinkSpoolRecords += uplinkBatchCount;
+  uplinkRecordsSpooled += uplinkBatchCount;
+  uplinkBatchCount = 0;
+  return true;
+}
 
-  // Serialize to stack-allocated buffer
-  char payload[2048];
-  serializeJson(doc, payload, sizeof(payload));
-
-  Serial.printf("Posting %d devices to server (payload: %d bytes)...\n", devicesToSend, strlen(payload));
+// Uplink task only: reads up to max of the oldest unsent spool records
+int readUplinkSpool(UplinkRecord* out, int max) {
+  ScopedLock lock(sdMutex);
+  File spool = SD.open(UPLINK_SPOOL_PATH, FILE_READ);
+  if (!spool) {
+    // Card pulled or file removed: the backlog is gone
+    Serial.println("Uplink: spool unreadable, discarding it");
+    uplinkRecordsDropped += uplinkSpoolRecords - uplinkSpoolSent;
+    uplinkSpoolRecords = 0;
+    uplinkSpoolSent = 0;
+    return 0;
+  }
+  int count = min((uint32_t)max, uplinkSpoolRecords - uplinkSpoolSent);
+  int read = 0;
+  if (spool.seek(uplinkSpoolSent * sizeof(UplinkRecord))) {
+    read = spool.read((uint8_t*)out, count * sizeof(UplinkRecord)) / sizeof(UplinkRecord);
+  }
+  spool.close();
+  return read;
+}
 
-  // Use plain HTTP (no SSL) to avoid memory fragmentation issues
-  HTTPClient http;
-  if (!http.begin(BLE_SERVER_URL)) {
-    Serial.println("http.begin() failed!");
+// Uplink task only: marks count more spool records as accepted, removing
+// the spool once it has all been posted
+void advanceUplinkSpool(int count) {
+  ScopedLock lock(sdMutex);
+  uplinkSpoolSent += count;
+  if (uplinkSpoolSent >= uplinkSpoolRecords) {
+    SD.remove(UPLINK_SPOOL_PATH);
+    SD.remove(UPLINK_SPOOL_POS_PATH);
+    uplinkSpoolRecords = 0;
+    uplinkSpoolSent = 0;
     return;
   }
+  File pos = SD.open(UPLINK_SPOOL_POS_PATH, FILE_WRITE);
+  if (pos) {
+    pos.write((const uint8_t*)&uplinkSpoolSent, sizeof(uplinkSpoolSent));
+    pos.close();
+  }
+}
 
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Authorization", String("Bearer ") + BLE_API_KEY);
-  http.setTimeout(15000);
+// ============================================================================
+// Metrics
+// ============================================================================
 
-  int httpCode = http.POST(payload);
-  if (httpCode == 200) {
-    Serial.printf("Server post OK: %d devices sent\n", deviceCount);
-  } else if (httpCode > 0) {
-    Serial.printf("Server post failed: HTTP %d\n", httpCode);
-    Serial.printf("Response: %s\n", http.getString().c_str());
-  } else {
-    Serial.printf("Server post error code: %d (%s)\n", httpCode, http.errorToString(httpCode).c_str());
+// Closes the metrics interval ending now into metricsRing, overwriting the
+// oldest sample. Called by the tracker with deviceMutex held.
+void recordMetricsSample(unsigned long now, unsigned long elapsed, uint32_t adverts) {
+  MetricsSample& sample = metricsRing[metricsSamples % METRICS_HISTORY];
+  sample.timeMs = now;
+  sample.intervalMs = elapsed;
+  sample.adverts = adverts;
+  sample.uniqueDevices = 0;
+  for (int i = 0; i < deviceCount; i++) {
+    if (now - deviceAt(i).lastSeen <= elapsed) sample.uniqueDevices++;
   }
+  uint32_t dropped = ingestDropped;
+  sample.ingestDropped = dropped - metricsDroppedMark;
+  metricsDroppedMark = dropped;
+  sample.evicted = devicesEvicted - metricsEvictedMark;
+  metricsEvictedMark = devicesEvicted;
+  sample.rotated = addressRotations - metricsRotatedMark;
+  metricsRotatedMark = addressRotations;
+
+  sample.classified = metricsWindow.classified.exchange(0);
+  uint32_t classifyUs = metricsWindow.classifyUs.exchange(0);
+  sample.classifyAvgUs = sample.classified ? classifyUs / sample.classified : 0;
+  sample.classifyMaxUs = metricsWindow.classifyMaxUs.exchange(0);
+  sample.sdFlushMaxUs = metricsWindow.sdFlushMaxUs.exchange(0);
+  sample.frameMaxUs = metricsWindow.frameMaxUs.exchange(0);
+  sample.httpRequests = metricsWindow.httpRequests.exchange(0);
+  sample.httpMaxUs = metricsWindow.httpMaxUs.exchange(0);
+  sample.loopMaxUs = metricsWindow.loopMaxUs.exchange(0);
+  sample.freeHeap = ESP.getFreeHeap();
+  sample.largestBlock = ESP.getMaxAllocHeap();
+  metricsSamples++;
+}
 
-  http.end();
-
-  // BLE scan will restart automatically on next loop iteration
-  Serial.println("POST complete, BLE scan will resume.");
+// Raises an interval maximum; several tasks may report into the same one
+void noteMetricMax(std::atomic<uint32_t>& max, uint32_t value) {
+  uint32_t seen = max.load();
+  while (value > seen && !max.compare_exchange_weak(seen, value)) {
+  }
 }
 
 // ============================================================================
 // Web Server Functions
 // ============================================================================
 
+// Routes run on esp_http_server, which keeps connections alive and serves
+// up to WEB_MAX_SOCKETS of them. Quick routes run on its task; the ones that
+// stream (listings, downloads, /status) are handed to WEB_WORKERS worker
+// tasks as async requests, so one slow transfer doesn't stall the rest.
 void initWebServer() {
   Serial.println("=== Web Server Debug ===");
 
-  server.on("/", handleRoot);
-  Serial.println("  Route added: /");
-
-  server.on("/logs", handleListLogs);
-  Serial.println("  Route added: /logs");
-
-  server.on("/download", handleDownloadLog);
-  Serial.println("  Route added: /download");
-
-  server.on("/status", handleStatus);
-  Serial.println("  Route added: /status");
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.core_id = APP_CORE;
+  config.max_uri_handlers = WEB_MAX_ROUTES;
+  config.task_priority = WEB_TASK_PRIORITY;
+  config.stack_size = HTTPD_TASK_STACK;
+  config.max_open_sockets = WEB_MAX_SOCKETS;
+  if (httpd_start(&webServer, &config) != ESP_OK) {
+    Serial.println("  httpd_start() failed!");
+    return;
+  }
 
-  server.begin();
+  struct Route {
+    const char* uri;
+    WebHandler handler;
+    bool worker;                  // Streams: run on a web worker
+    httpd_method_t method;
+  };
+  const Route routes[] = {
+    {"/", handleRoot, false, HTTP_GET},
+    {"/logs", handleListLogs, true, HTTP_GET},
+    {"/download", handleDownloadLog, true, HTTP_GET},
+    {"/status", handleStatus, true, HTTP_GET},
+    {"/events", handleLiveEvents, false, HTTP_GET},
+    {"/scan", handleScanSettings, false, HTTP_GET},
+    {"/scan", handleScanSettings, false, HTTP_POST},
+    {"/whitelist", handleWhitelistImport, true, HTTP_POST},
+    {"/metrics", handleMetrics, true, HTTP_GET},
+  };
+  for (const Route& route : routes) {
+    httpd_uri_t uri = {};
+    uri.uri = route.uri;
+    uri.method = route.method;
+    uri.handler = route.worker ? queueWebRequest : runWebRequest;
+    uri.user_ctx = (void*)route.handler;
+    httpd_register_uri_handler(webServer, &uri);
+    Serial.printf("  Route added: %s %s%s\n", route.method == HTTP_POST ? "POST" : "GET",
+                  route.uri, route.worker ? " (worker)" : "");
+  }
 
   IPAddress ip = WiFi.localIP();
   Serial.println("=== Web Server Started ===");
   Serial.printf("  URL: http://%d.%d.%d.%d/\n", ip[0], ip[1], ip[2], ip[3]);
-  Serial.printf("  Listening on port 80\n");
+  Serial.printf("  Listening on port %d, %d connections, %d workers\n",
+                config.server_port, WEB_MAX_SOCKETS, WEB_WORKERS);
+}
+
+esp_err_t runWebRequest(httpd_req_t* req) {
+  serveWebRequest(req);
+  return ESP_OK;
+}
+
+// Runs a route's handler, on the httpd task or a worker, and times it
+void serveWebRequest(httpd_req_t* req) {
+  uint32_t start = micros();
+  ((WebHandler)req->user_ctx)(req);
+  uint32_t elapsed = micros() - start;
+  webRequestsHandled++;
+  metricsWindow.httpRequests++;
+  noteMetricMax(metricsWindow.httpMaxUs, elapsed);
+}
+
+// Hands the request to a web worker. With every worker busy and the queue
+// full the client is told to retry rather than left waiting.
+esp_err_t queueWebRequest(httpd_req_t* req) {
+  httpd_req_t* copy;
+  if (uxQueueSpacesAvailable(webQueue) == 0 ||
+      httpd_req_async_handler_begin(req, &copy) != ESP_OK) {
+    webRequestsRejected++;
+    httpd_resp_set_hdr(req, "Retry-After", "1");
+    sendResponse(req, "503 Service Unavailable", "text/plain", "Server busy");
+    return ESP_OK;
+  }
+  xQueueSend(webQueue, &copy, 0);  // Only this task enqueues, so there is room
+  webRequestsQueued++;
+  return ESP_OK;
+}
+
+// Copies query parameter name, URL-decoded, into value; false if absent
+bool findQueryArg(httpd_req_t* req, const char* name, char* value, size_t size) {
+  char query[WEB_QUERY_MAX];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return false;
+  if (httpd_query_key_value(query, name, value, size) != ESP_OK) return false;
+  urlDecode(value);
+  return true;
+}
+
+bool hasQueryArg(httpd_req_t* req, const char* name) {
+  char value[WEB_QUERY_MAX];
+  return findQueryArg(req, name, value, sizeof(value));
+}
+
+// Query parameter value, or "" if absent
+String queryArg(httpd_req_t* req, const char* name) {
+  char value[WEB_QUERY_MAX];
+  if (!findQueryArg(req, name, value, sizeof(value))) return String();
+  return String(value);
+}
+
+// Decodes %XX escapes and '+' in place
+void urlDecode(char* text) {
+  char* out = text;
+  for (const char* in = text; *in; in++) {
+    if (*in == '+') {
+      *out++ = ' ';
+    } else if (in[0] == '%' && isxdigit((uint8_t)in[1]) && isxdigit((uint8_t)in[2])) {
+      char hex[3] = {in[1], in[2], '\0'};
+      *out++ = (char)strtol(hex, nullptr, 16);
+      in += 2;
+    } else {
+      *out++ = *in;
+    }
+  }
+  *out = '\0';
 }
 
-void handleRoot() {
+void sendResponse(httpd_req_t* req, const char* status, const char* contentType, const char* body) {
+  httpd_resp_set_status(req, status);
+  httpd_resp_set_type(req, contentType);
+  httpd_resp_sendstr(req, body);
+}
+
+void handleRoot(httpd_req_t* req) {
   Serial.println("Web request: /");
-  server.sendHeader("Connection", "close");
   String html = "<!DOCTYPE html><html><head><title>BLE Scanner</title>";
   html += "<style>body{font-family:monospace;background:#111;color:#0f0;padding:20px;}";
   html += "a{color:#0ff;}h1{color:#fff;}pre{background:#222;padding:10px;}</style></head>";
@@ -1469,99 +6485,665 @@ void handleRoot() {
   html += "<li><a href='/logs'>/logs</a> - List available log files (JSON)</li>";
   html += "<li><a href='/download?file=FILENAME'>/download?file=FILENAME</a> - Download a log file</li>";
   html += "<li><a href='/status'>/status</a> - Current scanner status (JSON)</li>";
+  html += "<li><a href='/events'>/events</a> - Live event feed (server-sent events)</li>";
+  html += "<li><a href='/scan'>/scan</a> - Scan mode, profile and adverts/s per profile (JSON; POST ?mode=&amp;profile=&amp;active= to switch)</li>";
   html += "</ul></body></html>";
-  server.send(200, "text/html", html);
+  sendResponse(req, "200 OK", "text/html", html.c_str());
+}
+
+// Profile index for name, or -1
+int parseScanProfile(const char* name) {
+  for (int p = 0; p < PROFILE_COUNT; p++) {
+    if (strcmp(name, SCAN_PROFILES[p].name) == 0) return p;
+  }
+  return -1;
+}
+
+// GET reports the scan settings and adverts/s per profile and mode; POST
+// ?mode=continuous|cycle, ?profile=NAME and/or ?active=off|on|adaptive
+// queues a switch, which the tracker applies on its next pass. The reply
+// shows the requested settings.
+void handleScanSettings(httpd_req_t* req) {
+  Serial.println("Web request: /scan");
+
+  bool continuous = scanContinuous;
+  int profile = scanProfile;
+  int active = activeScanMode;
+  int eviction = evictionPolicy;
+  if (req->method == HTTP_POST) {
+    char value[24];
+    if (findQueryArg(req, "mode", value, sizeof(value))) {
+      if (strcmp(value, "continuous") != 0 && strcmp(value, "cycle") != 0) {
+        sendResponse(req, "400 Bad Request", "text/plain", "mode must be 'continuous' or 'cycle'");
+        return;
+      }
+      continuous = strcmp(value, "continuous") == 0;
+    }
+    if (findQueryArg(req, "profile", value, sizeof(value))) {
+      profile = parseScanProfile(value);
+      if (profile < 0) {
+        sendResponse(req, "400 Bad Request", "text/plain", "Unknown profile");
+        return;
+      }
+    }
+    if (findQueryArg(req, "active", value, sizeof(value))) {
+      active = -1;
+      for (int a = 0; a < ACTIVE_MODE_COUNT; a++) {
+        if (strcmp(value, ACTIVE_SCAN_MODE_NAMES[a]) == 0) active = a;
+      }
+      if (active < 0) {
+        sendResponse(req, "400 Bad Request", "text/plain", "active must be 'off', 'on' or 'adaptive'");
+        return;
+      }
+    }
+    if (findQueryArg(req, "eviction", value, sizeof(value))) {
+      eviction = parseEvictionPolicy(value);
+      if (eviction < 0) {
+        sendResponse(req, "400 Bad Request", "text/plain",
+                     "eviction must be 'rssi', 'lru', 'priority' or 'weighted'");
+        return;
+      }
+    }
+    requestedScanMode = continuous ? 1 : 0;
+    requestedScanProfile = profile;
+    requestedActiveMode = active;
+    requestedEvictionPolicy = eviction;
+    xTaskNotifyGive(trackerTask);
+  }
+
+  StaticJsonDocument<2048> doc;
+  doc["mode"] = continuous ? "continuous" : "cycle";
+  doc["profile"] = SCAN_PROFILES[profile].name;
+  doc["interval_ms"] = SCAN_PROFILES[profile].intervalMs;
+  doc["window_ms"] = SCAN_PROFILES[profile].windowMs;
+  doc["adverts_per_sec"] = scanAdvertRate;
+  doc["eviction"] = EVICTION_POLICY_NAMES[eviction];
+
+  // Passive vs active advert rates (gain = passive rate / active rate) and
+  // how long unresolved devices took to get a name and type in each phase
+  JsonObject activeScan = doc.createNestedObject("active_scan");
+  activeScan["mode"] = ACTIVE_SCAN_MODE_NAMES[active];
+  activeScan["sending_requests"] = scanActive;
+  activeScan["bursts"] = activeBurstCount;
+  activeScan["unresolved"] = unresolvedCount;
+  activeScan["burst_candidates"] = activeCandidates;
+  double phaseRate[2];
+  for (int a = 0; a < 2; a++) {
+    const ScanProfileStats& stats = scanPhaseStats[a];
+    const ResolveStats& resolved = resolveStats[a];
+    phaseRate[a] = stats.activeMs > 0 ? stats.adverts * 1000.0 / stats.activeMs : 0.0;
+    JsonObject phase = activeScan.createNestedObject(a ? "active" : "passive");
+    phase["adverts"] = stats.adverts;
+    phase["seconds"] = (uint32_t)(stats.activeMs / 1000);
+    phase["adverts_per_sec"] = phaseRate[a];
+    phase["resolved"] = resolved.count;
+    phase["avg_resolve_ms"] = resolved.count > 0 ? (uint32_t)(resolved.totalMs / resolved.count) : 0;
+    phase["max_resolve_ms"] = resolved.maxMs;
+  }
+  if (phaseRate[0] > 0 && phaseRate[1] > 0) activeScan["advert_rate_gain"] = phaseRate[0] / phaseRate[1];
+
+  // Totals lag by up to one housekeeping pass for the active combination
+  JsonArray profiles = doc.createNestedArray("profiles");
+  for (int p = 0; p < PROFILE_COUNT; p++) {
+    JsonObject entry = profiles.createNestedObject();
+    entry["name"] = SCAN_PROFILES[p].name;
+    entry["interval_ms"] = SCAN_PROFILES[p].intervalMs;
+    entry["window_ms"] = SCAN_PROFILES[p].windowMs;
+    for (int m = 0; m < 2; m++) {
+      const ScanProfileStats& stats = scanProfileStats[p][m];
+      JsonObject mode = entry.createNestedObject(m ? "continuous" : "cycle");
+      mode["adverts"] = stats.adverts;
+      mode["seconds"] = (uint32_t)(stats.activeMs / 1000);
+      mode["adverts_per_sec"] = stats.activeMs > 0 ? stats.adverts * 1000.0 / stats.activeMs : 0.0;
+    }
+  }
+
+  String json;
+  serializeJson(doc, json);
+  sendResponse(req, "200 OK", "application/json", json.c_str());
+}
+
+// POST /whitelist?mode=merge|replace with a whitelist.json body. The body
+// is spooled to SPIFFS and streamed into a fresh index (seeded with the
+// current one when merging), which is swapped in under deviceMutex so the
+// tracker never sees a half-built list. Tracked devices are re-checked, then
+// the file is compacted with the imported names taking precedence.
+void handleWhitelistImport(httpd_req_t* req) {
+  Serial.println("Web request: POST /whitelist");
+
+  char mode[16] = "merge";
+  findQueryArg(req, "mode", mode, sizeof(mode));
+  bool replace = strcmp(mode, "replace") == 0;
+  if (!replace && strcmp(mode, "merge") != 0) {
+    sendResponse(req, "400 Bad Request", "text/plain", "mode must be 'merge' or 'replace'");
+    return;
+  }
+  if (req->content_len == 0) {
+    sendResponse(req, "400 Bad Request", "text/plain", "Body is empty");
+    return;
+  }
+  if (req->content_len > WHITELIST_IMPORT_MAX) {
+    char message[48];
+    snprintf(message, sizeof(message), "Body must be at most %d bytes", WHITELIST_IMPORT_MAX);
+    sendResponse(req, "413 Payload Too Large", "text/plain", message);
+    return;
+  }
+
+  unsigned long start = millis();
+  ScopedLock whitelistLock(whitelistMutex);
+
+  // Spool the body. Receive timeouts are retried only until the deadline, so a
+  // stalled client can't keep a web worker and whitelistMutex (which touch
+  // edits wait on) for good.
+  File file = SPIFFS.open(WHITELIST_IMPORT_PATH, "w");
+  if (!file) {
+    sendResponse(req, "500 Internal Server Error", "text/plain", "Failed to open import file");
+    return;
+  }
+  char buffer[1024];
+  size_t remaining = req->content_len;
+  bool received = true;
+  unsigned long receiveStart = millis();
+  while (remaining > 0 && received) {
+    int n = httpd_req_recv(req, buffer, min(remaining, sizeof(buffer)));
+    if (n == HTTPD_SOCK_ERR_TIMEOUT && millis() - receiveStart < WHITELIST_IMPORT_DEADLINE_MS) continue;
+    received = n > 0 && file.write((const uint8_t*)buffer, n) == (size_t)n;
+    remaining -= received ? n : 0;
+  }
+  file.close();
+  if (!received) {
+    SPIFFS.remove(WHITELIST_IMPORT_PATH);
+    sendResponse(req, "400 Bad Request", "text/plain", "Failed to receive body");
+    return;
+  }
+
+  // Build the new index off to the side
+  uint8_t (*addrs)[6] = (uint8_t (*)[6])malloc(WHITELIST_MAX * 6);
+  if (!addrs) {
+    SPIFFS.remove(WHITELIST_IMPORT_PATH);
+    sendResponse(req, "503 Service Unavailable", "text/plain", "Out of memory");
+    return;
+  }
+  uint8_t ouis[WHITELIST_OUI_MAX][3];
+  int count = 0;
+  int ouiCount = 0;
+  if (!replace) {
+    memcpy(addrs, whitelistAddrs, whitelistCount * 6);
+    memcpy(ouis, whitelistOuis, whitelistOuiCount * 3);
+    count = whitelistCount;
+    ouiCount = whitelistOuiCount;
+  }
+  int before = count + ouiCount;
+  // Nothing of a body that doesn't parse in full is taken
+  int badEntries = 0;
+  int skipped = readWhitelistFile(WHITELIST_IMPORT_PATH, addrs, count, ouis, ouiCount, badEntries);
+  if (skipped < 0 || badEntries > 0) {
+    free(addrs);
+    SPIFFS.remove(WHITELIST_IMPORT_PATH);
+    char message[64];
+    if (skipped < 0) {
+      strlcpy(message, "Body has no \"devices\" array, or it breaks off", sizeof(message));
+    } else {
+      snprintf(message, sizeof(message), "Body entries that don't parse: %d", badEntries);
+    }
+    sendResponse(req, "400 Bad Request", "text/plain", message);
+    return;
+  }
+  int imported = count + ouiCount - before;
+  count = sortWhitelistAddrs(addrs, count);
+
+  int changed;
+  {
+    ScopedLock lock(deviceMutex);
+    memcpy(whitelistAddrs, addrs, count * 6);
+    memcpy(whitelistOuis, ouis, ouiCount * 3);
+    whitelistCount = count;
+    whitelistOuiCount = ouiCount;
+    changed = refreshKnownDevices();
+  }
+  free(addrs);
+  if (replace) whitelistIncomplete = false;  // The new index no longer rests on the old file
+  if (changed > 0) xTaskNotifyGive(displayTask);
+
+  bool saved = compactWhitelist(WHITELIST_IMPORT_PATH);
+  SPIFFS.remove(WHITELIST_IMPORT_PATH);
+  whitelistImports++;
+  Serial.printf("Whitelist import (%s): %d entries read, %d skipped, %d devices changed\n",
+                mode, imported, skipped, changed);
+
+  StaticJsonDocument<256> doc;
+  doc["mode"] = mode;
+  doc["imported"] = imported;
+  doc["skipped"] = skipped;
+  doc["whitelist_count"] = whitelistCount;
+  doc["whitelist_oui_rules"] = whitelistOuiCount;
+  doc["devices_changed"] = changed;
+  doc["saved"] = saved;
+  doc["elapsed_ms"] = millis() - start;
+  String json;
+  serializeJson(doc, json);
+  sendResponse(req, saved ? "200 OK" : "500 Internal Server Error", "application/json", json.c_str());
+}
+
+// Reads an integer query parameter, clamped to >= 0
+int pageArg(httpd_req_t* req, const char* name, int fallback) {
+  char value[16];
+  if (!findQueryArg(req, name, value, sizeof(value))) return fallback;
+  return max(0L, strtol(value, nullptr, 10));
 }
 
-void handleListLogs() {
+// Prints an object's members without the enclosing braces, so a streamed
+// response can continue the same object
+void printJsonMembers(Print& out, JsonObjectConst members) {
+  bool first = true;
+  for (JsonPairConst member : members) {
+    if (!first) out.print(',');
+    first = false;
+    out.printf("\"%s\":", member.key().c_str());
+    serializeJson(member.value(), out);
+  }
+}
+
+// Streams the log directory: ?offset=N&limit=N page through the entries
+// (default all). next_offset is present when more entries follow.
+void handleListLogs(httpd_req_t* req) {
   Serial.println("Web request: /logs");
-  server.sendHeader("Connection", "close");
 
   if (!sdCardPresent) {
-    server.send(503, "application/json", "{\"error\":\"SD card not present\"}");
+    sendResponse(req, "503 Service Unavailable", "application/json", "{\"error\":\"SD card not present\"}");
     return;
   }
 
-  StaticJsonDocument<2048> doc;
-  JsonArray files = doc.createNestedArray("files");
+  int offset = pageArg(req, "offset", 0);
+  int limit = pageArg(req, "limit", INT_MAX);
 
-  File root = SD.open("/ble-logs");
-  if (!root || !root.isDirectory()) {
-    server.send(404, "application/json", "{\"error\":\"Log directory not found\"}");
-    return;
+  File root;
+  {
+    ScopedLock lock(sdMutex);
+
+    // Report current sizes for the open log
+    flushLogBuffer(true);
+
+    root = SD.open(LOG_DIR);
+    if (!root || !root.isDirectory()) {
+      sendResponse(req, "404 Not Found", "application/json", "{\"error\":\"Log directory not found\"}");
+      return;
+    }
   }
 
-  File file = root.openNextFile();
-  while (file) {
-    if (!file.isDirectory()) {
-      JsonObject fileObj = files.createNestedObject();
-      fileObj["name"] = String(file.name());
-      fileObj["size"] = file.size();
+  ChunkedResponse out(req, "200 OK", "application/json");
+  out.print("{\"files\":[");
+
+  // sdMutex is held per directory entry, never across a send
+  int index = 0;
+  int listed = 0;
+  bool more = false;
+  while (out.ok()) {
+    StaticJsonDocument<128> entry;
+    {
+      ScopedLock lock(sdMutex);
+      File file = root.openNextFile();
+      if (!file) break;
+      bool isFile = !file.isDirectory();
+      if (isFile) {
+        entry["name"] = file.name();  // Copied: the File is closed below
+        entry["size"] = file.size();
+      }
+      file.close();
+      if (!isFile || index++ < offset) continue;
+      if (listed == limit) {
+        more = true;
+        break;
+      }
     }
-    file = root.openNextFile();
+    if (listed++ > 0) out.print(',');
+    serializeJson(entry, out);
+  }
+  {
+    ScopedLock lock(sdMutex);
+    root.close();
   }
 
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+  out.printf("],\"offset\":%d,\"count\":%d", offset, listed);
+  if (more) out.printf(",\"next_offset\":%d", offset + listed);
+  out.print('}');
 }
 
-void handleDownloadLog() {
+void handleDownloadLog(httpd_req_t* req) {
   Serial.println("Web request: /download");
-  server.sendHeader("Connection", "close");
 
   if (!sdCardPresent) {
-    server.send(503, "text/plain", "SD card not present");
+    sendResponse(req, "503 Service Unavailable", "text/plain", "SD card not present");
     return;
   }
 
-  if (!server.hasArg("file")) {
-    server.send(400, "text/plain", "Missing 'file' parameter");
+  if (!hasQueryArg(req, "file")) {
+    sendResponse(req, "400 Bad Request", "text/plain", "Missing 'file' parameter");
     return;
   }
 
-  String filename = server.arg("file");
+  String filename = queryArg(req, "file");
 
   // Security: prevent directory traversal
   if (filename.indexOf("..") >= 0) {
-    server.send(403, "text/plain", "Invalid filename");
+    sendResponse(req, "403 Forbidden", "text/plain", "Invalid filename");
     return;
   }
 
-  String filepath = "/ble-logs/" + filename;
+  String filepath = LOG_DIR "/" + filename;
+
+  // format=csv converts binary logs (format=rssi exports the RSSI history);
+  // a .csv request falls back to the day's .bin
+  String format = queryArg(req, "format");
+  bool wantRssi = format == "rssi";
+  bool wantCsv = wantRssi || format == "csv";
+  String binPath;
+  bool binExists = false;
+  bool fileExists;
+
+  // Compress for clients that accept it. A Range refers to the plain bytes,
+  // so resumed downloads are always sent as stored.
+  bool gzip = acceptsGzip(req) && httpd_req_get_hdr_value_len(req, "Range") == 0;
+  String gzPath;
+  {
+    ScopedLock lock(sdMutex);
+
+    // Serve records still buffered in RAM too
+    flushLogBuffer(true);
+
+    fileExists = SD.exists(filepath);
+    if (filename.endsWith(".bin")) {
+      binPath = filepath;
+    } else if (filename.endsWith(".csv") && !fileExists) {
+      binPath = filepath.substring(0, filepath.length() - 4) + ".bin";
+      wantCsv = SD.exists(binPath);
+    }
+    if (binPath.length() > 0) binExists = SD.exists(binPath);
+
+    // A past day's CSV (stored or converted) may already be compressed
+    bool wantsDayCsv = filename.endsWith(".csv") || (wantCsv && !wantRssi && binPath.length() > 0);
+    if (gzip && wantsDayCsv) {
+      gzPath = filepath.substring(0, filepath.length() - 4) + ".csv.gz";
+      if (!SD.exists(gzPath)) gzPath = "";
+    }
+  }
+  httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+  String csvName = filename.substring(0, filename.length() - 4) + (wantRssi ? "-rssi.csv" : ".csv");
+  if (gzPath.length() > 0) {
+    streamSdFile(req, gzPath, csvName, "text/csv", CODING_GZIP_FILE);
+    return;
+  }
 
-  if (!SD.exists(filepath)) {
-    server.send(404, "text/plain", "File not found: " + filename);
+  if (wantCsv && binPath.length() > 0) {
+    if (!binExists) {
+      sendResponse(req, "404 Not Found", "text/plain", ("File not found: " + filename).c_str());
+      return;
+    }
+    streamBinaryLogAsCsv(req, binPath, csvName, wantRssi, gzip);
     return;
   }
 
-  File file = SD.open(filepath, FILE_READ);
-  if (!file) {
-    server.send(500, "text/plain", "Failed to open file");
+  if (!fileExists) {
+    sendResponse(req, "404 Not Found", "text/plain", ("File not found: " + filename).c_str());
     return;
   }
 
-  // Stream the file
-  server.sendHeader("Content-Disposition", "attachment; filename=" + filename);
-  server.streamFile(file, "text/csv");
-  file.close();
+  // Stream the file (an explicit .csv.gz is sent as the gzip file it is)
+  const char* contentType = "application/octet-stream";
+  if (filename.endsWith(".csv")) {
+    contentType = "text/csv";
+  } else if (filename.endsWith(".gz")) {
+    contentType = "application/gzip";
+    gzip = false;
+  }
+  streamSdFile(req, filepath, filename, contentType, gzip ? CODING_GZIP : CODING_IDENTITY);
 }
 
-void handleStatus() {
+// Scanner stats followed by the device table, streamed. Devices are listed
+// in ?sort=<view> order (default table) and paged with ?offset=N&limit=N
+// (default all); next_offset is present when more devices follow. Pages are
+// read under separate locks, so a table changing between them may repeat or
+// skip a device.
+//
+// seq is the change cursor: ?since=<seq> answers with only the devices added,
+// changed or removed after it (handleStatusDelta), or 304 if there are none.
+// A cursor the scanner can no longer answer for (from before a reboot, or
+// older than the removal log) gets this full response instead.
+void handleStatus(httpd_req_t* req) {
   Serial.println("Web request: /status");
-  server.sendHeader("Connection", "close");
 
-  StaticJsonDocument<1024> doc;
+  uint32_t seq;
+  bool deltaPossible;
+  char sinceArg[24];
+  bool hasSince = findQueryArg(req, "since", sinceArg, sizeof(sinceArg));
+  uint64_t cursor = hasSince ? strtoull(sinceArg, nullptr, 10) : 0;
+  uint32_t since = (uint32_t)cursor;
+  {
+    ScopedLock lock(deviceMutex);
+    seq = deviceChangeSeq;
+    deltaPossible = (cursor >> 32) == changeBootId && since <= seq && since >= removedHorizon;
+  }
+  if (hasSince && deltaPossible) {
+    if (since == seq) {
+      httpd_resp_set_status(req, "304 Not Modified");
+      httpd_resp_send(req, nullptr, 0);
+      return;
+    }
+    handleStatusDelta(req, since);
+    return;
+  }
+
+  StaticJsonDocument<4416> doc;
+  doc["seq"] = changeCursor(seq);  // Read before the devices, so a change during the listing is reported again, not lost
 
   doc["scanner_id"] = SCANNER_ID;
   doc["device_count"] = deviceCount;
   doc["whitelist_count"] = whitelistCount;
+  doc["whitelist_oui_rules"] = whitelistOuiCount;
+  doc["whitelist_journal"] = whitelistJournalCount;
+  doc["whitelist_load_ms"] = whitelistLoadMs;
+  doc["whitelist_load_cached"] = whitelistLoadCached;
+  doc["whitelist_bad_entries"] = whitelistBadEntries;
+  doc["whitelist_incomplete"] = whitelistIncomplete;
+  doc["whitelist_imports"] = whitelistImports;
   doc["sd_card"] = sdCardPresent;
   doc["wifi_connected"] = wifiConnected;
   doc["ip_address"] = WiFi.localIP().toString();
   doc["uptime_ms"] = millis();
   doc["scan_in_progress"] = scanInProgress;
   doc["last_scan_ms_ago"] = millis() - lastScanTime;
+  doc["scan_mode"] = scanContinuous ? "continuous" : "cycle";
+  doc["scan_profile"] = SCAN_PROFILES[scanProfile].name;
+  doc["active_scan"] = ACTIVE_SCAN_MODE_NAMES[activeScanMode];
+  doc["scan_requests"] = scanActive;
+  doc["adverts_per_sec"] = scanAdvertRate;
+  doc["unresolved_count"] = unresolvedCount;
+
+  // Table overflow: devices evicted to make room, by what they were
+  JsonObject eviction = doc.createNestedObject("eviction");
+  eviction["policy"] = EVICTION_POLICY_NAMES[evictionPolicy];
+  eviction["capacity"] = MAX_TRACKED_DEVICES;
+  eviction["evicted"] = devicesEvicted;
+  eviction["unknown"] = evictedUnknown;
+  eviction["new_unknown"] = evictedNewUnknown;  // Included in unknown
+  eviction["known"] = devicesEvicted - evictedUnknown;
+  if (devicesEvicted > 0) eviction["last_ms_ago"] = millis() - lastEvictionMs;
+
+  // Private addresses followed onto the device they rotated from
+  JsonObject rotation = doc.createNestedObject("rotation");
+  rotation["handoff_ms"] = ROTATION_HANDOFF_MS;
+  rotation["followed"] = addressRotations;
+  rotation["handed_back"] = rotationSplits;
+  rotation["ambiguous"] = rotationsAmbiguous;
+
+  // Boot timeline, ms since reset: time to first advert, to network ready
+  // (web server up) and per step
+  JsonObject boot = doc.createNestedObject("boot");
+  if (firstAdvertMs) boot["first_advert_ms"] = firstAdvertMs;
+  if (bootSteps[BOOT_WEB] == BOOT_DONE) boot["network_ready_ms"] = bootStepMs[BOOT_WEB];
+  JsonObject bootState = boot.createNestedObject("steps");
+  JsonObject bootMs = boot.createNestedObject("step_ms");
+  for (int i = 0; i < BOOT_STEP_COUNT; i++) {
+    uint8_t state = bootSteps[i];
+    bootState[BOOT_STEP_NAMES[i]] = BOOT_STATE_NAMES[state];
+    if (state >= BOOT_DONE) bootMs[BOOT_STEP_NAMES[i]] = bootStepMs[i];
+  }
+
+  // Advertisement ingest queue stats
+  JsonObject ingest = doc.createNestedObject("ingest");
+  ingest["enqueued"] = ingestEnqueued;
+  ingest["dropped"] = ingestDropped;
+  ingest["high_water"] = ingestHighWater;
+  ingest["depth"] = ingestHead.load() - ingestTail.load();
+  ingest["capacity"] = INGEST_QUEUE_SIZE;
+
+  // Classification cache stats
+  JsonObject cache = doc.createNestedObject("classify_cache");
+  cache["hits"] = classifyCacheHits;
+  cache["misses"] = classifyCacheMisses;
+  cache["scan_hits"] = scanCacheHits;
+  cache["scan_misses"] = scanCacheMisses;
+
+  // SD log writer stats
+  JsonObject sdLog = doc.createNestedObject("sd_log");
+  sdLog["file"] = logFilePath;
+  sdLog["bytes_written"] = logBytesWritten;
+  sdLog["flushes"] = logFlushCount;
+  sdLog["last_flush_us"] = logFlushLastUs;
+  sdLog["max_flush_us"] = logFlushMaxUs;
+  sdLog["pending_bytes"] = logBufferUsed;
+  sdLog["write_errors"] = logWriteErrors;
+  sdLog["lines_dropped"] = logLinesDropped;
+  sdLog["rssi_records"] = rssiRecordsLogged;
+  sdLog["rssi_bucket_ms"] = rssiBucketInterval;
+  sdLog["queue_dropped"] = logQueueDropped;
+
+  JsonObject gzipStats = doc.createNestedObject("gzip");
+  gzipStats["responses"] = gzipResponses;
+  gzipStats["bytes_in"] = gzipBytesIn;
+  gzipStats["bytes_out"] = gzipBytesOut;
+  gzipStats["files_served"] = gzipFilesServed;
+  gzipStats["alloc_failures"] = gzipAllocFailures;
+  gzipStats["logs_compressed"] = logsCompressed;
+  if (compressJob.active) gzipStats["compressing"] = compressJob.source;
+
+  // Server uplink: posts (batches) and the sightings they carried
+  JsonObject uplink = doc.createNestedObject("uplink");
+  uplink["enabled"] = uplinkEnabled;
+  uplink["encoding"] = uplinkBinary ? "binary" : "json";
+  uplink["posts_ok"] = postSuccessCount;
+  uplink["posts_failed"] = postFailCount;
+  uplink["last_status"] = uplinkLastStatus;
+  uplink["last_batch"] = uplinkLastBatch;
+  uplink["max_batch"] = uplinkMaxBatch;
+  uplink["last_latency_ms"] = uplinkLastLatencyMs;
+  uplink["max_latency_ms"] = uplinkMaxLatencyMs;
+  uplink["connections_reused"] = uplinkConnectionsReused;
+  uplink["backoff_ms"] = uplinkBackoffMs;
+  uplink["records_sent"] = uplinkRecordsSent;
+  uplink["bytes_sent"] = uplinkBytesSent;
+  uplink["batch_pending"] = uplinkBatchCount;
+  uplink["spooled"] = uplinkRecordsSpooled;
+  uplink["spool_pending"] = uplinkSpoolRecords - uplinkSpoolSent;
+  uplink["dropped"] = uplinkRecordsDropped;
+  uplink["queue_dropped"] = uplinkQueueDropped;
+
+  // Webhook alert pipeline: depth is alerts queued plus batched
+  JsonObject alerts = doc.createNestedObject("alerts");
+  alerts["depth"] = uxQueueMessagesWaiting(alertQueue) + alertBatchCount;
+  alerts["sent"] = alertsSent;
+  alerts["posts_ok"] = alertPostsOk;
+  alerts["posts_failed"] = alertPostsFailed;
+  alerts["last_status"] = alertLastStatus;
+  alerts["max_batch"] = alertMaxBatch;
+  alerts["limited_device"] = alertsLimitedDevice;
+  alerts["limited_global"] = alertsLimitedGlobal;
+  alerts["rejected"] = alertsRejected;
+  alerts["expired"] = alertsExpired;
+  alerts["queue_dropped"] = alertQueueDropped;
+  alerts["last_latency_ms"] = alertLastLatencyMs;
+  alerts["max_latency_ms"] = alertMaxLatencyMs;
+  alerts["avg_latency_ms"] = alertsSent ? alertLatencyTotalMs / alertsSent : 0;
+  alerts["connections_reused"] = alertConnectionsReused;
+  alerts["backoff_ms"] = alertBackoffMs;
+
+  // Per-task stack headroom and CPU time. cpu_pct covers the interval since
+  // the previous /status request (the run-time counter is 32-bit microseconds
+  // and wraps after ~71 minutes, so a since-boot figure would be meaningless).
+  // Both web workers can be in here at once, so the sample is taken locked.
+  struct TaskEntry { const char* name; TaskHandle_t handle; int core; };
+  const TaskEntry taskList[] = {
+    {"tracker", trackerTask, TRACKER_CORE},
+    {"storage", storageTask, APP_CORE},
+    {"display", displayTask, APP_CORE},
+    {"web", webTask, APP_CORE},
+    {"web0", webWorkers[0], APP_CORE},
+    {"web1", webWorkers[1], APP_CORE},
+    {"uplink", uplinkTask, APP_CORE},
+    {"audio", audioTask, APP_CORE},
+  };
+  static_assert(WEB_WORKERS == 2, "taskList lists each web worker");
+  static uint32_t lastTaskRunTime[sizeof(taskList) / sizeof(taskList[0])];
+  static uint32_t lastTaskSampleUs = 0;
+  JsonArray tasks = doc.createNestedArray("tasks");
+  {
+    ScopedLock lock(taskSampleMutex);
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+    uint32_t windowUs = nowUs - lastTaskSampleUs;
+    for (size_t i = 0; i < sizeof(taskList) / sizeof(taskList[0]); i++) {
+      const TaskEntry& t = taskList[i];
+      if (!t.handle) continue;
+      uint32_t runTime = ulTaskGetRunTimeCounter(t.handle);
+      JsonObject task = tasks.createNestedObject();
+      task["name"] = t.name;
+      task["core"] = t.core;
+      task["stack_free"] = uxTaskGetStackHighWaterMark(t.handle);  // Bytes, lowest seen
+      task["cpu_us"] = runTime;
+      task["cpu_pct"] = windowUs > 0 ? (runTime - lastTaskRunTime[i]) * 100.0f / windowUs : 0.0f;
+      lastTaskRunTime[i] = runTime;
+    }
+    lastTaskSampleUs = nowUs;
+  }
+  doc["alert_queue_dropped"] = alertQueueDropped;
+
+  // Display frame timing: compare partial frames against full repaints
+  JsonObject display = doc.createNestedObject("display");
+  display["frames"] = displayFrames;
+  display["full_frames"] = displayFullFrames;
+  display["last_frame_us"] = displayFrameLastUs;
+  display["max_frame_us"] = displayFrameMaxUs;
+  display["avg_frame_us"] = displayFrames ? (uint32_t)(displayFrameTotalUs / displayFrames) : 0;
+  display["full_frame_us"] = displayFullFrameUs;
+  display["widgets_last"] = displayWidgetsLast;
+  display["strip_buffers"] = stripBufferCount;
+  display["strip_bytes"] = stripBufferCount * SCREEN_WIDTH * DISPLAY_STRIP_HEIGHT * 2;
+  display["dma"] = stripUseDma;
+
+  // HTTP worker pool
+  JsonObject web = doc.createNestedObject("web");
+  web["workers"] = WEB_WORKERS;
+  web["queued"] = webRequestsQueued;
+  web["rejected"] = webRequestsRejected;
+  web["waiting"] = uxQueueMessagesWaiting(webQueue);
+
+  // Live event feed stats
+  JsonObject live = doc.createNestedObject("live");
+  live["clients"] = liveClientCount.load();
+  live["events"] = liveEventsQueued;
+  live["queue_dropped"] = liveQueueDropped;
+  uint32_t clientDropped = liveClientDropped;
+  for (int i = 0; i < LIVE_MAX_CLIENTS; i++) {
+    if (liveClients[i].active) clientDropped += liveClients[i].dropped;
+  }
+  live["client_dropped"] = clientDropped;
+
+  // Audio sequencer stats
+  JsonObject audio = doc.createNestedObject("audio");
+  audio["enabled"] = audioEnabled;
+  audio["played"] = audioPlayed;
+  audio["coalesced"] = audioCoalesced;
+  audio["preempted"] = audioPreempted;
 
   // Add timestamp if NTP is available
   struct tm timeinfo;
@@ -1571,17 +7153,661 @@ void handleStatus() {
     doc["current_time"] = timeStr;
   }
 
-  // List current devices
-  JsonArray devicesArray = doc.createNestedArray("devices");
-  for (int i = 0; i < min(deviceCount, 10); i++) {  // Limit to first 10
-    JsonObject devObj = devicesArray.createNestedObject();
-    devObj["mac"] = devices[i].mac;
-    devObj["name"] = devices[i].name;
-    devObj["rssi"] = devices[i].rssi;
-    devObj["known"] = devices[i].isKnown;
+  DeviceView view = parseDeviceView(queryArg(req, "sort"), VIEW_TABLE);
+  int offset = pageArg(req, "offset", 0);
+  int limit = pageArg(req, "limit", INT_MAX);
+  doc["sort"] = DEVICE_VIEW_NAMES[view];
+  doc["offset"] = offset;
+
+  ChunkedResponse out(req, "200 OK", "application/json");
+  out.print('{');
+  printJsonMembers(out, doc.as<JsonObjectConst>());
+  out.print(",\"devices\":[");
+  bool more;
+  int listed = streamStatusDevices(out, view, offset, limit, 0, more);
+  out.printf("],\"count\":%d", listed);
+  if (more) out.printf(",\"next_offset\":%d", offset + listed);
+  printMetricsHistory(out, min(pageArg(req, "history", METRICS_STATUS_SAMPLES), METRICS_HISTORY));
+  out.print('}');
+}
+
+// The /status change cursor clients see for seq: this boot's id above it
+uint64_t changeCursor(uint32_t seq) {
+  return ((uint64_t)changeBootId << 32) | seq;
+}
+
+// Devices added, changed and removed after since, which the caller has
+// checked is answerable. "added" marks devices new since the cursor; a
+// removed device that has since come back is listed as changed only.
+void handleStatusDelta(httpd_req_t* req, uint32_t since) {
+  uint32_t seq;
+  int count;
+  {
+    ScopedLock lock(deviceMutex);
+    seq = deviceChangeSeq;
+    count = deviceCount;
+  }
+
+  ChunkedResponse out(req, "200 OK", "application/json");
+  out.printf("{\"seq\":%llu,\"since\":%llu,\"device_count\":%d,\"changed\":[",
+             (unsigned long long)changeCursor(seq), (unsigned long long)changeCursor(since), count);
+  bool more;
+  streamStatusDevices(out, VIEW_TABLE, 0, INT_MAX, since, more);
+  out.print("],\"removed\":[");
+
+  // Newest first, stopping at the cursor; the ring is small, so it is copied whole
+  char removed[REMOVED_LOG_SIZE][18];
+  int removedListed = 0;
+  {
+    ScopedLock lock(deviceMutex);
+    uint32_t oldest = removedCount > REMOVED_LOG_SIZE ? removedCount - REMOVED_LOG_SIZE : 0;
+    for (uint32_t i = removedCount; i > oldest; i--) {
+      const DeviceRemoval& entry = removedLog[(i - 1) % REMOVED_LOG_SIZE];
+      if (entry.seq <= since) break;
+      if (findDeviceSlot(packAddress(entry.addr)) != DEVICE_SLOT_EMPTY) continue;
+      formatMac(entry.addr, removed[removedListed++]);
+    }
+  }
+  for (int i = 0; i < removedListed; i++) {
+    out.printf(i > 0 ? ",\"%s\"" : "\"%s\"", removed[i]);
+  }
+  out.print("]}");
+}
+
+// Streams the devices at positions offset.. of view whose changeSeq is after
+// since (0 for all) as a JSON array body, up to limit of them. Returns the
+// number written; more is set if the view holds further devices.
+int streamStatusDevices(Print& out, DeviceView view, int offset, int limit, uint32_t since, bool& more) {
+  // Copy a batch out under the lock, then serialize it unlocked
+  struct DeviceEntry {
+    char mac[18];
+    char name[DEVICE_NAME_LEN + 1];
+    int8_t rssi;
+    bool known;
+    bool added;
+    uint8_t status;
+    uint16_t rotations;
+    unsigned long lastSeenAgo;
+  };
+  DeviceEntry batch[STATUS_DEVICE_BATCH];
+  int index = offset;
+  int listed = 0;
+  more = false;
+  for (;;) {
+    int batchSize = 0;
+    {
+      ScopedLock lock(deviceMutex);
+      unsigned long now = millis();
+      while (batchSize < STATUS_DEVICE_BATCH && index < deviceCount && listed + batchSize < limit) {
+        BLEDeviceInfo& dev = deviceInView(view, index++);
+        if (dev.changeSeq <= since) continue;
+        DeviceEntry& entry = batch[batchSize++];
+        formatMac(dev.addr, entry.mac);
+        strlcpy(entry.name, deviceDisplayName(dev), sizeof(entry.name));
+        entry.rssi = dev.rssi;
+        entry.known = dev.isKnown;
+        entry.added = since > 0 && dev.addedSeq > since;
+        entry.status = deviceLogStatus(dev);
+        entry.rotations = dev.rotations;
+        entry.lastSeenAgo = now - dev.lastSeen;
+      }
+      more = index < deviceCount;
+    }
+    if (batchSize == 0) break;
+
+    for (int i = 0; i < batchSize; i++) {
+      const DeviceEntry& entry = batch[i];
+      StaticJsonDocument<192> devObj;
+      devObj["mac"] = entry.mac;
+      devObj["name"] = entry.name;
+      devObj["rssi"] = entry.rssi;
+      devObj["known"] = entry.known;
+      devObj["status"] = LOG_STATUS_NAMES[entry.status];
+      devObj["last_seen_ms_ago"] = entry.lastSeenAgo;
+      if (entry.added) devObj["added"] = true;
+      if (entry.rotations > 0) devObj["rotations"] = entry.rotations;
+      if (listed++ > 0) out.print(',');
+      serializeJson(devObj, out);
+    }
+  }
+  return listed;
+}
+
+// Prometheus text exposition: counters since boot, gauges read now, and the
+// newest metrics sample as ble_interval_* gauges
+void handleMetrics(httpd_req_t* req) {
+  MetricsSample latest;
+  bool haveSample;
+  int count;
+  {
+    ScopedLock lock(deviceMutex);
+    haveSample = metricsSamples > 0;
+    if (haveSample) latest = metricsRing[(metricsSamples - 1) % METRICS_HISTORY];
+    count = deviceCount;
+  }
+
+  ChunkedResponse out(req, "200 OK", "text/plain; version=0.0.4; charset=utf-8");
+  printMetric(out, "ble_uptime_seconds", "gauge", "Time since boot", millis() / 1000.0);
+  printMetric(out, "ble_adverts_total", "counter", "Adverts received, including dropped ones",
+              (uint32_t)(ingestEnqueued + ingestDropped));
+  printMetric(out, "ble_ingest_dropped_total", "counter", "Adverts dropped because the ingest queue was full",
+              ingestDropped);
+  printMetric(out, "ble_ingest_queue_depth", "gauge", "Adverts waiting for the tracker",
+              ingestHead.load() - ingestTail.load());
+  printMetric(out, "ble_classify_cache_hits_total", "counter", "Adverts matched to an unchanged payload",
+              classifyCacheHits);
+  printMetric(out, "ble_classify_cache_misses_total", "counter", "Adverts parsed and classified",
+              classifyCacheMisses);
+  printMetric(out, "ble_adverts_per_second", "gauge", "Advert rate over the last housekeeping pass",
+              scanAdvertRate);
+  printMetric(out, "ble_devices_tracked", "gauge", "Devices in the table", count);
+  printMetric(out, "ble_devices_unresolved", "gauge", "Tracked devices without a name or type", unresolvedCount);
+  printMetric(out, "ble_devices_evicted_total", "counter", "Devices evicted to make room in the full table",
+              devicesEvicted);
+  printMetric(out, "ble_devices_evicted_unknown_total", "counter", "Unknown (alerting) devices evicted",
+              evictedUnknown);
+  printMetric(out, "ble_address_rotations_total", "counter", "Private address changes followed onto a tracked device",
+              addressRotations);
+  printMetric(out, "ble_address_rotations_ambiguous_total", "counter",
+              "New private addresses more than one tracked device could have rotated from", rotationsAmbiguous);
+  printMetric(out, "ble_sd_log_flushes_total", "counter", "SD log buffer flushes", logFlushCount);
+  printMetric(out, "ble_sd_log_bytes_total", "counter", "Bytes written to the SD log", logBytesWritten);
+  printMetric(out, "ble_display_frames_total", "counter", "Display frames drawn", displayFrames);
+  printMetric(out, "ble_http_requests_total", "counter", "HTTP requests handled", webRequestsHandled.load());
+  printMetric(out, "ble_http_rejected_total", "counter", "HTTP requests turned away with 503",
+              webRequestsRejected);
+  printMetric(out, "ble_uplink_posts_ok_total", "counter", "Uplink posts the server accepted", postSuccessCount);
+  printMetric(out, "ble_uplink_posts_failed_total", "counter", "Uplink posts that failed", postFailCount);
+  printMetric(out, "ble_alert_queue_depth", "gauge", "Webhook alerts queued or batched, not yet sent",
+              (uint32_t)(uxQueueMessagesWaiting(alertQueue) + alertBatchCount));
+  printMetric(out, "ble_alerts_sent_total", "counter", "Alerts delivered to the webhook", alertsSent);
+  printMetric(out, "ble_alerts_rate_limited_total", "counter", "Alerts held back by the per-device or global limit",
+              alertsLimitedDevice + alertsLimitedGlobal);
+  printMetric(out, "ble_alerts_dropped_total", "counter", "Alerts lost to a full queue, a 4xx or old age",
+              alertQueueDropped + alertsRejected + alertsExpired);
+  printMetric(out, "ble_alert_posts_failed_total", "counter", "Webhook POSTs that failed and were retried",
+              alertPostsFailed);
+  printMetric(out, "ble_alert_delivery_latency_ms_sum", "counter", "Raised-to-delivered time over all sent alerts",
+              alertLatencyTotalMs);
+  printMetric(out, "ble_alert_delivery_latency_max_ms", "gauge", "Longest raised-to-delivered time of an alert",
+              alertMaxLatencyMs);
+  printMetric(out, "ble_heap_free_bytes", "gauge", "Free heap", ESP.getFreeHeap());
+  printMetric(out, "ble_heap_largest_block_bytes", "gauge", "Largest allocatable heap block",
+              ESP.getMaxAllocHeap());
+  printMetric(out, "ble_heap_min_free_bytes", "gauge", "Lowest free heap since boot", ESP.getMinFreeHeap());
+  if (wifiConnected) printMetric(out, "ble_wifi_rssi_dbm", "gauge", "WiFi signal strength", WiFi.RSSI());
+
+  if (!haveSample) return;
+  for (const MetricsField& field : METRICS_FIELDS) {
+    if (field.gauge) printMetric(out, field.gauge, "gauge", field.help, latest.*field.value);
+  }
+}
+
+// One metric with its HELP and TYPE lines. %.10g keeps 32-bit counters exact.
+void printMetric(Print& out, const char* name, const char* type, const char* help, double value) {
+  out.printf("# HELP %s %s\n# TYPE %s %s\n%s %.10g\n", name, help, name, type, name, value);
+}
+
+// The newest samples of metricsRing, oldest first, as /status "metrics": the
+// field names once, then one array of values per sample. Samples are copied
+// out one at a time so deviceMutex is never held across a send.
+void printMetricsHistory(Print& out, int samples) {
+  out.printf(",\"metrics\":{\"capacity\":%d,\"fields\":[", METRICS_HISTORY);
+  for (int f = 0; f < METRICS_FIELD_COUNT; f++) {
+    out.printf("%s\"%s\"", f ? "," : "", METRICS_FIELDS[f].key);
+  }
+  out.print("],\"samples\":[");
+
+  uint32_t end;
+  {
+    ScopedLock lock(deviceMutex);
+    end = metricsSamples;
+  }
+  uint32_t first = end - min(end, (uint32_t)samples);
+  bool listed = false;
+  for (uint32_t i = first; i < end; i++) {
+    MetricsSample sample;
+    {
+      ScopedLock lock(deviceMutex);
+      if (metricsSamples - i > METRICS_HISTORY) continue;  // Overwritten during a slow response
+      sample = metricsRing[i % METRICS_HISTORY];
+    }
+    out.print(listed ? ",[" : "[");
+    listed = true;
+    for (int f = 0; f < METRICS_FIELD_COUNT; f++) {
+      out.printf("%s%lu", f ? "," : "", (unsigned long)(sample.*METRICS_FIELDS[f].value));
+    }
+    out.print(']');
+  }
+  out.print("]}");
+}
+
+// ============================================================================
+// Live Event Feed
+// ============================================================================
+
+// GET /events is a server-sent event stream. The tracker queues LiveEvents
+// without blocking; the web task copies each one into every subscriber's
+// ring and writes to the sockets with MSG_DONTWAIT, so a stalled subscriber
+// loses its oldest events rather than delaying the others or the scanner.
+// Each event's id is the /status change cursor after it.
+
+// Tracker side: never blocks. A full queue drops its oldest event, so the
+// newest state always gets through.
+void queueLiveEvent(LiveEvent& event) {
+  if (liveClientCount == 0) return;
+  event.seq = deviceChangeSeq;
+  if (xQueueSend(liveQueue, &event, 0) != pdTRUE) {
+    LiveEvent discarded;
+    xQueueReceive(liveQueue, &discarded, 0);
+    liveQueueDropped++;
+    xQueueSend(liveQueue, &event, 0);
+  }
+  liveEventsQueued++;
+}
+
+void queueDeviceEvent(LiveEventType type, const BLEDeviceInfo& dev) {
+  if (liveClientCount == 0) return;
+  LiveEvent event = {};
+  event.type = type;
+  memcpy(event.addr, dev.addr, sizeof(event.addr));
+  event.rssi = dev.rssi;
+  event.status = deviceLogStatus(dev);
+  event.deviceType = dev.deviceType;
+  strlcpy(event.name, deviceDisplayName(dev), sizeof(event.name));
+  queueLiveEvent(event);
+}
+
+// Per-scan summary (deviceMutex held)
+void queueScanEvent() {
+  if (liveClientCount == 0) return;
+  LiveEvent event = {};
+  event.type = LIVE_SCAN;
+  event.deviceCount = deviceCount;
+  for (int i = 0; i < deviceCount; i++) {
+    uint8_t status = deviceLogStatus(deviceAt(i));
+    if (status == LOG_STATUS_UNKNOWN) event.unknownCount++;
+    if (status == LOG_STATUS_NEW) event.newCount++;
+  }
+  queueLiveEvent(event);
+}
+
+int formatLiveEvent(const LiveEvent& event, char* out, size_t size) {
+  StaticJsonDocument<192> data;
+  if (event.type == LIVE_SCAN) {
+    data["devices"] = event.deviceCount;
+    data["unknown"] = event.unknownCount;
+    data["new"] = event.newCount;
+  } else {
+    char mac[18];
+    formatMac(event.addr, mac);
+    data["mac"] = mac;
+    if (event.type != LIVE_EXPIRED) {
+      data["name"] = event.name;
+      data["rssi"] = event.rssi;
+      data["type"] = deviceTypeName(event.deviceType);
+      data["status"] = LOG_STATUS_NAMES[event.status];
+    }
+  }
+
+  int length = snprintf(out, size, "event: %s\nid: %llu\ndata: ",
+                        LIVE_EVENT_NAMES[event.type], (unsigned long long)changeCursor(event.seq));
+  length += serializeJson(data, out + length, size - length - 2);
+  length += snprintf(out + length, size - length, "\n\n");
+  return min(length, (int)size - 1);
+}
+
+// Holds the request open as a subscriber (on the HTTP server task). The
+// response, headers included, is written to the socket by the live feed pump;
+// it has no length, so it ends when either side closes the connection.
+void handleLiveEvents(httpd_req_t* req) {
+  Serial.println("Web request: /events");
+
+  ScopedLock lock(liveMutex);
+  int slot = -1;
+  for (int i = 0; i < LIVE_MAX_CLIENTS; i++) {
+    if (!liveClients[i].active) {
+      slot = i;
+      break;
+    }
+  }
+  httpd_req_t* stream;
+  if (slot < 0 || httpd_req_async_handler_begin(req, &stream) != ESP_OK) {
+    sendResponse(req, "503 Service Unavailable", "text/plain", "Too many event subscribers");
+    return;
+  }
+
+  LiveClient& sub = liveClients[slot];
+  sub.req = stream;
+  sub.fd = httpd_req_to_sockfd(stream);
+  sub.queueHead = 0;
+  sub.queueCount = 0;
+  sub.dropped = 0;
+  sub.outSent = 0;
+  sub.outLength = snprintf(sub.out, sizeof(sub.out),
+                           "HTTP/1.1 200 OK\r\n"
+                           "Content-Type: text/event-stream\r\n"
+                           "Cache-Control: no-cache\r\n"
+                           "Connection: close\r\n"
+                           "Access-Control-Allow-Origin: *\r\n\r\n"
+                           "retry: 2000\n\n");
+  sub.lastSend = millis();
+  sub.active = true;
+  liveClientCount++;
+}
+
+// Web task: fans out queued events and pushes as much of each subscriber's
+// backlog as its socket will take without blocking
+void serviceLiveClients() {
+  ScopedLock lock(liveMutex);
+  LiveEvent event;
+  while (xQueueReceive(liveQueue, &event, 0) == pdTRUE) {
+    for (int i = 0; i < LIVE_MAX_CLIENTS; i++) {
+      LiveClient& sub = liveClients[i];
+      if (!sub.active) continue;
+      if (sub.queueCount == LIVE_CLIENT_QUEUE) {
+        sub.queueHead = (sub.queueHead + 1) % LIVE_CLIENT_QUEUE;  // Drop oldest
+        sub.queueCount--;
+        sub.dropped++;
+      }
+      sub.queue[(sub.queueHead + sub.queueCount) % LIVE_CLIENT_QUEUE] = event;
+      sub.queueCount++;
+    }
+  }
+
+  unsigned long now = millis();
+  for (int i = 0; i < LIVE_MAX_CLIENTS; i++) {
+    LiveClient& sub = liveClients[i];
+    if (!sub.active) continue;
+
+    bool closed = false;
+    while (!closed) {
+      if (sub.outSent == sub.outLength) {
+        if (sub.queueCount > 0) {
+          sub.outLength = formatLiveEvent(sub.queue[sub.queueHead], sub.out, sizeof(sub.out));
+          sub.queueHead = (sub.queueHead + 1) % LIVE_CLIENT_QUEUE;
+          sub.queueCount--;
+        } else if (now - sub.lastSend >= LIVE_KEEPALIVE_MS) {
+          sub.outLength = strlcpy(sub.out, ": keepalive\n\n", sizeof(sub.out));
+        } else {
+          break;
+        }
+        sub.outSent = 0;
+      }
+
+      int sent = send(sub.fd, sub.out + sub.outSent, sub.outLength - sub.outSent, MSG_DONTWAIT);
+      if (sent > 0) {
+        sub.outSent += sent;
+        sub.lastSend = now;
+      } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;  // Socket buffer full: retry on the next pass
+      } else {
+        closed = true;
+      }
+    }
+
+    if (closed) {
+      // Release the request, then have the server close its socket
+      httpd_req_async_handler_complete(sub.req);
+      httpd_sess_trigger_close(webServer, sub.fd);
+      sub.active = false;
+      liveClientDropped += sub.dropped;
+      liveClientCount--;
+    }
+  }
+}
+
+// ============================================================================
+// Benchmark Mode
+// ============================================================================
+
+constexpr BenchScenario BENCH_SCENARIOS[] = {
+  {"quiet", 20, 50},
+  {"office", 60, 200},
+  {"crowd", 180, 800},
+  {"overflow", 400, 800},         // Beyond MAX_TRACKED_DEVICES: most adverts evict a device
+  {"flat-out", 180, 0},
+};
+
+// Raw advertising data the synthetic devices send, one shape per device
+// family the classifier tells apart (including one it can't)
+struct BenchAdvert {
+  uint8_t length;
+  uint8_t payload[31];
+};
+
+constexpr BenchAdvert BENCH_CORPUS[] = {
+  // AirPods: Apple Continuity subtype 0x07
+  {15, {0x02, 0x01, 0x1A, 0x0B, 0xFF, 0x4C, 0x00, 0x07, 0x19, 0x01, 0x0E, 0x20, 0x75, 0xAA, 0x30}},
+  // iBeacon: Apple subtype 0x02 with UUID, major, minor and TX power
+  {30, {0x02, 0x01, 0x06, 0x1A, 0xFF, 0x4C, 0x00, 0x02, 0x15, 0xE2, 0xC5, 0x6D, 0xB5, 0xDF, 0xFB,
+        0x48, 0xD2, 0xB0, 0x60, 0xD0, 0xF5, 0xA7, 0x10, 0x96, 0xE0, 0x00, 0x01, 0x00, 0x02, 0xC5}},
+  // Windows Swift Pair (Microsoft company ID)
+  {14, {0x02, 0x01, 0x06, 0x0A, 0xFF, 0x06, 0x00, 0x01, 0x09, 0x20, 0x02, 0x7A, 0x3B, 0x11}},
+  // Samsung phone
+  {14, {0x02, 0x01, 0x06, 0x0A, 0xFF, 0x75, 0x00, 0x42, 0x04, 0x01, 0x80, 0x60, 0xA1, 0xB2}},
+  // Fitness band: Heart Rate service and a name
+  {16, {0x02, 0x01, 0x06, 0x03, 0x03, 0x0D, 0x18, 0x08, 0x09, 'M', 'i', ' ', 'B', 'a', 'n', 'd'}},
+  // Tile tracker
+  {15, {0x02, 0x01, 0x06, 0x03, 0x03, 0xED, 0xFE, 0x07, 0xFF, 0x77, 0x04, 0x01, 0x02, 0x03, 0x04}},
+  // Speaker known only by its name pattern
+  {15, {0x02, 0x01, 0x06, 0x0B, 0x09, 'J', 'B', 'L', ' ', 'F', 'l', 'i', 'p', ' ', '5'}},
+  // Anonymous: unknown company ID, no name (stays unresolved)
+  {9, {0x02, 0x01, 0x06, 0x05, 0xFF, 0x99, 0x99, 0x01, 0x02}},
+};
+constexpr int BENCH_CORPUS_COUNT = sizeof(BENCH_CORPUS) / sizeof(BENCH_CORPUS[0]);
+
+// xorshift32: the same corpus order every run, so runs compare
+uint32_t benchRandom() {
+  benchSeed ^= benchSeed << 13;
+  benchSeed ^= benchSeed >> 17;
+  benchSeed ^= benchSeed << 5;
+  return benchSeed;
+}
+
+void benchRecord(BenchStage stage, uint32_t cycles) {
+  BenchStats& stats = benchStats[stage];
+  stats.seen++;
+  stats.totalCycles += cycles;
+  if (cycles > stats.maxCycles) stats.maxCycles = cycles;
+  if (stats.kept < BENCH_SAMPLES) {
+    stats.samples[stats.kept++] = cycles;
+  } else {
+    uint32_t pick = benchRandom() % stats.seen;
+    if (pick < BENCH_SAMPLES) stats.samples[pick] = cycles;
+  }
+}
+
+// Synthetic device index's address and advert; variant changes the payload
+// (a rotating field, as Continuity and Fast Pair adverts have), so a new
+// variant misses the classification cache
+void buildBenchAdvert(int index, uint8_t variant, uint8_t* addr, uint8_t* payload, uint8_t& length) {
+  uint32_t hash = hashAddress((uint64_t)index * 0x9E3779B97F4A7C15ull);
+  addr[0] = 0xC0 | (index >> 8 & 0x3F);  // Random static address
+  addr[1] = index & 0xFF;
+  addr[2] = hash >> 24;
+  addr[3] = hash >> 16;
+  addr[4] = hash >> 8;
+  addr[5] = hash;
+  const BenchAdvert& advert = BENCH_CORPUS[index % BENCH_CORPUS_COUNT];
+  length = advert.length;
+  memcpy(payload, advert.payload, length);
+  payload[length - 1] ^= variant;
+}
+
+// Benchmark build: replays BENCH_SCENARIOS instead of scanning, then again
+// every BENCH_PAUSE_MS. Runs on the Arduino loop task with no other task
+// started, so nothing competes with the stage being timed.
+void runBenchmarks() {
+  {
+    ScopedLock lock(sdMutex);
+    initSDCard();
+  }
+  initDisplaySprites();
+  for (int i = 0; i < BENCH_STAGE_COUNT; i++) {
+    benchStats[i].samples = (uint32_t*)malloc(BENCH_SAMPLES * sizeof(uint32_t));
+    if (!benchStats[i].samples) {
+      Serial.println("Benchmark: no memory for samples");
+      for (;;) delay(1000);
+    }
+  }
+
+  for (uint32_t run = 1;; run++) {
+    Serial.printf("\n=== Benchmark run %lu: %d adverts per scenario, CPU %lu MHz ===\n",
+                  run, BENCH_ADVERTS, ESP.getCpuFreqMHz());
+    for (const BenchScenario& scenario : BENCH_SCENARIOS) {
+      runBenchScenario(scenario);
+    }
+    delay(BENCH_PAUSE_MS);
+  }
+}
+
+void runBenchScenario(const BenchScenario& scenario) {
+  // Start each scenario from an empty table, cold caches and an empty log
+  {
+    ScopedLock lock(deviceMutex);
+    while (deviceCount > 0) freeDeviceSlot(activeSlots[deviceCount - 1]);
+  }
+  countUnresolvedDevices(false);
+  if (sdCardPresent) {
+    ScopedLock lock(sdMutex);
+    flushLogBuffer(true);
+    closeLogFile();
+    char path[sizeof(logFilePath)];
+    formatLogFilename(path, sizeof(path));
+    SD.remove(path);
+  }
+  xQueueReset(logQueue);
+  invalidateDisplay();
+  benchSeed = 1;
+  for (BenchStats& stats : benchStats) {
+    stats.kept = 0;
+    stats.seen = 0;
+    stats.totalCycles = 0;
+    stats.maxCycles = 0;
+  }
+
+  // Something to change on each device; a device's first advert is variant 0
+  uint8_t* variants = (uint8_t*)calloc(scenario.devices, 1);
+  if (!variants) return;
+
+  multi_heap_info_t heapBefore;
+  heap_caps_get_info(&heapBefore, MALLOC_CAP_8BIT);
+  uint32_t lowestFree = heapBefore.total_free_bytes;
+  uint32_t logBytesBefore = logBytesWritten;
+  uint32_t droppedBefore = ingestDropped + logQueueDropped;
+
+  uint32_t frameEvery = scenario.rate ? max(1, scenario.rate * RSSI_METER_INTERVAL / 1000) : 50;
+  unsigned long start = micros();
+  for (int n = 0; n < BENCH_ADVERTS; n++) {
+    if (scenario.rate) {
+      unsigned long due = start + (uint64_t)n * 1000000 / scenario.rate;
+      while ((long)(micros() - due) < 0) {
+        if ((long)(due - micros()) > 2000) delay(1);
+      }
+    }
+
+    int index = benchRandom() % scenario.devices;
+    if (benchRandom() % 100 < BENCH_CHURN_PCT) variants[index]++;
+    uint8_t addr[6];
+    uint8_t payload[31];
+    uint8_t length;
+    buildBenchAdvert(index, variants[index], addr, payload, length);
+    int rssi = -35 - (int)(index * 7 % 55) - (int)(benchRandom() % 6);
+
+    uint32_t cycles = ESP.getCycleCount();
+    ingestRecord(addr, BLE_ADDR_TYPE_RANDOM, rssi, payload, length);
+    benchRecord(BENCH_INGEST, ESP.getCycleCount() - cycles);
+
+    {
+      ScopedLock lock(deviceMutex);
+      uint32_t misses = classifyCacheMisses;
+      cycles = ESP.getCycleCount();
+      drainIngestQueue();
+      cycles = ESP.getCycleCount() - cycles;
+      benchRecord(classifyCacheMisses != misses ? BENCH_PROCESS_MISS : BENCH_PROCESS_HIT, cycles);
+    }
+
+    // The slow path's classification on its own, side-effect free
+    AdvertRecord rec;
+    memcpy(rec.payload, payload, length);
+    rec.payloadLen = length;
+    cycles = ESP.getCycleCount();
+    parseAdvertPayload(rec.payload, rec.payloadLen, rec);
+    volatile DeviceClass cls = classifyAdvert(rec);
+    (void)cls;
+    benchRecord(BENCH_CLASSIFY, ESP.getCycleCount() - cycles);
+
+    // Storage task's share: write what the tracker queued
+    LogItem item;
+    while (xQueueReceive(logQueue, &item, 0) == pdTRUE) {
+      ScopedLock lock(sdMutex);
+      cycles = ESP.getCycleCount();
+      writeLogItem(item);
+      benchRecord(BENCH_LOG, ESP.getCycleCount() - cycles);
+    }
+    if (sdCardPresent && millis() - lastLogFlush >= LOG_FLUSH_INTERVAL) {
+      ScopedLock lock(sdMutex);
+      cycles = ESP.getCycleCount();
+      serviceLogWriter();
+      benchRecord(BENCH_LOG, ESP.getCycleCount() - cycles);
+    }
+
+    // A display frame at the live meter rate (or every 50 adverts flat out)
+    if (n % frameEvery == 0) {
+      xQueueReset(audioQueue);  // Alert beeps that nothing plays
+      cycles = ESP.getCycleCount();
+      drawDisplay();
+      benchRecord(BENCH_RENDER, ESP.getCycleCount() - cycles);
+      lowestFree = min(lowestFree, (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    }
+  }
+  unsigned long elapsedUs = micros() - start;
+  free(variants);
+
+  multi_heap_info_t heapAfter;
+  heap_caps_get_info(&heapAfter, MALLOC_CAP_8BIT);
+  float rate = elapsedUs ? BENCH_ADVERTS * 1e6f / elapsedUs : 0;
+  Serial.printf("\nScenario \"%s\": %d devices, ", scenario.name, scenario.devices);
+  if (scenario.rate) {
+    Serial.printf("%d adverts/s target", scenario.rate);
+  } else {
+    Serial.print("unpaced");
   }
+  Serial.printf(", %.0f/s achieved over %lu ms\n", rate, elapsedUs / 1000);
+  printBenchStats();
+  Serial.printf("  Heap: free %u -> %u (%+d), largest block %u -> %u, lowest %lu, blocks %+d\n",
+                heapBefore.total_free_bytes, heapAfter.total_free_bytes,
+                (int)heapAfter.total_free_bytes - (int)heapBefore.total_free_bytes,
+                heapBefore.largest_free_block, heapAfter.largest_free_block, lowestFree,
+                (int)heapAfter.allocated_blocks - (int)heapBefore.allocated_blocks);
+  Serial.printf("  Table: %d tracked, %d unresolved; log %lu bytes; %lu adverts or log items dropped\n",
+                deviceCount, unresolvedCount, logBytesWritten - logBytesBefore,
+                ingestDropped + logQueueDropped - droppedBefore);
+}
 
-  String response;
-  serializeJson(doc, response);
-  server.send(200, "application/json", response);
+int compareBenchCycles(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+// Per-stage table: sample count, then mean and percentiles in CPU cycles,
+// with p99 and max in microseconds
+void printBenchStats() {
+  float cyclesPerUs = ESP.getCpuFreqMHz();
+  Serial.println("  stage              n     mean      p50      p90      p99      max   p99 us   max us");
+  for (int i = 0; i < BENCH_STAGE_COUNT; i++) {
+    BenchStats& stats = benchStats[i];
+    if (stats.seen == 0) {
+      Serial.printf("  %-12s         -\n", BENCH_STAGE_NAMES[i]);
+      continue;
+    }
+    qsort(stats.samples, stats.kept, sizeof(uint32_t), compareBenchCycles);
+    auto percentile = [&](int pct) { return stats.samples[(stats.kept - 1) * pct / 100]; };
+    Serial.printf("  %-12s %7lu %8lu %8lu %8lu %8lu %8lu %8.1f %8.1f\n", BENCH_STAGE_NAMES[i],
+                  stats.seen, (uint32_t)(stats.totalCycles / stats.seen),
+                  percentile(50), percentile(90), percentile(99), stats.maxCycles,
+                  percentile(99) / cyclesPerUs, stats.maxCycles / cyclesPerUs);
+  }
 }
@@ -15,6 +15,8 @@ cd /home/cursor/SECURITY/ble-scanner
 BOARD="esp32:esp32:esp32:PartitionScheme=huge_app"
 PORT="/dev/ttyUSB0"
 BAUD="115200"
+BUILD_PATH="./build"
+EXTRA_FLAGS=""
 
 # Colors for output
 RED='\033[0;31m'
@@ -48,8 +50,9 @@ compile() {
     echo ""
 
     arduino-cli compile \
-        --build-path ./build \
+        --build-path ${BUILD_PATH} \
         --fqbn ${BOARD} \
+        --build-property "compiler.cpp.extra_flags=${EXTRA_FLAGS}" \
         .
 
     echo ""
@@ -57,8 +60,8 @@ compile() {
     echo ""
 
     # Show binary size
-    if [ -f "./build/ble-scanner.ino.bin" ]; then
-        SIZE=$(ls -lh ./build/ble-scanner.ino.bin | awk '{print $5}')
+    if [ -f "${BUILD_PATH}/ble-scanner.ino.bin" ]; then
+        SIZE=$(ls -lh ${BUILD_PATH}/ble-scanner.ino.bin | awk '{print $5}')
         echo "Binary size: ${SIZE}"
     fi
 }
@@ -74,7 +77,7 @@ upload() {
     arduino-cli upload \
         -p ${PORT} \
         --fqbn ${BOARD} \
-        --input-dir ./build \
+        --input-dir ${BUILD_PATH} \
         .
 
     echo ""
@@ -107,6 +110,17 @@ case "${1}" in
     monitor)
         monitor
         ;;
+    benchmark)
+        # Benchmark build: replays a synthetic corpus instead of scanning and
+        # prints per-stage timings over serial (BENCHMARK_MODE in ble-scanner.ino)
+        BUILD_PATH="./build-benchmark"
+        EXTRA_FLAGS="-DBENCHMARK_MODE=1"
+        compile
+        upload
+        echo ""
+        echo -e "${GREEN}=== Benchmark Deployed ===${NC}"
+        echo "Run './deploy.sh monitor' for the results; './deploy.sh' restores the scanner"
+        ;;
     "")
         # Default: compile and upload
         compile
@@ -123,5 +137,6 @@ case "${1}" in
         echo "  ./deploy.sh compile  - Compile only"
         echo "  ./deploy.sh upload   - Upload only"
         echo "  ./deploy.sh monitor  - Open serial monitor"
+        echo "  ./deploy.sh benchmark - Compile and upload the benchmark build"
         ;;
 esac
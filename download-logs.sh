@@ -120,15 +120,108 @@ FILE_COUNT=$(echo "$FILES" | wc -l)
 echo -e "Found ${CYAN}${FILE_COUNT}${NC} log file(s)"
 echo ""
 
+# Convert a binary log (.bin + .nam name table) to the scanner's CSV layout.
+# Mirrors LogRecord in ble-scanner.ino: 16-byte little-endian records.
+convert_binary_log() {
+    python3 - "$1" "$2" "$3" <<'PYEOF'
+import struct, sys, time
+bin_path, nam_path, csv_path = sys.argv[1:4]
+TYPES = ["Unknown", "iBeacon", "AirDrop", "AirPods", "AirPlay", "AirTag", "Apple",
+         "Samsung", "Google", "Microsoft", "Tile", "Wearable", "BLE Device", "HID",
+         "Beacon", "Phone", "Audio", "Tracker"]
+MFRS = ["Unknown", "Apple", "Samsung", "Google", "Microsoft", "Tile", "Garmin",
+        "Huawei", "Xiaomi", "Nordic", "Sony"]
+STATUS = ["unknown", "new", "known", "unknown"]
+try:
+    names = open(nam_path, "rb").read()
+except OSError:
+    names = b""
+def lookup(table, i):
+    return table[i] if i < len(table) else table[0]
+def timestamp(t, flags):
+    if flags & 0x04:
+        return str(t)
+    return time.strftime("%Y-%m-%dT%H:%M:%S", time.gmtime(t))
+def fmt_mac(mac):
+    return ":".join("%02X" % b for b in mac)
+rssi_rows = []
+with open(bin_path, "rb") as f, open(csv_path, "w") as out:
+    out.write("timestamp,mac,name,rssi,device_type,status,manufacturer\n")
+    data = f.read()
+    for off in range(0, len(data) - 15, 16):
+        t, mac, rssi, flags, dtype, mfr, ref = struct.unpack_from("<I6sbBBBH", data, off)
+        if flags >> 4 == 1:
+            # RSSI bucket: mean, then min/max/samples in place of type/mfr/name
+            lo, hi, samples = struct.unpack_from("<bbH", data, off + 12)
+            rssi_rows.append("%s,%s,%d,%d,%d,%d\n" % (timestamp(t, flags), fmt_mac(mac),
+                             samples, lo, hi, rssi))
+            continue
+        if flags >> 4 != 0:
+            continue  # Unknown record kind
+        ts = timestamp(t, flags)
+        name = ""
+        if ref != 0xFFFF:
+            name = names[ref * 20:ref * 20 + 20].split(b"\0")[0].decode("utf-8", "replace")
+        name = (name or "Unknown").replace(",", ";")
+        out.write("%s,%s,%s,%d,%s,%s,%s\n" % (ts, fmt_mac(mac), name, rssi,
+                  lookup(TYPES, dtype), STATUS[flags & 3], lookup(MFRS, mfr)))
+if rssi_rows:
+    with open(csv_path[:-4] + "-rssi.csv", "w") as out:
+        out.write("bucket_start,mac,samples,rssi_min,rssi_max,rssi_mean\n")
+        out.writelines(rssi_rows)
+PYEOF
+}
+
+HAVE_PYTHON=false
+if command -v python3 > /dev/null 2>&1; then
+    HAVE_PYTHON=true
+fi
+
 # Download each file
 DOWNLOADED=0
 for filename in $FILES; do
+    # Name tables are fetched together with their .bin log; .csv.gz copies of
+    # past days (and .tmp ones being written) duplicate a .bin or .csv
+    if [[ "$filename" == *.nam || "$filename" == *.gz || "$filename" == *.tmp ]]; then
+        FILE_COUNT=$((FILE_COUNT - 1))
+        continue
+    fi
+
     echo -n "  Downloading ${filename}... "
 
-    OUTPUT_PATH="${OUTPUT_DIR}/${filename}"
+    if [[ "$filename" == *.bin ]]; then
+        base="${filename%.bin}"
+        OUTPUT_PATH="${OUTPUT_DIR}/${base}.csv"
+
+        if $HAVE_PYTHON; then
+            # Pull the compact binary log and convert locally (~4x less over WiFi).
+            # The .bin is removed after conversion, so one left behind is an
+            # interrupted pull: -C - resumes it with a Range request.
+            if curl -s --compressed --connect-timeout "$TIMEOUT" --retry 3 -C - "${SCANNER_URL}/download?file=${filename}" \
+                    -o "${OUTPUT_DIR}/${filename}" && \
+               curl -s --compressed --connect-timeout "$TIMEOUT" "${SCANNER_URL}/download?file=${base}.nam" \
+                    -o "${OUTPUT_DIR}/${base}.nam" && \
+               convert_binary_log "${OUTPUT_DIR}/${filename}" "${OUTPUT_DIR}/${base}.nam" "$OUTPUT_PATH"; then
+                rm -f "${OUTPUT_DIR:?}/${filename:?}" "${OUTPUT_DIR:?}/${base:?}.nam"
+                SIZE=$(stat -f%z "$OUTPUT_PATH" 2>/dev/null || stat -c%s "$OUTPUT_PATH" 2>/dev/null || echo "?")
+                echo -e "${GREEN}OK${NC} (${SIZE} bytes as CSV)"
+                ((DOWNLOADED++))
+            else
+                echo -e "${RED}FAILED${NC}"
+            fi
+            continue
+        fi
+
+        # No python3: let the scanner convert to CSV
+        URL="${SCANNER_URL}/download?file=${filename}&format=csv"
+    else
+        OUTPUT_PATH="${OUTPUT_DIR}/${filename}"
+        URL="${SCANNER_URL}/download?file=${filename}"
+    fi
 
-    if curl -s --connect-timeout "$TIMEOUT" \
-        "${SCANNER_URL}/download?file=${filename}" \
+    # --compressed: the scanner gzips downloads (past days' CSV is stored gzipped)
+    if curl -s --compressed --connect-timeout "$TIMEOUT" \
+        "$URL" \
         -o "$OUTPUT_PATH"; then
 
         # Get file size
@@ -70,19 +70,49 @@ Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RST);
 #define SCAN_DURATION 5           // Seconds per scan cycle
 #define SCAN_INTERVAL 15000       // Milliseconds between scans
 #define DEVICE_TIMEOUT 120000     // Milliseconds before device removed (2 min)
-#define MAX_TRACKED_DEVICES 30    // Maximum devices to track in memory
+#define MAX_TRACKED_DEVICES 128   // Maximum devices to track in memory
+#define DEVICE_HASH_SIZE 256      // Address hash index slots (power of 2, >= 2x MAX_TRACKED_DEVICES)
+#define DEVICE_SLOT_EMPTY -1      // Unused hash index slot
+#define ACTIVE_SCAN_GAP 60000     // Least time between active scans (ms); the others are passive
+#define ACTIVE_SCAN_TRIES 3       // Active scans a nameless device is heard in before it stops asking for one
+
+// ============================================================================
+// Server Uplink Constants
+// ============================================================================
+
+#define UPLINK_BATCH_MAX 32       // Sightings per POST
+#define UPLINK_BACKLOG 128        // Sightings held for the server; the oldest is dropped when full
+#define UPLINK_INTERVAL 60000     // A partial batch is posted once its oldest sighting is this old (ms)
+#define UPLINK_PAYLOAD_MAX 8192   // JSON body buffer; a batch that doesn't fit goes in parts
+#define UPLINK_MIN_WINDOW 2000    // Least scan gap (ms) worth starting a post in
+#define UPLINK_GAP_MARGIN 500     // Post timeouts end this long before the next scan (ms)
+#define UPLINK_BACKOFF_MIN 5000   // Retry delay after a failed post, doubled per failure...
+#define UPLINK_BACKOFF_MAX 300000 // ...up to this (ms)
 
 // ============================================================================
 // Data Structures
 // ============================================================================
 
 struct BLEDeviceInfo {
+  uint64_t addrKey;               // 48-bit address packed for hashing
   String mac;
   String name;
   int rssi;
   String deviceType;
   String manufacturer;
+  unsigned long firstSeen;
   unsigned long lastSeen;
+  uint8_t activeScans;            // Active scans heard in while still nameless
+};
+
+// New sighting waiting in the uplink backlog
+struct UplinkRecord {
+  char mac[18];
+  char name[24];
+  int8_t rssi;
+  char deviceType[12];
+  char manufacturer[12];
+  unsigned long seenAt;           // millis() when queued
 };
 
 // ============================================================================
@@ -90,17 +120,54 @@ struct BLEDeviceInfo {
 // ============================================================================
 
 BLEScan* pBLEScan;
+
+// Device table: index-stable slot pool with an open-addressing address index
+// (linear probing, backward-shift deletion). activeSlots[] lists occupied
+// slots densely; deviceAt(i) returns the i-th tracked device.
 BLEDeviceInfo devices[MAX_TRACKED_DEVICES];
+int16_t deviceHash[DEVICE_HASH_SIZE];
+int16_t activeSlots[MAX_TRACKED_DEVICES];
+int16_t slotPosition[MAX_TRACKED_DEVICES];
+int16_t freeSlots[MAX_TRACKED_DEVICES];
+int freeSlotCount = 0;
 int deviceCount = 0;
 
+// Recency list: occupied slots doubly linked, most recently seen first. A
+// sighting moves its slot to the head, so the tail is always the oldest.
+int16_t recentNext[MAX_TRACKED_DEVICES];
+int16_t recentPrev[MAX_TRACKED_DEVICES];
+int16_t recentHead = DEVICE_SLOT_EMPTY;
+int16_t recentTail = DEVICE_SLOT_EMPTY;
+
 unsigned long lastScanTime = 0;
-unsigned long lastPostTime = 0;
 bool scanInProgress = false;
 unsigned long scanStartTime = 0;
 
+// Passive scanning, with an active scan only while nameless devices might
+// answer a scan request. Stats are [scan was active].
+bool scanActive = false;
+unsigned long lastActiveScan = 0;
+int scanCount[2] = {0, 0};
+unsigned long scanAdverts[2] = {0, 0};  // Devices reported per scan (no duplicates within one)
+int namesResolved[2] = {0, 0};
+unsigned long resolveTotalMs[2] = {0, 0};
+
 bool wifiConnected = false;
+
+// Server uplink: ring of new sightings, oldest at uplinkHead
+HTTPClient uplinkHttp;                 // Kept between posts so the connection is reused
+UplinkRecord uplinkBacklog[UPLINK_BACKLOG];
+int uplinkHead = 0;
+int uplinkCount = 0;
+char uplinkPayload[UPLINK_PAYLOAD_MAX];
+unsigned long lastPostTime = 0;        // Last attempt
+unsigned long uplinkBackoffMs = 0;     // Wait after the last failure, 0 once a post succeeds
 int postSuccessCount = 0;
 int postFailCount = 0;
+int uplinkLastBatch = 0;               // Sightings in the last accepted post
+unsigned long uplinkLastLatencyMs = 0;
+unsigned long uplinkMaxLatencyMs = 0;
+unsigned long uplinkDropped = 0;       // Oldest sightings overwritten while the server was unreachable
 
 // ============================================================================
 // Forward Declarations
@@ -110,11 +177,24 @@ void initDisplay();
 void initBLE();
 void initWiFi();
 void startBLEScan();
+bool wantActiveScan(unsigned long now);
 void processDevice(BLEAdvertisedDevice& device);
-void updateDeviceList(String mac, String name, int rssi, String deviceType, String manufacturer);
+void initDeviceTable();
+uint64_t packAddress(const uint8_t* addr);
+uint32_t hashAddress(uint64_t addrKey);
+int findDeviceSlot(uint64_t addrKey);
+int allocDeviceSlot(uint64_t addrKey);
+void freeDeviceSlot(int slot);
+BLEDeviceInfo& deviceAt(int index);
+void unlinkRecent(int slot);
+void touchRecent(int slot);
+void updateDeviceList(uint64_t addrKey, String mac, String name, int rssi, String deviceType, String manufacturer);
 void pruneStaleDevices();
 void updateDisplay();
-void postLogsToServer();
+void queueUplinkSighting(const BLEDeviceInfo& dev);
+void serviceUplink();
+int encodeUplinkJson(int count, size_t& length);
+int postLogsToServer(int count, unsigned long timeoutMs);
 String detectDeviceType(BLEAdvertisedDevice& device);
 String detectManufacturer(BLEAdvertisedDevice& device);
 
@@ -152,6 +232,8 @@ void setup() {
   // Initialize display
   initDisplay();
 
+  initDeviceTable();
+
   display.clearDisplay();
   display.setTextSize(1);
   display.setTextColor(SSD1306_WHITE);
@@ -165,6 +247,7 @@ void setup() {
 
   // Initialize BLE
   initBLE();
+  uplinkHttp.setReuse(true);
 
   // Show ready
   display.clearDisplay();
@@ -201,21 +284,36 @@ void loop() {
     scanInProgress = false;
     lastScanTime = millis();
 
+    // Nameless devices heard in an active scan use up one of their tries
+    if (scanActive) {
+      for (int i = 0; i < deviceCount; i++) {
+        BLEDeviceInfo& dev = deviceAt(i);
+        if (dev.name == "Unknown" && dev.lastSeen >= scanStartTime && dev.activeScans < ACTIVE_SCAN_TRIES) {
+          dev.activeScans++;
+        }
+      }
+    }
+
     // Prune stale devices
     pruneStaleDevices();
 
     // Update display
     updateDisplay();
 
-    // Post to server
-    if (wifiConnected && deviceCount > 0) {
-      postLogsToServer();
+    Serial.printf("Scan complete. Tracking %d devices. Posts: %d OK, %d fail, last %d sightings in %lu ms (max %lu), %d queued, %lu dropped\n",
+                  deviceCount, postSuccessCount, postFailCount, uplinkLastBatch,
+                  uplinkLastLatencyMs, uplinkMaxLatencyMs, uplinkCount, uplinkDropped);
+    for (int a = 0; a < 2; a++) {
+      Serial.printf("  %s scans: %d, %.1f devices/scan, %d names resolved (avg %lu ms after first sighting)\n",
+                    a ? "Active" : "Passive", scanCount[a],
+                    scanCount[a] > 0 ? (float)scanAdverts[a] / scanCount[a] : 0.0f,
+                    namesResolved[a], namesResolved[a] > 0 ? resolveTotalMs[a] / namesResolved[a] : 0);
     }
-
-    Serial.printf("Scan complete. Tracking %d devices. Posts: %d OK, %d fail\n",
-                  deviceCount, postSuccessCount, postFailCount);
   }
 
+  // Posts only start in the gap between scans
+  serviceUplink();
+
   delay(10);
 }
 
@@ -255,7 +353,8 @@ void initBLE() {
   BLEDevice::init("Heltec-Scanner");
   pBLEScan = BLEDevice::getScan();
   pBLEScan->setAdvertisedDeviceCallbacks(new BLEScanCallbacks());
-  pBLEScan->setActiveScan(true);
+  pBLEScan->setActiveScan(false);
+  lastActiveScan = millis() - ACTIVE_SCAN_GAP;
   pBLEScan->setInterval(100);
   pBLEScan->setWindow(99);
 
@@ -303,14 +402,32 @@ void startBLEScan() {
   scanStartTime = millis();
   scanInProgress = true;
 
+  scanActive = wantActiveScan(scanStartTime);
+  pBLEScan->setActiveScan(scanActive);
+  if (scanActive) lastActiveScan = scanStartTime;
+  scanCount[scanActive]++;
+
   pBLEScan->clearResults();
   bool started = pBLEScan->start(SCAN_DURATION, nullptr, false);
 
-  Serial.printf("  Scan started: %s\n", started ? "true" : "false");
+  Serial.printf("  Scan started: %s (%s)\n", started ? "true" : "false", scanActive ? "active" : "passive");
+}
+
+// Most types come from the manufacturer data of the primary advert; only the
+// name tends to sit in the scan response
+bool wantActiveScan(unsigned long now) {
+  if (now - lastActiveScan < ACTIVE_SCAN_GAP) return false;
+  for (int i = 0; i < deviceCount; i++) {
+    const BLEDeviceInfo& dev = deviceAt(i);
+    if (dev.name == "Unknown" && dev.activeScans < ACTIVE_SCAN_TRIES) return true;
+  }
+  return false;
 }
 
 void processDevice(BLEAdvertisedDevice& device) {
-  String mac = device.getAddress().toString().c_str();
+  BLEAddress address = device.getAddress();
+  uint64_t addrKey = packAddress(*address.getNative());
+  String mac = address.toString().c_str();
   mac.toUpperCase();
 
   String name = device.haveName() ? device.getName().c_str() : "Unknown";
@@ -318,48 +435,171 @@ void processDevice(BLEAdvertisedDevice& device) {
   String deviceType = detectDeviceType(device);
   String manufacturer = detectManufacturer(device);
 
-  updateDeviceList(mac, name, rssi, deviceType, manufacturer);
+  scanAdverts[scanActive]++;
+  updateDeviceList(addrKey, mac, name, rssi, deviceType, manufacturer);
+}
+
+// ============================================================================
+// Device Table
+// ============================================================================
+
+void initDeviceTable() {
+  for (int i = 0; i < DEVICE_HASH_SIZE; i++) {
+    deviceHash[i] = DEVICE_SLOT_EMPTY;
+  }
+  // Stack the free slots so slot 0 is handed out first
+  freeSlotCount = 0;
+  for (int i = MAX_TRACKED_DEVICES - 1; i >= 0; i--) {
+    freeSlots[freeSlotCount++] = i;
+  }
+  deviceCount = 0;
+  recentHead = recentTail = DEVICE_SLOT_EMPTY;
+}
+
+uint64_t packAddress(const uint8_t* addr) {
+  uint64_t key = 0;
+  for (int i = 0; i < 6; i++) {
+    key = (key << 8) | addr[i];
+  }
+  return key;
+}
+
+uint32_t hashAddress(uint64_t addrKey) {
+  static_assert((DEVICE_HASH_SIZE & (DEVICE_HASH_SIZE - 1)) == 0, "DEVICE_HASH_SIZE must be a power of 2");
+  static_assert(DEVICE_HASH_SIZE >= 2 * MAX_TRACKED_DEVICES, "DEVICE_HASH_SIZE too small for load factor");
+  return (uint32_t)((addrKey * 0x9E3779B97F4A7C15ULL) >> 40) & (DEVICE_HASH_SIZE - 1);
+}
+
+// Returns the slot holding addrKey, or DEVICE_SLOT_EMPTY
+int findDeviceSlot(uint64_t addrKey) {
+  uint32_t pos = hashAddress(addrKey);
+  while (deviceHash[pos] != DEVICE_SLOT_EMPTY) {
+    if (devices[deviceHash[pos]].addrKey == addrKey) {
+      return deviceHash[pos];
+    }
+    pos = (pos + 1) & (DEVICE_HASH_SIZE - 1);
+  }
+  return DEVICE_SLOT_EMPTY;
+}
+
+// Claims a free slot for addrKey and indexes it. Caller must ensure the
+// table is not full and the address is not already present.
+int allocDeviceSlot(uint64_t addrKey) {
+  if (freeSlotCount == 0) return DEVICE_SLOT_EMPTY;
+
+  int slot = freeSlots[--freeSlotCount];
+  devices[slot].addrKey = addrKey;
+
+  uint32_t pos = hashAddress(addrKey);
+  while (deviceHash[pos] != DEVICE_SLOT_EMPTY) {
+    pos = (pos + 1) & (DEVICE_HASH_SIZE - 1);
+  }
+  deviceHash[pos] = slot;
+
+  activeSlots[deviceCount] = slot;
+  slotPosition[slot] = deviceCount;
+  deviceCount++;
+
+  recentPrev[slot] = DEVICE_SLOT_EMPTY;
+  recentNext[slot] = recentHead;
+  if (recentHead != DEVICE_SLOT_EMPTY) recentPrev[recentHead] = slot;
+  recentHead = slot;
+  if (recentTail == DEVICE_SLOT_EMPTY) recentTail = slot;
+  return slot;
+}
+
+void freeDeviceSlot(int slot) {
+  // Locate the slot's hash entry
+  uint32_t hole = hashAddress(devices[slot].addrKey);
+  while (deviceHash[hole] != slot) {
+    if (deviceHash[hole] == DEVICE_SLOT_EMPTY) return;  // Not indexed
+    hole = (hole + 1) & (DEVICE_HASH_SIZE - 1);
+  }
+
+  // Backward-shift deletion: keeps probe runs intact without tombstones
+  uint32_t next = hole;
+  while (true) {
+    next = (next + 1) & (DEVICE_HASH_SIZE - 1);
+    if (deviceHash[next] == DEVICE_SLOT_EMPTY) break;
+
+    uint32_t home = hashAddress(devices[deviceHash[next]].addrKey);
+    bool staysPut = (hole <= next) ? (hole < home && home <= next)
+                                   : (hole < home || home <= next);
+    if (!staysPut) {
+      deviceHash[hole] = deviceHash[next];
+      hole = next;
+    }
+  }
+  deviceHash[hole] = DEVICE_SLOT_EMPTY;
+
+  // Swap-remove from the dense list
+  int pos = slotPosition[slot];
+  int lastSlot = activeSlots[deviceCount - 1];
+  activeSlots[pos] = lastSlot;
+  slotPosition[lastSlot] = pos;
+  deviceCount--;
+
+  unlinkRecent(slot);
+  freeSlots[freeSlotCount++] = slot;
+}
+
+BLEDeviceInfo& deviceAt(int index) {
+  return devices[activeSlots[index]];
 }
 
-void updateDeviceList(String mac, String name, int rssi, String deviceType, String manufacturer) {
+void unlinkRecent(int slot) {
+  if (recentPrev[slot] != DEVICE_SLOT_EMPTY) recentNext[recentPrev[slot]] = recentNext[slot];
+  else recentHead = recentNext[slot];
+  if (recentNext[slot] != DEVICE_SLOT_EMPTY) recentPrev[recentNext[slot]] = recentPrev[slot];
+  else recentTail = recentPrev[slot];
+}
+
+// Moves slot to the head of the recency list
+void touchRecent(int slot) {
+  if (slot == recentHead) return;
+  unlinkRecent(slot);
+  recentPrev[slot] = DEVICE_SLOT_EMPTY;
+  recentNext[slot] = recentHead;
+  recentPrev[recentHead] = slot;
+  recentHead = slot;
+}
+
+void updateDeviceList(uint64_t addrKey, String mac, String name, int rssi, String deviceType, String manufacturer) {
   unsigned long currentTime = millis();
 
   // Check if device already exists
-  for (int i = 0; i < deviceCount; i++) {
-    if (devices[i].mac == mac) {
-      // Update existing device
-      devices[i].rssi = rssi;
-      devices[i].lastSeen = currentTime;
-      if (name != "Unknown" && devices[i].name == "Unknown") {
-        devices[i].name = name;
-      }
-      return;
+  int slot = findDeviceSlot(addrKey);
+  if (slot != DEVICE_SLOT_EMPTY) {
+    // Update existing device
+    BLEDeviceInfo& dev = devices[slot];
+    dev.rssi = rssi;
+    dev.lastSeen = currentTime;
+    if (name != "Unknown" && dev.name == "Unknown") {
+      dev.name = name;
+      namesResolved[scanActive]++;
+      resolveTotalMs[scanActive] += currentTime - dev.firstSeen;
     }
+    touchRecent(slot);
+    return;
   }
 
   // New device - add to list
   if (deviceCount >= MAX_TRACKED_DEVICES) {
     // Remove oldest device
-    int oldestIdx = 0;
-    for (int i = 1; i < deviceCount; i++) {
-      if (devices[i].lastSeen < devices[oldestIdx].lastSeen) {
-        oldestIdx = i;
-      }
-    }
-    for (int i = oldestIdx; i < deviceCount - 1; i++) {
-      devices[i] = devices[i + 1];
-    }
-    deviceCount--;
+    freeDeviceSlot(recentTail);
   }
 
   // Add new device
-  devices[deviceCount].mac = mac;
-  devices[deviceCount].name = name;
-  devices[deviceCount].rssi = rssi;
-  devices[deviceCount].deviceType = deviceType;
-  devices[deviceCount].manufacturer = manufacturer;
-  devices[deviceCount].lastSeen = currentTime;
-  deviceCount++;
+  BLEDeviceInfo& dev = devices[allocDeviceSlot(addrKey)];
+  dev.mac = mac;
+  dev.name = name;
+  dev.rssi = rssi;
+  dev.deviceType = deviceType;
+  dev.manufacturer = manufacturer;
+  dev.firstSeen = currentTime;
+  dev.lastSeen = currentTime;
+  dev.activeScans = 0;
+  queueUplinkSighting(dev);
 
   Serial.printf("NEW: %s (%s) RSSI: %d\n", name.c_str(), mac.c_str(), rssi);
 }
@@ -369,11 +609,8 @@ void pruneStaleDevices() {
   int i = 0;
 
   while (i < deviceCount) {
-    if (currentTime - devices[i].lastSeen > DEVICE_TIMEOUT) {
-      for (int j = i; j < deviceCount - 1; j++) {
-        devices[j] = devices[j + 1];
-      }
-      deviceCount--;
+    if (currentTime - deviceAt(i).lastSeen > DEVICE_TIMEOUT) {
+      freeDeviceSlot(activeSlots[i]);
     } else {
       i++;
     }
@@ -450,93 +687,132 @@ void updateDisplay() {
   int showCount = min(deviceCount, 2);
   for (int i = 0; i < showCount; i++) {
     display.setCursor(0, 52 + (i * 10));
-    String dispName = devices[i].name.substring(0, 12);
-    display.printf("%s %d", dispName.c_str(), devices[i].rssi);
+    String dispName = deviceAt(i).name.substring(0, 12);
+    display.printf("%s %d", dispName.c_str(), deviceAt(i).rssi);
   }
 
   display.display();
 }
 
 // ============================================================================
-// Server POST - The key test!
+// Server Uplink
 // ============================================================================
 
-void postLogsToServer() {
-  if (strlen(BLE_SERVER_URL) == 0) return;
-  if (strlen(BLE_API_KEY) == 0 || strcmp(BLE_API_KEY, "CHANGE_ME_AFTER_DEPLOY") == 0) {
-    Serial.println("WARNING: API key not configured");
-    return;
-  }
-
-  Serial.println("=== HTTPS POST Test ===");
-  Serial.printf("  Heap before POST: %d, Largest: %d\n", ESP.getFreeHeap(), ESP.getMaxAllocHeap());
-
-  // Build JSON payload - send most recently seen devices
-  int devicesToSend = min(deviceCount, 10);
-
-  // Create array of indices sorted by lastSeen (most recent first)
-  int sortedIndices[MAX_TRACKED_DEVICES];
-  for (int i = 0; i < deviceCount; i++) {
-    sortedIndices[i] = i;
-  }
-  // Simple bubble sort by lastSeen descending
-  for (int i = 0; i < deviceCount - 1; i++) {
-    for (int j = 0; j < deviceCount - i - 1; j++) {
-      if (devices[sortedIndices[j]].lastSeen < devices[sortedIndices[j+1]].lastSeen) {
-        int temp = sortedIndices[j];
-        sortedIndices[j] = sortedIndices[j+1];
-        sortedIndices[j+1] = temp;
-      }
-    }
-  }
+// New sightings collect in uplinkBacklog[] and go to the server in batches
+// of up to UPLINK_BATCH_MAX, once a batch is full or UPLINK_INTERVAL old. A
+// post is only started in the gap between scans and its timeouts end before
+// the next scan is due, so it never holds a scan up. HTTPClient is kept
+// between posts with reuse on, so batches share one keep-alive connection.
+// Failed posts back off from UPLINK_BACKOFF_MIN to UPLINK_BACKOFF_MAX; the
+// backlog keeps the newest UPLINK_BACKLOG sightings meanwhile (there is no
+// SD card to spill to on this board).
 
-  StaticJsonDocument<2048> doc;
-  doc["scanner_id"] = SCANNER_ID;
-
-  JsonArray devicesArray = doc.createNestedArray("devices");
-  for (int i = 0; i < devicesToSend; i++) {
-    int idx = sortedIndices[i];  // Use sorted index
-    JsonObject devObj = devicesArray.createNestedObject();
-    devObj["mac"] = devices[idx].mac;
-    devObj["name"] = devices[idx].name;
-    devObj["rssi"] = devices[idx].rssi;
-    devObj["device_type"] = devices[idx].deviceType;
-    devObj["manufacturer"] = devices[idx].manufacturer;
+void queueUplinkSighting(const BLEDeviceInfo& dev) {
+  if (uplinkCount == UPLINK_BACKLOG) {
+    uplinkHead = (uplinkHead + 1) % UPLINK_BACKLOG;
+    uplinkCount--;
+    uplinkDropped++;
   }
+  UplinkRecord& rec = uplinkBacklog[(uplinkHead + uplinkCount) % UPLINK_BACKLOG];
+  strlcpy(rec.mac, dev.mac.c_str(), sizeof(rec.mac));
+  strlcpy(rec.name, dev.name.c_str(), sizeof(rec.name));
+  rec.rssi = dev.rssi;
+  strlcpy(rec.deviceType, dev.deviceType.c_str(), sizeof(rec.deviceType));
+  strlcpy(rec.manufacturer, dev.manufacturer.c_str(), sizeof(rec.manufacturer));
+  rec.seenAt = millis();
+  uplinkCount++;
+}
 
-  char payload[2048];
-  serializeJson(doc, payload, sizeof(payload));
-
-  Serial.printf("  Posting %d devices (%d bytes)...\n", devicesToSend, strlen(payload));
+void serviceUplink() {
+  if (uplinkCount == 0 || scanInProgress) return;
+  if (strlen(BLE_SERVER_URL) == 0) return;
+  if (strlen(BLE_API_KEY) == 0 || strcmp(BLE_API_KEY, "CHANGE_ME_AFTER_DEPLOY") == 0) return;
+  if (WiFi.status() != WL_CONNECTED) return;
+
+  unsigned long now = millis();
+  if (uplinkBackoffMs > 0 && now - lastPostTime < uplinkBackoffMs) return;
+  bool due = uplinkCount >= UPLINK_BATCH_MAX ||
+             now - uplinkBacklog[uplinkHead].seenAt >= UPLINK_INTERVAL;
+  if (!due) return;
+
+  // Time left before loop() starts the next scan
+  unsigned long idle = now - lastScanTime;
+  if (idle + UPLINK_MIN_WINDOW > SCAN_INTERVAL) return;
+  unsigned long timeout = SCAN_INTERVAL - idle - UPLINK_GAP_MARGIN;
+
+  int posted = postLogsToServer(min(uplinkCount, UPLINK_BATCH_MAX), timeout);
+  uplinkHead = (uplinkHead + posted) % UPLINK_BACKLOG;
+  uplinkCount -= posted;
+}
 
-  // Attempt HTTPS POST (the key test!)
-  HTTPClient http;
+// LogBatch JSON of the oldest count sightings, as many as fit in
+// uplinkPayload. Returns how many were encoded; length receives the size.
+int encodeUplinkJson(int count, size_t& length) {
+  size_t used = snprintf(uplinkPayload, sizeof(uplinkPayload), "{\"scanner_id\":\"%s\",\"devices\":[", SCANNER_ID);
+  int encoded = 0;
+  for (; encoded < count; encoded++) {
+    const UplinkRecord& rec = uplinkBacklog[(uplinkHead + encoded) % UPLINK_BACKLOG];
+    StaticJsonDocument<256> doc;
+    doc["mac"] = rec.mac;
+    doc["name"] = rec.name;
+    doc["rssi"] = rec.rssi;
+    doc["device_type"] = rec.deviceType;
+    doc["manufacturer"] = rec.manufacturer;
+
+    // Separator, then room left for the closing "]}" and NUL
+    if (used + measureJson(doc) + 4 > sizeof(uplinkPayload)) break;
+    if (encoded > 0) uplinkPayload[used++] = ',';
+    used += serializeJson(doc, uplinkPayload + used, sizeof(uplinkPayload) - used);
+  }
+  uplinkPayload[used++] = ']';
+  uplinkPayload[used++] = '}';
+  uplinkPayload[used] = '\0';
+  length = used;
+  return encoded;
+}
 
-  if (!http.begin(BLE_SERVER_URL)) {
+// Posts the oldest count sightings with connect and response timeouts of
+// timeoutMs. Returns how many the server accepted (0 on failure).
+int postLogsToServer(int count, unsigned long timeoutMs) {
+  size_t length = 0;
+  int encoded = encodeUplinkJson(count, length);
+  if (encoded == 0) return 0;
+
+  Serial.printf("  Posting %d sightings (%d bytes), %lu ms of scan gap left...\n",
+                encoded, (int)length, timeoutMs);
+
+  lastPostTime = millis();
+  bool reused = uplinkHttp.connected();
+  int httpCode = HTTPC_ERROR_CONNECTION_REFUSED;
+  if (uplinkHttp.begin(BLE_SERVER_URL)) {
+    uplinkHttp.setConnectTimeout(timeoutMs);
+    uplinkHttp.setTimeout(timeoutMs);
+    uplinkHttp.addHeader("Content-Type", "application/json");
+    uplinkHttp.addHeader("Authorization", String("Bearer ") + BLE_API_KEY);
+    httpCode = uplinkHttp.POST((uint8_t*)uplinkPayload, length);
+    uplinkHttp.end();  // Keeps the socket open when the server allows it
+  } else {
     Serial.println("  http.begin() failed!");
-    postFailCount++;
-    return;
   }
+  unsigned long latency = millis() - lastPostTime;
 
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Authorization", String("Bearer ") + BLE_API_KEY);
-  http.setTimeout(15000);
-
-  int httpCode = http.POST(payload);
-
-  Serial.printf("  Heap after POST: %d, Largest: %d\n", ESP.getFreeHeap(), ESP.getMaxAllocHeap());
-
-  if (httpCode == 200) {
-    Serial.printf("  SUCCESS! HTTP %d\n", httpCode);
+  if (httpCode >= 200 && httpCode < 300) {
+    Serial.printf("  SUCCESS! HTTP %d in %lu ms%s\n", httpCode, latency, reused ? " (connection reused)" : "");
     postSuccessCount++;
-  } else if (httpCode > 0) {
-    Serial.printf("  HTTP Error: %d\n", httpCode);
-    postFailCount++;
-  } else {
-    Serial.printf("  Connection Error: %d (%s)\n", httpCode, http.errorToString(httpCode).c_str());
-    postFailCount++;
+    uplinkBackoffMs = 0;
+    uplinkLastBatch = encoded;
+    uplinkLastLatencyMs = latency;
+    if (latency > uplinkMaxLatencyMs) uplinkMaxLatencyMs = latency;
+    return encoded;
   }
 
-  http.end();
-  Serial.println("=== POST Complete ===\n");
+  postFailCount++;
+  uplinkBackoffMs = constrain(uplinkBackoffMs * 2, (unsigned long)UPLINK_BACKOFF_MIN, (unsigned long)UPLINK_BACKOFF_MAX);
+  if (httpCode > 0) {
+    Serial.printf("  HTTP Error: %d, retrying in %lu ms\n", httpCode, uplinkBackoffMs);
+  } else {
+    Serial.printf("  Connection Error: %d (%s), retrying in %lu ms\n", httpCode,
+                  uplinkHttp.errorToString(httpCode).c_str(), uplinkBackoffMs);
+  }
+  return 0;
 }
@@ -0,0 +1,159 @@
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"time"
+)
+
+// BinaryBatchContentType selects the compact batch encoding on POST /api/logs.
+// Scanners use it instead of JSON to fit many more sightings per request; any
+// other content type is decoded as a JSON LogBatch.
+//
+// All integers are little endian:
+//
+//	header  u8 version (1), u8 scanner ID length, scanner ID bytes,
+//	        u32 base time (epoch seconds), u16 record count
+//	record  u8 flags, 6-byte MAC, i8 RSSI, u8 device type, u8 manufacturer,
+//	        [varint time delta], [u8 name length, name bytes]
+//
+// Flags bits 0-1 hold the status code; bit 2 means a time delta follows, bit
+// 3 that a name does. Time deltas are zigzag LEB128 varints in seconds from
+// the previous timestamped record (the first from the base time). Records
+// without a time are stamped on arrival, like JSON entries without one.
+const BinaryBatchContentType = "application/x-ble-batch"
+
+const (
+	binaryBatchVersion  = 1
+	binaryFlagStatus    = 0x03
+	binaryFlagTime      = 0x04
+	binaryFlagName      = 0x08
+	binaryRecordMinSize = 10
+	maxBinaryBatchBytes = 1 << 20
+)
+
+// Code tables; these mirror DEVICE_TYPE_NAMES, MANUFACTURER_NAMES and
+// LOG_STATUS_NAMES in ble-scanner.ino and must change with them
+var (
+	deviceTypeNames = []string{
+		"Unknown", "iBeacon", "AirDrop", "AirPods", "AirPlay", "AirTag", "Apple",
+		"Samsung", "Google", "Microsoft", "Tile", "Wearable", "BLE Device", "HID",
+		"Beacon", "Phone", "Audio", "Tracker",
+	}
+	manufacturerNames = []string{
+		"Unknown", "Apple", "Samsung", "Google", "Microsoft", "Tile", "Garmin",
+		"Huawei", "Xiaomi", "Nordic", "Sony",
+	}
+	statusNames = []string{"unknown", "new", "known", "unknown"}
+)
+
+var errShortBatch = errors.New("batch truncated")
+
+// batchReader walks a binary batch; the first read past the end sets err and
+// every later read returns zero
+type batchReader struct {
+	data []byte
+	pos  int
+	err  error
+}
+
+func (b *batchReader) bytes(n int) []byte {
+	if b.err != nil || n > len(b.data)-b.pos {
+		b.err = errShortBatch
+		return nil
+	}
+	out := b.data[b.pos : b.pos+n]
+	b.pos += n
+	return out
+}
+
+func (b *batchReader) u8() uint8 {
+	if p := b.bytes(1); p != nil {
+		return p[0]
+	}
+	return 0
+}
+
+func (b *batchReader) u16() uint16 {
+	if p := b.bytes(2); p != nil {
+		return binary.LittleEndian.Uint16(p)
+	}
+	return 0
+}
+
+func (b *batchReader) u32() uint32 {
+	if p := b.bytes(4); p != nil {
+		return binary.LittleEndian.Uint32(p)
+	}
+	return 0
+}
+
+func (b *batchReader) varint() int64 {
+	if b.err != nil {
+		return 0
+	}
+	v, n := binary.Varint(b.data[b.pos:])
+	if n <= 0 {
+		b.err = errShortBatch
+		return 0
+	}
+	b.pos += n
+	return v
+}
+
+func codeName(names []string, code uint8) string {
+	if int(code) < len(names) {
+		return names[code]
+	}
+	return names[0]
+}
+
+// decodeBinaryBatch parses a BinaryBatchContentType body
+func decodeBinaryBatch(data []byte) (LogBatch, error) {
+	var batch LogBatch
+	b := &batchReader{data: data}
+
+	if version := b.u8(); b.err == nil && version != binaryBatchVersion {
+		return batch, fmt.Errorf("unsupported batch version %d", version)
+	}
+	batch.ScannerID = string(b.bytes(int(b.u8())))
+	lastTime := int64(b.u32())
+	count := int(b.u16())
+	if b.err != nil {
+		return batch, b.err
+	}
+	if count*binaryRecordMinSize > len(data)-b.pos {
+		return batch, errShortBatch
+	}
+
+	batch.Devices = make([]LogEntry, 0, count)
+	for i := 0; i < count; i++ {
+		flags := b.u8()
+		mac := b.bytes(6)
+		entry := LogEntry{
+			RSSI:         int(int8(b.u8())),
+			DeviceType:   codeName(deviceTypeNames, b.u8()),
+			Manufacturer: codeName(manufacturerNames, b.u8()),
+			Status:       statusNames[flags&binaryFlagStatus],
+			Name:         "Unknown",
+		}
+		if flags&binaryFlagTime != 0 {
+			lastTime += b.varint()
+			entry.Timestamp = time.Unix(lastTime, 0).UTC()
+		}
+		if flags&binaryFlagName != 0 {
+			entry.Name = string(b.bytes(int(b.u8())))
+		}
+		if b.err != nil {
+			return batch, b.err
+		}
+		entry.MAC = fmt.Sprintf("%02X:%02X:%02X:%02X:%02X:%02X",
+			mac[0], mac[1], mac[2], mac[3], mac[4], mac[5])
+		batch.Devices = append(batch.Devices, entry)
+	}
+	if b.pos != len(data) {
+		return batch, errors.New("trailing bytes after batch")
+	}
+	return batch, nil
+}
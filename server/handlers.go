@@ -2,7 +2,9 @@ package main
 
 import (
 	"encoding/json"
+	"io"
 	"log"
+	"mime"
 	"net/http"
 	"strconv"
 	"strings"
@@ -41,10 +43,22 @@ func APIKeyAuth(apiKey string) func(http.Handler) http.Handler {
 }
 
 // HandlePostLogs handles POST /api/logs - receive logs from scanner
+// (JSON LogBatch, or BinaryBatchContentType from the scanner firmware)
 func HandlePostLogs(w http.ResponseWriter, r *http.Request) {
 	var batch LogBatch
 
-	if err := json.NewDecoder(r.Body).Decode(&batch); err != nil {
+	mediaType, _, _ := mime.ParseMediaType(r.Header.Get("Content-Type"))
+	if mediaType == BinaryBatchContentType {
+		body, err := io.ReadAll(http.MaxBytesReader(w, r.Body, maxBinaryBatchBytes))
+		if err == nil {
+			batch, err = decodeBinaryBatch(body)
+		}
+		if err != nil {
+			log.Printf("Error decoding binary log batch: %v", err)
+			http.Error(w, "Invalid batch", http.StatusBadRequest)
+			return
+		}
+	} else if err := json.NewDecoder(r.Body).Decode(&batch); err != nil {
 		log.Printf("Error decoding log batch: %v", err)
 		http.Error(w, "Invalid JSON", http.StatusBadRequest)
 		return